@@ -0,0 +1,666 @@
+// All kernels of the repository in one benchmark executable, see README.md.
+// Usage: Bench [--list] [--filter=regex] [--sizes=a,b] [--threads=1,2,4]
+//              [--ranks=1,2,4] [--reps=N] [--warmup=N] [--min-sample=s]
+//              [--json=path] [--csv=path]
+//        Bench --compare base.json current.json [--threshold=0.05]
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "../cufft/bigint.hpp"
+#include "../cufft/fft_cpu.hpp"
+#include "../cufft/fft_tune.hpp"
+#include "../openmp/filters.hpp"
+#include "../openmp/lu.hpp"
+#include "../openmp/numa_alloc.h"
+#include "../openmp/ppm.hpp"
+#include "../openmp/reduce.h"
+#include "bench.hpp"
+
+using std::string, std::vector;
+
+/// Uniform [-1, 1) doubles, the same for a given seed
+vector<double> RandomVector(long n, unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dist(-1.0, 1.0);
+  vector<double> x(n);
+  for (auto &v : x) {
+    v = dist(gen);
+  }
+  return x;
+}
+
+// GEMM: C = A * B for n x n row-major matrices, the i-n-j order of MatMul.c
+static bool gemm = BenchRegistry::Add(
+    {"gemm", {256, 512, 1024}, [](long n) {
+       auto A = std::make_shared<vector<double>>(RandomVector(n * n, 1));
+       auto B = std::make_shared<vector<double>>(RandomVector(n * n, 2));
+       auto C = std::make_shared<vector<double>>(n * n);
+       BenchInstance instance;
+       instance.run = [=] {
+         const double *a = A->data(), *b = B->data();
+         double *c = C->data();
+#pragma omp parallel for
+         for (long i = 0; i < n; ++i) {
+           std::fill(c + i * n, c + (i + 1) * n, 0.0);
+           for (long k = 0; k < n; ++k) {
+             const double aik = a[i * n + k];
+#pragma omp simd
+             for (long j = 0; j < n; ++j) {
+               c[i * n + j] += aik * b[k * n + j];
+             }
+           }
+         }
+       };
+       instance.work = {2.0 * n * n * n, 4.0 * sizeof(double) * n * n};
+       instance.check = [=] {
+         for (long i : {0L, n / 2, n - 1}) {
+           double dot = 0;
+           for (long k = 0; k < n; ++k) {
+             dot += (*A)[i * n + k] * (*B)[k * n + n - 1 - i];
+           }
+           if (std::abs(dot - (*C)[i * n + n - 1 - i]) > 1e-9 * n) {
+             return false;
+           }
+         }
+         return true;
+       };
+       return instance;
+     }});
+
+// A x = b of openmp/lu.hpp: LU in double, and LU in float with iterative
+// refinement to the same accuracy; diagonally weighted random A
+static void AddLUBenchmark(const string &name, bool mixed) {
+  BenchRegistry::Add(
+      {name, {1024, 2048}, [=](long n) {
+         auto A = std::make_shared<vector<double>>(RandomVector(n * n, 1));
+         for (long i = 0; i < n; ++i) {
+           (*A)[i * n + i] += std::sqrt((double)n);
+         }
+         auto b = std::make_shared<vector<double>>(RandomVector(n, 2));
+         auto x = std::make_shared<vector<double>>(n);
+         BenchInstance instance;
+         instance.run = [=] {
+           if (mixed) {
+             MixedSolve(n, A->data(), b->data(), x->data());
+             return;
+           }
+           LU<double> lu(n);
+           std::copy(A->begin(), A->end(), lu.Data());
+           lu.Factor();
+           *x = *b;
+           lu.Solve(x->data());
+         };
+         const double element = mixed ? sizeof(float) : sizeof(double);
+         instance.work = {2.0 / 3 * n * n * n, element * n * n};
+         instance.check = [=] {
+           vector<double> r(n);
+           Residual(n, A->data(), b->data(), x->data(), r.data());
+           return NormInf(r) / (NormInf(n, A->data()) * NormInf(*x) +
+                                NormInf(*b)) < 1e-14;
+         };
+         return instance;
+       }});
+}
+
+static bool lu = [] {
+  AddLUBenchmark("lu/double", false);
+  AddLUBenchmark("lu/mixed", true);
+  return true;
+}();
+
+// FFT::fft from cufft, forward and inverse of a fresh copy of the input, so
+// the check sees the error of one round trip
+static bool fft = BenchRegistry::Add(
+    {"fft", {1 << 12, 1 << 16, 1 << 20}, [](long n) {
+       auto a = std::make_shared<vector<fcomplex>>(n);
+       auto input = RandomVector(n, 3);
+       for (long i = 0; i < n; ++i) {
+         (*a)[i] = fcomplex(input[i], 0);
+       }
+       auto original = std::make_shared<vector<fcomplex>>(*a);
+       auto fft = std::make_shared<FFT>();
+       BenchInstance instance;
+       instance.run = [=] {
+         std::copy(original->begin(), original->end(), a->begin());
+         fft->fft(*a, false);
+         fft->fft(*a, true);
+       };
+       const double stages = std::log2((double)n);
+       instance.work = {2 * 5.0 * n * stages,
+                        2 * 2.0 * sizeof(fcomplex) * n * (stages + 1)};
+       instance.check = [=] {
+         double err = 0;
+         for (long i = 0; i < n; ++i) {
+           err = std::max(err, (double)std::abs((*a)[i] - (*original)[i]));
+         }
+         // single precision, log2(n) roundings each way
+         return err < 1e-3;
+       };
+       return instance;
+     }});
+
+// The same with the schedule of cufft/fft_tune.hpp, from the wisdom file
+// (tuned during the setup the first time a size is seen)
+static bool fft_tuned = BenchRegistry::Add(
+    {"fft/tuned", {1 << 12, 1 << 16, 1 << 20}, [](long n) {
+       static FFTTuner tuner;
+       auto a = std::make_shared<vector<fcomplex>>(n);
+       auto input = RandomVector(n, 3);
+       for (long i = 0; i < n; ++i) {
+         (*a)[i] = fcomplex(input[i], 0);
+       }
+       auto original = std::make_shared<vector<fcomplex>>(*a);
+       // tuned for the thread count of this configuration
+       const FFTParams params = tuner.params(n);
+       const TunableFFT *plan = &tuner.plan(n);
+       BenchInstance instance;
+       instance.run = [=] {
+         std::copy(original->begin(), original->end(), a->begin());
+         plan->execute(a->data(), false, params);
+         plan->execute(a->data(), true, params);
+       };
+       const double stages = std::log2((double)n);
+       instance.work = {2 * 5.0 * n * stages,
+                        2 * 2.0 * sizeof(fcomplex) * n * (stages + 1)};
+       instance.check = [=] {
+         double err = 0;
+         for (long i = 0; i < n; ++i) {
+           err = std::max(err, (double)std::abs((*a)[i] - (*original)[i]));
+         }
+         return err < 1e-3;
+       };
+       return instance;
+     }});
+
+// Polynomial product through FFT::mult, n coefficients each. In single
+// precision the rounded product is exact only up to a few thousand
+// coefficients of this size; larger --sizes fail the check.
+static bool polymul = BenchRegistry::Add(
+    {"polymul", {1000, 4000}, [](long n) {
+       auto a = std::make_shared<vector<int>>(n);
+       auto b = std::make_shared<vector<int>>(n);
+       for (long i = 0; i < n; ++i) {
+         (*a)[i] = i % 3;
+         (*b)[i] = (i + 1) % 2;
+       }
+       auto product = std::make_shared<vector<int>>();
+       BenchInstance instance;
+       instance.run = [=] { *product = FFT().mult(*a, *b); };
+       long m = 1;
+       while (m < n) {
+         m <<= 1;
+       }
+       m <<= 1;
+       const double stages = std::log2((double)m);
+       instance.work = {3 * 5.0 * m * stages + 6.0 * m,
+                        3 * 2.0 * sizeof(fcomplex) * m * stages};
+       instance.check = [=] {
+         // a few coefficients against the direct sum
+         for (long k : {0L, n / 3, n - 1}) {
+           long direct = 0;
+           for (long i = 0; i <= k; ++i) {
+             direct += (long)(*a)[i] * (*b)[k - i];
+           }
+           if ((*product)[k] != direct) {
+             return false;
+           }
+         }
+         return true;
+       };
+       return instance;
+     }});
+
+/// x mod 2^61 - 1, a cheap fingerprint of a product
+uint64_t BigIntResidue(const BigInt &x) {
+  const uint64_t q = (uint64_t(1) << 61) - 1;
+  unsigned __int128 r = 0;
+  for (size_t i = x.limbs.size(); i-- > 0;) {
+    r = (r * BigInt::BASE + x.limbs[i]) % q;
+  }
+  return (uint64_t)r;
+}
+
+// Products of two random n-digit integers by the three methods of
+// cufft/bigint.hpp, checked modulo 2^61 - 1
+static void AddBigIntBenchmark(const string &name, vector<long> sizes,
+                               BigInt (*mult)(const BigInt &,
+                                              const BigInt &)) {
+  BenchRegistry::Add({name, sizes, [=](long n) {
+                        std::mt19937 gen(n);
+                        string da(n, '0'), db(n, '0');
+                        for (long i = 0; i < n; ++i) {
+                          da[i] += gen() % 10;
+                          db[i] += gen() % 10;
+                        }
+                        da[0] = db[0] = '9';
+                        auto a = std::make_shared<BigInt>(da);
+                        auto b = std::make_shared<BigInt>(db);
+                        auto c = std::make_shared<BigInt>();
+                        BenchInstance instance;
+                        instance.run = [=] { *c = mult(*a, *b); };
+                        // time only: the methods do different work
+                        instance.work = {0, 0};
+                        instance.check = [=] {
+                          const unsigned __int128 q = (uint64_t(1) << 61) - 1;
+                          return (unsigned __int128)BigIntResidue(*a) *
+                                         BigIntResidue(*b) % q ==
+                                 BigIntResidue(*c);
+                        };
+                        return instance;
+                      }});
+}
+
+static bool bigint = [] {
+  AddBigIntBenchmark("bigint/schoolbook", {10000, 100000},
+                     BigInt::mult_schoolbook);
+  AddBigIntBenchmark("bigint/karatsuba", {10000, 100000},
+                     BigInt::mult_karatsuba);
+  AddBigIntBenchmark("bigint/fft", {10000, 100000, 1000000}, BigInt::mult_fft);
+  return true;
+}();
+
+/// Elementary automaton step on cells [1, n], cells 0 and n + 1 are halos
+void CAStep(const int8_t *cur, int8_t *next, long n, const int8_t rule[8]) {
+#pragma omp parallel for simd
+  for (long i = 1; i <= n; ++i) {
+    next[i] = rule[cur[i - 1] * 4 + cur[i] * 2 + cur[i + 1]];
+  }
+}
+
+// Rule 30 with periodic boundaries as in mpi/cellular_automata.cpp; the
+// cells are split over the ranks, which exchange halo cells every step
+static bool ca = BenchRegistry::Add(
+    {"ca",
+     {1 << 20, 1 << 24},
+     [](long size) {
+       const int ranks = BenchRanks(), rank = BenchRank();
+       const long n = size / ranks;
+       struct State {
+         vector<int8_t> cur, next;
+         int8_t rule[8];
+       };
+       auto state = std::make_shared<State>();
+       state->cur.resize(n + 2);
+       state->next.resize(n + 2);
+       for (int k = 0; k < 8; ++k) {
+         state->rule[k] = (30 >> k) & 1;
+       }
+       std::mt19937 gen(rank);
+       for (long i = 1; i <= n; ++i) {
+         state->cur[i] = gen() & 1;
+       }
+       BenchInstance instance;
+       instance.run = [=] {
+         int8_t *cur = state->cur.data();
+#ifdef USE_MPI
+         const int left = (rank + ranks - 1) % ranks, right = (rank + 1) % ranks;
+         MPI_Sendrecv(cur + 1, 1, MPI_INT8_T, left, 0, cur + n + 1, 1,
+                      MPI_INT8_T, right, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+         MPI_Sendrecv(cur + n, 1, MPI_INT8_T, right, 1, cur, 1, MPI_INT8_T,
+                      left, 1, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
+#else
+         cur[0] = cur[n];
+         cur[n + 1] = cur[1];
+#endif
+         CAStep(cur, state->next.data(), n, state->rule);
+         state->cur.swap(state->next);
+       };
+       // one byte read and one written per cell
+       instance.work = {0, 2.0 * size};
+       return instance;
+     },
+     true});
+
+// 5-point Jacobi sweep on an n x n grid with fixed borders
+static bool stencil = BenchRegistry::Add(
+    {"stencil", {512, 2048, 4096}, [](long n) {
+       auto u = std::make_shared<vector<double>>(RandomVector(n * n, 4));
+       auto v = std::make_shared<vector<double>>(*u);
+       BenchInstance instance;
+       instance.run = [=] {
+         const double *in = u->data();
+         double *out = v->data();
+#pragma omp parallel for
+         for (long i = 1; i < n - 1; ++i) {
+#pragma omp simd
+           for (long j = 1; j < n - 1; ++j) {
+             out[i * n + j] = 0.25 * (in[(i - 1) * n + j] + in[(i + 1) * n + j] +
+                                      in[i * n + j - 1] + in[i * n + j + 1]);
+           }
+         }
+         u->swap(*v);
+       };
+       instance.work = {4.0 * n * n, 2.0 * sizeof(double) * n * n};
+       return instance;
+     }});
+
+// Sums: reproducible reduce_sum against plain reduction(+)
+static bool reduce_compensated = BenchRegistry::Add(
+    {"reduce/compensated", {1 << 16, 1 << 20, 1 << 24}, [](long n) {
+       auto x = std::make_shared<vector<double>>(RandomVector(n, 5));
+       auto sum = std::make_shared<double>(0);
+       BenchInstance instance;
+       instance.run = [=] { *sum = reduce_sum(x->data(), n); };
+       instance.work = {1.0 * n, 8.0 * n};
+       instance.check = [=] {
+         // NaN and infinities propagate like in a plain sum
+         vector<double> special(*x);
+         special[n / 2] = NAN;
+         const bool nan = std::isnan(reduce_sum(special.data(), n));
+         special[n / 2] = INFINITY;
+         const bool inf = reduce_sum(special.data(), n) == INFINITY;
+         special[n / 3] = -INFINITY;
+         const bool both = std::isnan(reduce_sum(special.data(), n));
+         return std::abs(*sum - reduce_sum_pairwise(x->data(), n)) < 1e-9 &&
+                nan && inf && both;
+       };
+       return instance;
+     }});
+
+static bool reduce_omp = BenchRegistry::Add(
+    {"reduce/omp", {1 << 16, 1 << 20, 1 << 24}, [](long n) {
+       auto x = std::make_shared<vector<double>>(RandomVector(n, 5));
+       auto sum = std::make_shared<double>(0);
+       BenchInstance instance;
+       instance.run = [=] {
+         const double *data = x->data();
+         double s = 0;
+#pragma omp parallel for simd reduction(+ : s)
+         for (long i = 0; i < n; ++i) {
+           s += data[i];
+         }
+         *sum = s;
+       };
+       instance.work = {1.0 * n, 8.0 * n};
+       instance.check = [=] {
+         return std::abs(*sum - reduce_sum(x->data(), n)) < 1e-9;
+       };
+       return instance;
+     }});
+
+#ifdef USE_MPI
+// reduce_sum_mpi over the ranks, every rank holding size / ranks elements
+static bool reduce_mpi = BenchRegistry::Add(
+    {"reduce/mpi",
+     {1 << 20, 1 << 24},
+     [](long size) {
+       const long n = size / BenchRanks();
+       auto x = std::make_shared<vector<double>>(n, 0.5);
+       auto sum = std::make_shared<double>(0);
+       BenchInstance instance;
+       instance.run = [=] { *sum = reduce_sum_mpi(x->data(), n, MPI_COMM_WORLD); };
+       instance.work = {1.0 * size, 8.0 * size};
+       instance.check = [=] { return *sum == 0.5 * n * BenchRanks(); };
+       return instance;
+     },
+     true});
+#endif
+
+/// STREAM triad a = b + s * c on arrays from numa_alloc, initialized by one
+/// thread (all pages on its socket) or by the triad's own static schedule
+BenchInstance Triad(long n, bool first_touch) {
+  struct Arrays {
+    long n;
+    double *a, *b, *c;
+    ~Arrays() {
+      numa_free(a);
+      numa_free(b);
+      numa_free(c);
+    }
+  };
+  auto arrays = std::make_shared<Arrays>();
+  arrays->n = n;
+  arrays->a = (double *)numa_alloc(n * sizeof(double));
+  arrays->b = (double *)numa_alloc(n * sizeof(double));
+  arrays->c = (double *)numa_alloc(n * sizeof(double));
+  double *a = arrays->a, *b = arrays->b, *c = arrays->c;
+  if (first_touch) {
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+      a[i] = 0;
+      b[i] = 1;
+      c[i] = 2;
+    }
+  } else {
+    for (long i = 0; i < n; ++i) {
+      a[i] = 0;
+      b[i] = 1;
+      c[i] = 2;
+    }
+  }
+  BenchInstance instance;
+  instance.run = [arrays, a, b, c, n] {
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+      a[i] = b[i] + 0.5 * c[i];
+    }
+  };
+  instance.work = {2.0 * n, 3.0 * sizeof(double) * n};
+  return instance;
+}
+
+// Scaling beyond one socket: Bench --filter=triad --threads=1,2,...
+static bool triad_serial = BenchRegistry::Add(
+    {"triad/serial-init", {1 << 25}, [](long n) { return Triad(n, false); }});
+static bool triad_first_touch = BenchRegistry::Add(
+    {"triad/first-touch", {1 << 25}, [](long n) { return Triad(n, true); }});
+
+/// side x side test image: gradients and a checkerboard
+std::shared_ptr<PPMImage> TestImage(long side) {
+  auto image = std::shared_ptr<PPMImage>(new PPMImage, [](PPMImage *img) {
+    delete[] img->data;
+    delete img;
+  });
+  image->x = image->y = side;
+  image->all = side * side;
+  image->data = new PPMPixel[image->all];
+  for (long i = 0; i < side; ++i) {
+    for (long j = 0; j < side; ++j) {
+      image->data[i * side + j] = {int(i * 255 / side), int(j * 255 / side),
+                                   int((i / 8 + j / 8) % 2) * 255};
+    }
+  }
+  return image;
+}
+
+// Image operations of Car.cpp and Filters.cpp on a side x side image
+static bool image_rotate = BenchRegistry::Add(
+    {"image/rotate", {512, 2048}, [](long side) {
+       auto image = TestImage(side);
+       BenchInstance instance;
+       instance.run = [=] { rotatePPM(*image, side / 3); };
+       instance.work = {0, 2.0 * sizeof(PPMPixel) * side * side};
+       return instance;
+     }});
+
+static bool image_gaussian = BenchRegistry::Add(
+    {"image/gaussian", {512, 2048}, [](long side) {
+       auto image = TestImage(side), blurred = TestImage(side);
+       const double sigma = 2;
+       BenchInstance instance;
+       instance.run = [=] { gaussianBlurPPM(*image, *blurred, sigma); };
+       const double taps = GaussianKernel(sigma).size();
+       // two passes of multiply-adds per channel, planes split and merged
+       instance.work = {3 * 2 * 2 * taps * side * side,
+                        3 * 4.0 * sizeof(float) * side * side};
+       return instance;
+     }});
+
+static bool image_median = BenchRegistry::Add(
+    {"image/median", {512, 2048}, [](long side) {
+       auto image = TestImage(side), filtered = TestImage(side);
+       BenchInstance instance;
+       instance.run = [=] { medianFilterPPM(*image, *filtered, 2); };
+       instance.work = {0, 3 * 2.0 * side * side};
+       return instance;
+     }});
+
+/// "--name=value" -> value, or nullptr
+const char *Option(const string &arg, const char *name) {
+  const size_t len = strlen(name);
+  return arg.compare(0, len, name) == 0 && arg.size() > len && arg[len] == '='
+             ? arg.c_str() + len + 1
+             : nullptr;
+}
+
+vector<long> ParseList(const char *text) {
+  vector<long> values;
+  std::stringstream list(text);
+  for (string value; std::getline(list, value, ',');) {
+    values.push_back(std::stol(value));
+  }
+  return values;
+}
+
+/// Run this executable under `$MPIRUN -np r` (default mpirun) for every rank
+/// count and collect the results
+vector<BenchResult> RankSweep(const char *self, const vector<string> &args,
+                              const vector<long> &ranks) {
+  const char *mpirun = std::getenv("MPIRUN");
+  vector<BenchResult> results;
+  for (long r : ranks) {
+    const string path = "bench_ranks_" + std::to_string(r) + ".json";
+    string command = string(mpirun ? mpirun : "mpirun") + " -np " +
+                     std::to_string(r) + " " + self;
+    for (const auto &arg : args) {
+      if (!Option(arg, "--ranks") && !Option(arg, "--json") &&
+          !Option(arg, "--csv")) {
+        command += " '" + arg + "'";
+      }
+    }
+    command += " --json=" + path;
+    printf("%s\n", command.c_str());
+    fflush(stdout);
+    if (std::system(command.c_str()) != 0) {
+      fprintf(stderr, "%d ranks failed\n", (int)r);
+      continue;
+    }
+    for (auto &result : BenchRead(path)) {
+      results.push_back(result);
+    }
+    std::remove(path.c_str());
+  }
+  return results;
+}
+
+int main(int argc, char *argv[]) {
+  const vector<string> args(argv + 1, argv + argc);
+
+  if (!args.empty() && args[0] == "--compare") {
+    if (args.size() < 3) {
+      fprintf(stderr, "usage: Bench --compare base current [--threshold=x]\n");
+      return 2;
+    }
+    double threshold = 0.05;
+    if (args.size() > 3 && Option(args[3], "--threshold")) {
+      threshold = std::stod(Option(args[3], "--threshold"));
+    }
+    int regressions =
+        BenchCompare(BenchRead(args[1]), BenchRead(args[2]), threshold, stdout);
+    printf("%d regression(s)\n", regressions);
+    return regressions > 0 ? 1 : 0;
+  }
+
+  BenchOptions options;
+  options.threads = {omp_get_max_threads()};
+  std::regex filter(".*");
+  vector<long> sizes, ranks;
+  string json, csv;
+  bool list = false;
+  for (const auto &arg : args) {
+    if (const char *v = Option(arg, "--filter")) {
+      filter = std::regex(v);
+    } else if (const char *v = Option(arg, "--sizes")) {
+      sizes = ParseList(v);
+    } else if (const char *v = Option(arg, "--threads")) {
+      options.threads.clear();
+      for (long t : ParseList(v)) {
+        options.threads.push_back(t);
+      }
+    } else if (const char *v = Option(arg, "--ranks")) {
+      ranks = ParseList(v);
+    } else if (const char *v = Option(arg, "--reps")) {
+      options.reps = std::stoi(v);
+    } else if (const char *v = Option(arg, "--warmup")) {
+      options.warmup = std::stoi(v);
+    } else if (const char *v = Option(arg, "--min-sample")) {
+      options.min_sample = std::stod(v);
+    } else if (const char *v = Option(arg, "--json")) {
+      json = v;
+    } else if (const char *v = Option(arg, "--csv")) {
+      csv = v;
+    } else if (arg == "--list") {
+      list = true;
+    } else {
+      fprintf(stderr, "unknown option %s\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  vector<BenchResult> results;
+  if (!ranks.empty()) {
+    results = RankSweep(argv[0], args, ranks);
+  } else {
+#ifdef USE_MPI
+    MPI_Init(&argc, &argv);
+#endif
+    const bool root = BenchRank() == 0;
+    if (BenchRanks() == 1) {
+      // ranks on one node share the CPUs, leave their binding to mpirun
+      numa_bind_threads();
+    }
+    if (root && !list) {
+      BenchPrintHeader(stdout);
+    }
+    for (const auto &benchmark : BenchRegistry::All()) {
+      if (!std::regex_search(benchmark.name, filter) ||
+          (!benchmark.distributed && BenchRanks() > 1)) {
+        continue;
+      }
+      if (list) {
+        if (root) {
+          printf("%s%s\n", benchmark.name.c_str(),
+                 benchmark.distributed ? " (distributed)" : "");
+        }
+        continue;
+      }
+      for (long size : sizes.empty() ? benchmark.sizes : sizes) {
+        for (int threads : options.threads) {
+          results.push_back(BenchMeasure(benchmark, size, threads, options));
+          if (root) {
+            BenchPrint(stdout, results.back());
+            fflush(stdout);
+          }
+        }
+      }
+    }
+#ifdef USE_MPI
+    MPI_Finalize();
+#endif
+    if (!root) {
+      return 0;
+    }
+  }
+
+  if (!json.empty() && !BenchWriteJSON(json, results)) {
+    fprintf(stderr, "cannot write %s\n", json.c_str());
+  }
+  if (!csv.empty() && !BenchWriteCSV(csv, results)) {
+    fprintf(stderr, "cannot write %s\n", csv.c_str());
+  }
+  int failed = 0;
+  for (const auto &result : results) {
+    failed += !result.ok;
+  }
+  return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,413 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+#include <omp.h>
+#include <unistd.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+// Benchmark harness shared by all kernels of the repository.
+//
+// A benchmark is a named setup function: given a problem size it prepares
+// the data and returns an Instance whose run() executes the kernel once,
+// together with the work of one run (for GFLOP/s and GB/s) and an optional
+// correctness check. The harness sweeps sizes and thread counts, warms up,
+// groups runs into samples long enough for the clock, repeats them and
+// keeps order statistics of the time per run. Results go to JSON and CSV
+// files that Compare reads back to flag regressions between two runs.
+//
+// Under MPI (USE_MPI) samples start after a barrier and the slowest rank's
+// time is kept; benchmarks not marked distributed only run on one rank.
+
+/// Work of one run of a kernel, from the algorithm
+struct BenchWork {
+  double flops = 0;
+  double bytes = 0;
+};
+
+/// A kernel prepared for one problem size
+struct BenchInstance {
+  std::function<void()> run;
+  BenchWork work;
+  /// Called after the measurements, false marks the result as failed
+  std::function<bool()> check;
+};
+
+struct Benchmark {
+  std::string name; // "group/variant"
+  std::vector<long> sizes;
+  std::function<BenchInstance(long size)> setup;
+  /// Splits its problem over the ranks of MPI_COMM_WORLD
+  bool distributed = false;
+};
+
+class BenchRegistry {
+public:
+  static std::vector<Benchmark> &All() {
+    static std::vector<Benchmark> benchmarks;
+    return benchmarks;
+  }
+
+  /// For static registration: `static bool x = BenchRegistry::Add({...});`
+  static bool Add(Benchmark benchmark) {
+    All().push_back(std::move(benchmark));
+    return true;
+  }
+};
+
+struct BenchOptions {
+  int warmup = 1;
+  int reps = 10;
+  /// Shortest sample: fast kernels are run several times per sample
+  double min_sample = 1e-3;
+  std::vector<int> threads;
+};
+
+/// Statistics of one (kernel, size, threads, ranks) configuration, times in
+/// seconds per run
+struct BenchResult {
+  std::string name;
+  long size = 0;
+  int threads = 1;
+  int ranks = 1;
+  int reps = 0;
+  long runs_per_sample = 1;
+  double min = 0, q1 = 0, median = 0, q3 = 0, max = 0, mean = 0, stddev = 0;
+  double gflops = 0, gbs = 0;
+  bool ok = true;
+
+  std::string Key() const {
+    return name + "/" + std::to_string(size) + "/t" + std::to_string(threads) +
+           "/r" + std::to_string(ranks);
+  }
+};
+
+inline int BenchRank() {
+  int rank = 0;
+#ifdef USE_MPI
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+  return rank;
+}
+
+inline int BenchRanks() {
+  int ranks = 1;
+#ifdef USE_MPI
+  MPI_Comm_size(MPI_COMM_WORLD, &ranks);
+#endif
+  return ranks;
+}
+
+/// Seconds for `runs` runs, the slowest rank's under MPI
+inline double BenchSample(const BenchInstance &instance, long runs,
+                          bool distributed) {
+#ifdef USE_MPI
+  if (distributed) {
+    MPI_Barrier(MPI_COMM_WORLD);
+  }
+#endif
+  const double start = omp_get_wtime();
+  for (long k = 0; k < runs; ++k) {
+    instance.run();
+  }
+  double seconds = omp_get_wtime() - start;
+#ifdef USE_MPI
+  if (distributed) {
+    MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX,
+                  MPI_COMM_WORLD);
+  }
+#else
+  (void)distributed;
+#endif
+  return seconds;
+}
+
+/// Linear interpolation between order statistics of sorted values
+inline double BenchQuantile(const std::vector<double> &sorted, double q) {
+  const double pos = q * (sorted.size() - 1);
+  const size_t lo = (size_t)pos;
+  const size_t hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+inline BenchResult BenchMeasure(const Benchmark &benchmark, long size,
+                                int threads, const BenchOptions &options) {
+  omp_set_num_threads(threads);
+  BenchInstance instance = benchmark.setup(size);
+  const bool distributed = benchmark.distributed;
+
+  // warm-up runs also find how many runs make a sample
+  long runs = 1;
+  for (int w = 0; w < std::max(1, options.warmup); ++w) {
+    double seconds = BenchSample(instance, runs, distributed);
+    while (seconds < options.min_sample) {
+      runs *= seconds > 0 ? std::min(10.0, 2 * options.min_sample / seconds)
+                          : 10;
+      seconds = BenchSample(instance, runs, distributed);
+    }
+  }
+
+  std::vector<double> times;
+  for (int r = 0; r < options.reps; ++r) {
+    times.push_back(BenchSample(instance, runs, distributed) / runs);
+  }
+  std::sort(times.begin(), times.end());
+
+  BenchResult result;
+  result.name = benchmark.name;
+  result.size = size;
+  result.threads = threads;
+  result.ranks = distributed ? BenchRanks() : 1;
+  result.reps = times.size();
+  result.runs_per_sample = runs;
+  result.min = times.front();
+  result.max = times.back();
+  result.q1 = BenchQuantile(times, 0.25);
+  result.median = BenchQuantile(times, 0.5);
+  result.q3 = BenchQuantile(times, 0.75);
+  for (double t : times) {
+    result.mean += t / times.size();
+  }
+  for (double t : times) {
+    result.stddev += (t - result.mean) * (t - result.mean);
+  }
+  result.stddev = std::sqrt(result.stddev / std::max<size_t>(1, times.size() - 1));
+  result.gflops = instance.work.flops / result.median * 1e-9;
+  result.gbs = instance.work.bytes / result.median * 1e-9;
+  if (instance.check) {
+    result.ok = instance.check();
+#ifdef USE_MPI
+    if (distributed) {
+      int ok = result.ok;
+      MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_LAND, MPI_COMM_WORLD);
+      result.ok = ok;
+    }
+#endif
+  }
+  return result;
+}
+
+inline void BenchPrintHeader(FILE *out) {
+  fprintf(out, "%-22s %10s %4s %4s %12s %12s %8s %9s %8s\n", "benchmark",
+          "size", "thr", "rnk", "median, s", "min, s", "+-%", "GFLOP/s",
+          "GB/s");
+}
+
+inline void BenchPrint(FILE *out, const BenchResult &r) {
+  fprintf(out, "%-22s %10ld %4d %4d %12.4e %12.4e %8.1f %9.2f %8.2f%s\n",
+          r.name.c_str(), r.size, r.threads, r.ranks, r.median, r.min,
+          r.median > 0 ? 50 * (r.q3 - r.q1) / r.median : 0, r.gflops, r.gbs,
+          r.ok ? "" : "  CHECK FAILED");
+}
+
+/// Host, compiler and date of a run, stored with the results
+inline std::map<std::string, std::string> BenchMachine() {
+  char host[256] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+  char date[64];
+  std::time_t now = std::time(nullptr);
+  std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", std::localtime(&now));
+  return {{"host", host},
+          {"date", date},
+          {"compiler", __VERSION__},
+          {"cores", std::to_string(std::thread::hardware_concurrency())}};
+}
+
+static const char *const BENCH_CSV_HEADER =
+    "name,size,threads,ranks,reps,runs_per_sample,min,q1,median,q3,max,mean,"
+    "stddev,gflops,gbs,ok";
+
+inline bool BenchWriteCSV(const std::string &path,
+                          const std::vector<BenchResult> &results) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fprintf(file, "%s\n", BENCH_CSV_HEADER);
+  for (const auto &r : results) {
+    fprintf(file, "%s,%ld,%d,%d,%d,%ld,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%.6e,%g,%g,%d\n",
+            r.name.c_str(), r.size, r.threads, r.ranks, r.reps,
+            r.runs_per_sample, r.min, r.q1, r.median, r.q3, r.max, r.mean,
+            r.stddev, r.gflops, r.gbs, (int)r.ok);
+  }
+  fclose(file);
+  return true;
+}
+
+/// One result object per line, so the file is also easy to grep and diff
+inline bool BenchWriteJSON(const std::string &path,
+                           const std::vector<BenchResult> &results) {
+  FILE *file = fopen(path.c_str(), "w");
+  if (file == nullptr) {
+    return false;
+  }
+  fprintf(file, "{\"machine\":{");
+  bool first = true;
+  for (const auto &[key, value] : BenchMachine()) {
+    fprintf(file, "%s\"%s\":\"%s\"", first ? "" : ",", key.c_str(),
+            value.c_str());
+    first = false;
+  }
+  fprintf(file, "},\n\"results\":[\n");
+  for (size_t i = 0; i < results.size(); ++i) {
+    const auto &r = results[i];
+    fprintf(file,
+            "{\"name\":\"%s\",\"size\":%ld,\"threads\":%d,\"ranks\":%d,"
+            "\"reps\":%d,\"runs_per_sample\":%ld,\"min\":%.6e,\"q1\":%.6e,"
+            "\"median\":%.6e,\"q3\":%.6e,\"max\":%.6e,\"mean\":%.6e,"
+            "\"stddev\":%.6e,\"gflops\":%g,\"gbs\":%g,\"ok\":%s}%s\n",
+            r.name.c_str(), r.size, r.threads, r.ranks, r.reps,
+            r.runs_per_sample, r.min, r.q1, r.median, r.q3, r.max, r.mean,
+            r.stddev, r.gflops, r.gbs, r.ok ? "true" : "false",
+            i + 1 < results.size() ? "," : "");
+  }
+  fprintf(file, "]}\n");
+  fclose(file);
+  return true;
+}
+
+inline BenchResult BenchFromFields(
+    const std::map<std::string, std::string> &fields) {
+  auto get = [&](const char *key) {
+    auto it = fields.find(key);
+    return it == fields.end() ? std::string("0") : it->second;
+  };
+  BenchResult r;
+  r.name = get("name");
+  r.size = std::stol(get("size"));
+  r.threads = std::stoi(get("threads"));
+  r.ranks = std::stoi(get("ranks"));
+  r.reps = std::stoi(get("reps"));
+  r.runs_per_sample = std::stol(get("runs_per_sample"));
+  r.min = std::stod(get("min"));
+  r.q1 = std::stod(get("q1"));
+  r.median = std::stod(get("median"));
+  r.q3 = std::stod(get("q3"));
+  r.max = std::stod(get("max"));
+  r.mean = std::stod(get("mean"));
+  r.stddev = std::stod(get("stddev"));
+  r.gflops = std::stod(get("gflops"));
+  r.gbs = std::stod(get("gbs"));
+  const std::string ok = get("ok");
+  r.ok = ok == "true" || ok == "1";
+  return r;
+}
+
+/// Results written by BenchWriteJSON or BenchWriteCSV
+inline std::vector<BenchResult> BenchRead(const std::string &path) {
+  std::ifstream file(path);
+  std::vector<BenchResult> results;
+  std::string line;
+  std::vector<std::string> header;
+  while (std::getline(file, line)) {
+    std::map<std::string, std::string> fields;
+    if (line.rfind("{\"name\":", 0) == 0) {
+      // "key":value pairs of a flat object, no escapes in our names
+      size_t pos = 1;
+      while ((pos = line.find('"', pos)) != std::string::npos) {
+        size_t key_end = line.find('"', pos + 1);
+        std::string key = line.substr(pos + 1, key_end - pos - 1);
+        size_t value_begin = key_end + 2;
+        size_t value_end;
+        if (line[value_begin] == '"') {
+          ++value_begin;
+          value_end = line.find('"', value_begin);
+          pos = value_end + 1;
+        } else {
+          value_end = line.find_first_of(",}", value_begin);
+          pos = value_end;
+        }
+        fields[key] = line.substr(value_begin, value_end - value_begin);
+      }
+    } else if (line.rfind("name,", 0) == 0) {
+      std::stringstream columns(line);
+      header.clear();
+      for (std::string column; std::getline(columns, column, ',');) {
+        header.push_back(column);
+      }
+      continue;
+    } else if (!header.empty() && !line.empty()) {
+      std::stringstream values(line);
+      std::string value;
+      for (size_t c = 0; c < header.size() && std::getline(values, value, ',');
+           ++c) {
+        fields[header[c]] = value;
+      }
+    } else {
+      continue;
+    }
+    results.push_back(BenchFromFields(fields));
+  }
+  return results;
+}
+
+/// Print base against current for every configuration found in both and
+/// return the number of regressions: a median slower by more than
+/// `threshold` (relative) whose interquartile range does not overlap the
+/// base one, or a failed check. Changes within the noise are reported as
+/// such; configurations only in the current file are listed as new, those
+/// only in the base file as missing (not counted: a filtered run measures
+/// a subset).
+inline int BenchCompare(const std::vector<BenchResult> &base,
+                        const std::vector<BenchResult> &current,
+                        double threshold, FILE *out) {
+  std::map<std::string, const BenchResult *> by_key;
+  for (const auto &r : base) {
+    by_key[r.Key()] = &r;
+  }
+  std::map<std::string, bool> measured;
+  for (const auto &r : current) {
+    measured[r.Key()] = true;
+  }
+  int regressions = 0;
+  fprintf(out, "%-36s %12s %12s %9s  %s\n", "configuration", "base, s",
+          "current, s", "change", "verdict");
+  for (const auto &r : current) {
+    auto it = by_key.find(r.Key());
+    if (it == by_key.end()) {
+      fprintf(out, "%-36s %12s %12.4e %9s  new\n", r.Key().c_str(), "-",
+              r.median, "-");
+      continue;
+    }
+    const BenchResult &b = *it->second;
+    const double change = r.median / b.median - 1;
+    const char *verdict = "same";
+    if (!r.ok) {
+      verdict = "CHECK FAILED";
+      ++regressions;
+    } else if (change > threshold) {
+      if (r.q1 > b.q3) {
+        verdict = "REGRESSION";
+        ++regressions;
+      } else {
+        verdict = "noise";
+      }
+    } else if (change < -threshold) {
+      verdict = r.q3 < b.q1 ? "faster" : "noise";
+    }
+    fprintf(out, "%-36s %12.4e %12.4e %+8.1f%%  %s\n", r.Key().c_str(),
+            b.median, r.median, 100 * change, verdict);
+  }
+  for (const auto &b : base) {
+    if (measured.count(b.Key()) == 0) {
+      fprintf(out, "%-36s %12.4e %12s %9s  missing\n", b.Key().c_str(),
+              b.median, "-", "-");
+    }
+  }
+  return regressions;
+}
@@ -0,0 +1,425 @@
+// Steady state of the heat equation u_t = u_xx + u_yy on the unit square
+// with the boundary values of readme.md (u = 1 on y = 0, 0 elsewhere), by
+// alternating-direction-implicit steps, against explicit stepping.
+// Usage: adi [N=256] [tol=1e-6] [--pcr] [--max-jacobi=K] [--save]
+//   N segments per side, N - 1 interior points per line; tol bounds the
+//   relative residual max |A u - b| / max |b| of the 5-point Laplacian.
+//   --pcr solves every line by parallel cyclic reduction instead of the
+//   batched Thomas algorithm; --max-jacobi caps the explicit steps
+//   (default 2000000); --save writes field.txt for the heatmap cell.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+// Explicit stepping is stable up to dt = h^2 / 4, where one step is a
+// Jacobi sweep; the slowest mode decays by 1 - O(h^2) per step, so the
+// steady state takes O(N^2) steps. A Peaceman-Rachford step is implicit in
+// one direction at a time,
+//   (H + r) u* = g - (V - r) u,   (V + r) u' = g - (H - r) u*,
+// with H, V the second differences along x and y (sign flipped) and
+// r = 2 h^2 / dt; it is stable for any dt, and cycling r through K values
+// spread geometrically over the spectrum of H damps every mode in a few
+// cycles: O(log N) steps per digit instead of O(N^2).
+//
+// Each half step is N - 1 independent tridiagonal systems with the same
+// constant coefficients, so the Thomas factors are computed once per r.
+// Lines along y are columns: the sweep runs over rows and the inner loop
+// over the columns of a chunk is vectorized. Lines along x are rows: a
+// batch of ROW_BATCH rows is interleaved in a buffer so the same inner
+// loop runs across the batch. Batches and chunks are spread over the
+// threads. For a single long line, which has no such batch parallelism,
+// parallel cyclic reduction eliminates the neighbours at distances 1, 2,
+// 4, ... of all equations at once, log2(n) parallel steps.
+
+using std::vector;
+
+/// Rows interleaved per batch of the x sweep
+static const int ROW_BATCH = 8;
+/// Columns per task of the y sweep
+static const int COLUMN_CHUNK = 512;
+
+/// Interior values of an (N - 1) x (N - 1) grid, row-major, rows along y
+struct Field {
+  long n;
+  vector<double> v;
+
+  explicit Field(long n) : n(n), v(n * n) {}
+  double &operator()(long i, long j) { return v[i * n + j]; }
+  double operator()(long i, long j) const { return v[i * n + j]; }
+};
+
+/// Thomas elimination of the n x n system tridiag(-1, 2 + r, -1)
+struct LineFactors {
+  double r;
+  vector<double> c, inv;  // upper diagonal and pivot inverses after elimination
+
+  LineFactors(double r, long n) : r(r), c(n), inv(n) {
+    double prev = 0;
+    for (long i = 0; i < n; ++i) {
+      inv[i] = 1 / (2 + r + prev);
+      c[i] = prev = -inv[i];
+    }
+  }
+};
+
+/// General tridiagonal system a_i x_{i-1} + b_i x_i + c_i x_{i+1} = d_i
+struct Tridiagonal {
+  vector<double> a, b, c, d;
+};
+
+/// Sequential Thomas algorithm, O(n)
+vector<double> SolveThomas(const Tridiagonal &t) {
+  const long n = t.b.size();
+  vector<double> c(n), x(n);
+  double prev_c = 0, prev_d = 0;
+  for (long i = 0; i < n; ++i) {
+    const double inv = 1 / (t.b[i] - t.a[i] * prev_c);
+    c[i] = prev_c = t.c[i] * inv;
+    x[i] = prev_d = (t.d[i] - t.a[i] * prev_d) * inv;
+  }
+  for (long i = n - 2; i >= 0; --i) {
+    x[i] -= c[i] * x[i + 1];
+  }
+  return x;
+}
+
+/// Parallel cyclic reduction, O(n log n) work in log2(n) parallel steps
+vector<double> SolvePCR(const Tridiagonal &t) {
+  const long n = t.b.size();
+  Tridiagonal cur = t, next = t;
+  for (long s = 1; s < n; s *= 2) {
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+      // equations beyond the ends are x = 0
+      double alpha = 0, gamma = 0, a = 0, b = cur.b[i], c = 0, d = cur.d[i];
+      if (i - s >= 0) {
+        alpha = -cur.a[i] / cur.b[i - s];
+        a = alpha * cur.a[i - s];
+        b += alpha * cur.c[i - s];
+        d += alpha * cur.d[i - s];
+      }
+      if (i + s < n) {
+        gamma = -cur.c[i] / cur.b[i + s];
+        c = gamma * cur.c[i + s];
+        b += gamma * cur.a[i + s];
+        d += gamma * cur.d[i + s];
+      }
+      next.a[i] = a;
+      next.b[i] = b;
+      next.c[i] = c;
+      next.d[i] = d;
+    }
+    std::swap(cur, next);
+  }
+  vector<double> x(n);
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < n; ++i) {
+    x[i] = cur.d[i] / cur.b[i];
+  }
+  return x;
+}
+
+/// b of A u = b, A the 5-point Laplacian without the 1 / h^2: minus the
+/// boundary neighbours
+Field RightHandSide(long N) {
+  Field b(N - 1);
+  for (long j = 0; j < N - 1; ++j) {
+    b(0, j) = -1;
+  }
+  return b;
+}
+
+/// max |A u - b| / max |b|
+double Residual(const Field &u, const Field &b) {
+  const long n = u.n;
+  auto at = [&](long i, long j) {
+    return i < 0 || i >= n || j < 0 || j >= n ? 0.0 : u(i, j);
+  };
+  double r = 0, scale = 0;
+#pragma omp parallel for schedule(static) reduction(max : r, scale)
+  for (long i = 0; i < n; ++i) {
+    for (long j = 0; j < n; ++j) {
+      const double Au = at(i - 1, j) + at(i + 1, j) + at(i, j - 1) +
+                        at(i, j + 1) - 4 * u(i, j);
+      r = std::max(r, std::abs(Au - b(i, j)));
+      scale = std::max(scale, std::abs(b(i, j)));
+    }
+  }
+  return r / scale;
+}
+
+/// Explicit steps at the stability limit, that is Jacobi sweeps, until the
+/// residual (checked every `check` steps) is below tol
+Field SolveJacobi(const Field &b, double tol, long max_steps, long &steps) {
+  const long n = b.n;
+  const long check = 100;
+  Field u(n), next(n);
+  for (steps = 0; steps < max_steps;) {
+    for (long k = 0; k < check; ++k, ++steps) {
+#pragma omp parallel for schedule(static)
+      for (long i = 0; i < n; ++i) {
+        const double *up = i > 0 ? &u(i - 1, 0) : nullptr;
+        const double *down = i + 1 < n ? &u(i + 1, 0) : nullptr;
+        const double *row = &u(i, 0);
+        for (long j = 0; j < n; ++j) {
+          const double sum = (up ? up[j] : 0) + (down ? down[j] : 0) +
+                             (j > 0 ? row[j - 1] : 0) +
+                             (j + 1 < n ? row[j + 1] : 0);
+          next(i, j) = (sum - b(i, j)) / 4;
+        }
+      }
+      std::swap(u.v, next.v);
+    }
+    if (Residual(u, b) < tol) {
+      break;
+    }
+  }
+  return u;
+}
+
+/// Peaceman-Rachford ADI
+class ADI {
+ public:
+  /// K > 0 cycles K parameters, K = 0 uses the single optimal one
+  ADI(const Field &b, int K, bool pcr) : b(b), n(b.n), pcr(pcr) {
+    // eigenvalues of tridiag(-1, 2, -1) of size n
+    const double low = 4 * std::pow(std::sin(M_PI / (2 * (n + 1))), 2);
+    const double high = 4 * std::pow(std::cos(M_PI / (2 * (n + 1))), 2);
+    if (K == 0) {
+      factors.emplace_back(std::sqrt(low * high), n);
+    }
+    for (int k = 0; k < K; ++k) {
+      factors.emplace_back(high * std::pow(low / high, (k + 0.5) / K), n);
+    }
+  }
+
+  /// Full steps until the residual is below tol, at most max_steps
+  Field Solve(double tol, long max_steps, long &steps) {
+    Field u(n), half(n);
+    for (steps = 0; steps < max_steps;) {
+      const LineFactors &f = factors[steps++ % factors.size()];
+      SweepX(f, u, half);
+      SweepY(f, half, u);
+      if (Residual(u, b) < tol) {
+        break;
+      }
+    }
+    return u;
+  }
+
+ private:
+  const Field &b;
+  long n;
+  bool pcr;
+  vector<LineFactors> factors;
+
+  /// out = (H + r)^-1 (g - (V - r) in), lines along x; g = -b
+  void SweepX(const LineFactors &f, const Field &in, Field &out) const {
+    auto rhs = [&](long i, long j) {
+      const double up = i > 0 ? in(i - 1, j) : 0;
+      const double down = i + 1 < n ? in(i + 1, j) : 0;
+      return -b(i, j) + up + down + (f.r - 2) * in(i, j);
+    };
+    if (pcr) {
+      for (long i = 0; i < n; ++i) {
+        Tridiagonal t = Line(f);
+        for (long j = 0; j < n; ++j) {
+          t.d[j] = rhs(i, j);
+        }
+        const vector<double> x = SolvePCR(t);
+        std::copy(x.begin(), x.end(), &out(i, 0));
+      }
+      return;
+    }
+#pragma omp parallel
+    {
+      vector<double> batch(n * ROW_BATCH);
+#pragma omp for schedule(static)
+      for (long i0 = 0; i0 < n; i0 += ROW_BATCH) {
+        const long rows = std::min<long>(ROW_BATCH, n - i0);
+        // batch[j][row], forward elimination on the way in
+        for (long j = 0; j < n; ++j) {
+          double *x = &batch[j * ROW_BATCH];
+          const double *prev = j > 0 ? x - ROW_BATCH : nullptr;
+          for (long k = 0; k < rows; ++k) {
+            x[k] = (rhs(i0 + k, j) + (prev ? prev[k] : 0)) * f.inv[j];
+          }
+        }
+        for (long j = n - 2; j >= 0; --j) {
+          double *x = &batch[j * ROW_BATCH];
+#pragma omp simd
+          for (long k = 0; k < ROW_BATCH; ++k) {
+            x[k] -= f.c[j] * x[k + ROW_BATCH];
+          }
+        }
+        for (long k = 0; k < rows; ++k) {
+          for (long j = 0; j < n; ++j) {
+            out(i0 + k, j) = batch[j * ROW_BATCH + k];
+          }
+        }
+      }
+    }
+  }
+
+  /// out = (V + r)^-1 (g - (H - r) in), lines along y
+  void SweepY(const LineFactors &f, const Field &in, Field &out) const {
+    auto rhs = [&](long i, long j) {
+      const double left = j > 0 ? in(i, j - 1) : 0;
+      const double right = j + 1 < n ? in(i, j + 1) : 0;
+      return -b(i, j) + left + right + (f.r - 2) * in(i, j);
+    };
+    if (pcr) {
+      for (long j = 0; j < n; ++j) {
+        Tridiagonal t = Line(f);
+        for (long i = 0; i < n; ++i) {
+          t.d[i] = rhs(i, j);
+        }
+        const vector<double> x = SolvePCR(t);
+        for (long i = 0; i < n; ++i) {
+          out(i, j) = x[i];
+        }
+      }
+      return;
+    }
+#pragma omp parallel for schedule(static)
+    for (long j0 = 0; j0 < n; j0 += COLUMN_CHUNK) {
+      const long j1 = std::min<long>(j0 + COLUMN_CHUNK, n);
+      for (long i = 0; i < n; ++i) {
+        double *x = &out(i, 0);
+        const double *prev = i > 0 ? &out(i - 1, 0) : nullptr;
+        for (long j = j0; j < j1; ++j) {
+          x[j] = (rhs(i, j) + (prev ? prev[j] : 0)) * f.inv[i];
+        }
+      }
+      for (long i = n - 2; i >= 0; --i) {
+        double *x = &out(i, 0);
+        const double *next = &out(i + 1, 0);
+#pragma omp simd
+        for (long j = j0; j < j1; ++j) {
+          x[j] -= f.c[i] * next[j];
+        }
+      }
+    }
+  }
+
+  Tridiagonal Line(const LineFactors &f) const {
+    return {vector<double>(n, -1), vector<double>(n, 2 + f.r),
+            vector<double>(n, -1), vector<double>(n)};
+  }
+};
+
+/// Thomas against PCR on one long random diagonally dominant line
+void CheckPCR(long n) {
+  std::mt19937 gen(1);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  Tridiagonal t{vector<double>(n), vector<double>(n), vector<double>(n),
+                vector<double>(n)};
+  for (long i = 0; i < n; ++i) {
+    t.a[i] = i > 0 ? dist(gen) : 0;
+    t.c[i] = i + 1 < n ? dist(gen) : 0;
+    t.b[i] = 2.5 + dist(gen);
+    t.d[i] = dist(gen);
+  }
+  auto start = std::chrono::steady_clock::now();
+  const vector<double> thomas = SolveThomas(t);
+  auto middle = std::chrono::steady_clock::now();
+  const vector<double> pcr = SolvePCR(t);
+  auto end = std::chrono::steady_clock::now();
+  double diff = 0;
+  for (long i = 0; i < n; ++i) {
+    diff = std::max(diff, std::abs(thomas[i] - pcr[i]));
+  }
+  const std::chrono::duration<double> t1 = middle - start, t2 = end - middle;
+  printf("line of %ld: Thomas %.3f s, PCR %.3f s on %d threads, max "
+         "difference %.2e\n",
+         n, t1.count(), t2.count(), omp_get_max_threads(), diff);
+}
+
+/// Whole grid with its boundary, top row first as the notebook reads it
+void SaveField(const Field &u, long N) {
+  std::ofstream file("field.txt");
+  for (long i = N; i >= 0; --i) {
+    for (long j = 0; j <= N; ++j) {
+      const bool boundary = i == 0 || i == N || j == 0 || j == N;
+      file << (boundary ? (i == 0 ? 1.0 : 0.0) : u(i - 1, j - 1)) << " ";
+    }
+    file << "\n";
+  }
+  printf("Field's been saved to './field.txt'\n");
+}
+
+int main(int argc, char **argv) {
+  long N = 256, max_jacobi = 2000000;
+  double tol = 1e-6;
+  bool pcr = false, save = false;
+  int positional = 0;
+  for (int a = 1; a < argc; ++a) {
+    const std::string arg = argv[a];
+    if (arg == "--pcr") {
+      pcr = true;
+    } else if (arg == "--save") {
+      save = true;
+    } else if (arg.rfind("--max-jacobi=", 0) == 0) {
+      max_jacobi = std::stol(arg.substr(13));
+    } else if (positional++ == 0) {
+      N = std::stol(arg);
+    } else {
+      tol = std::stod(arg);
+    }
+  }
+  if (N < 3) {
+    printf("N must be at least 3\n");
+    return 1;
+  }
+
+  CheckPCR(1 << 20);
+  const Field b = RightHandSide(N);
+  printf("%ld x %ld grid, relative residual < %.0e, %d threads, %s line "
+         "solves\n",
+         N, N, tol, omp_get_max_threads(), pcr ? "PCR" : "batched Thomas");
+  printf("%-24s %10s %10s %12s\n", "method", "steps", "time, s", "residual");
+
+  // parameters per cycle, growing with the log of the spread of the
+  // spectrum of H, about (2N / pi)^2
+  const int K = std::max(1, (int)std::ceil(std::log2(N) / 2) + 1);
+  Field result(N - 1);
+  auto run = [&](const char *name, auto &&solve, long max_steps) {
+    long steps;
+    const auto start = std::chrono::steady_clock::now();
+    Field u = solve(max_steps, steps);
+    const std::chrono::duration<double> time =
+        std::chrono::steady_clock::now() - start;
+    const double r = Residual(u, b);
+    printf("%-24s %10ld %10.3f %12.2e%s\n", name, steps, time.count(), r,
+           r < tol ? "" : "  (not converged)");
+    result = std::move(u);
+  };
+  run("explicit (Jacobi)",
+      [&](long max_steps, long &steps) {
+        return SolveJacobi(b, tol, max_steps, steps);
+      },
+      max_jacobi);
+  run("ADI, one parameter",
+      [&](long max_steps, long &steps) {
+        return ADI(b, 0, pcr).Solve(tol, max_steps, steps);
+      },
+      100 * N);
+  char name[64];
+  snprintf(name, sizeof(name), "ADI, %d-cycle", K);
+  run(name,
+      [&](long max_steps, long &steps) {
+        return ADI(b, K, pcr).Solve(tol, max_steps, steps);
+      },
+      100 * N);
+  if (save) {
+    SaveField(result, N);
+  }
+  return 0;
+}
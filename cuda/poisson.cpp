@@ -0,0 +1,299 @@
+// Direct solver of the Poisson equation u_xx + u_yy = f on the unit square
+// with Dirichlet boundary values, by the 2-D discrete sine transform.
+// Usage: poisson [N=8192] [laplace|manufactured] [--save]
+//   N segments per side (a power of two), N - 1 interior points per line.
+//   laplace: the problem of readme.md (u = 1 on y = 0, 0 elsewhere, f = 0);
+//   manufactured: a known u with non-zero f and boundary values, to
+//   measure the discretization error. --save writes field.txt for the
+//   heatmap cell of the notebook.
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "../cufft/fft_cpu.hpp"
+
+// The 5-point Laplacian with Dirichlet boundaries is diagonalized by the
+// sine vectors sin(pi j k / N): in the basis of the 2-D DST-I the system is
+// u_kl = b_kl / lambda_kl with lambda_kl = (2 cos(pi k / N) - 2
+// + 2 cos(pi l / N) - 2) / h^2. Boundary values move to the right-hand side
+// first, so any boundary data and source term is solved in O(N^2 log N),
+// against (NM)^2 for the dense system of the notebook.
+//
+// A DST-I of n = N - 1 values is the FFT of their odd extension of length
+// 2N, -2i times the sines. That extension is real, so two lines go through
+// one complex transform, one as the real part and one as the imaginary
+// part: the sines of the first come out in the imaginary part of the
+// result, those of the second in the real part. Rows are transformed in
+// pairs, columns in groups of COLUMN_GROUP so every row of the group is one
+// cache line; both loops are OpenMP parallel.
+
+using std::vector;
+
+using Plan = BasicFFTPlan<double>;
+using dcomplex = Plan::value_type;
+
+/// Columns gathered per pass of the column transforms
+static const int COLUMN_GROUP = 8;
+
+/// Interior values of an (N - 1) x (N - 1) grid, row-major, rows along y
+struct Field {
+  long n;
+  vector<double> v;
+
+  explicit Field(long n) : n(n), v(n * n) {}
+  double &operator()(long i, long j) { return v[i * n + j]; }
+  double operator()(long i, long j) const { return v[i * n + j]; }
+};
+
+/// In-place DST-I of lines a and b (b may be null) of n = N - 1 values at
+/// stride `stride`, through one FFT of 2N in `z`
+void DSTPair(const Plan &plan, dcomplex *z, double *a, double *b, long n,
+             long stride) {
+  const long N = n + 1;
+  z[0] = z[N] = 0;
+  for (long j = 1; j <= n; ++j) {
+    const dcomplex x(a[(j - 1) * stride], b ? b[(j - 1) * stride] : 0.0);
+    z[j] = x;
+    z[2 * N - j] = -x;
+  }
+  plan.execute(z, false);
+  for (long k = 1; k <= n; ++k) {
+    a[(k - 1) * stride] = -z[k].imag() / 2;
+    if (b) {
+      b[(k - 1) * stride] = z[k].real() / 2;
+    }
+  }
+}
+
+/// Unnormalized 2-D DST-I of the field, rows then columns
+void DST2D(const Plan &plan, Field &u) {
+  const long n = u.n;
+#pragma omp parallel
+  {
+    vector<dcomplex> z(plan.size());
+#pragma omp for schedule(static)
+    for (long i = 0; i < n; i += 2) {
+      DSTPair(plan, z.data(), &u(i, 0), i + 1 < n ? &u(i + 1, 0) : nullptr, n,
+              1);
+    }
+    // a group of columns copied out as contiguous lines and back
+    vector<double> group(COLUMN_GROUP * n);
+#pragma omp for schedule(static)
+    for (long j0 = 0; j0 < n; j0 += COLUMN_GROUP) {
+      const long width = std::min<long>(COLUMN_GROUP, n - j0);
+      for (long i = 0; i < n; ++i) {
+        for (long c = 0; c < width; ++c) {
+          group[c * n + i] = u(i, j0 + c);
+        }
+      }
+      for (long c = 0; c < width; c += 2) {
+        DSTPair(plan, z.data(), &group[c * n],
+                c + 1 < width ? &group[(c + 1) * n] : nullptr, n, 1);
+      }
+      for (long i = 0; i < n; ++i) {
+        for (long c = 0; c < width; ++c) {
+          u(i, j0 + c) = group[c * n + i];
+        }
+      }
+    }
+  }
+}
+
+/// Problem data: f inside and the boundary values g, on the unit square
+struct Problem {
+  std::function<double(double, double)> f, g, exact;
+};
+
+Problem Laplace() {
+  return {[](double, double) { return 0.0; },
+          [](double, double y) { return y == 0 ? 1.0 : 0.0; }, nullptr};
+}
+
+/// u = cos(pi x) e^y + x y^2
+Problem Manufactured() {
+  auto u = [](double x, double y) {
+    return std::cos(M_PI * x) * std::exp(y) + x * y * y;
+  };
+  return {[](double x, double y) {
+            return (1 - M_PI * M_PI) * std::cos(M_PI * x) * std::exp(y) +
+                   2 * x;
+          },
+          u, u};
+}
+
+/// b = h^2 f minus the boundary neighbours, so that the interior satisfies
+/// u(i-1,j) + u(i+1,j) + u(i,j-1) + u(i,j+1) - 4 u(i,j) = b(i,j)
+Field RightHandSide(const Problem &p, long N) {
+  const long n = N - 1;
+  const double h = 1.0 / N;
+  Field b(n);
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < n; ++i) {
+    const double y = (i + 1) * h;
+    for (long j = 0; j < n; ++j) {
+      const double x = (j + 1) * h;
+      double value = h * h * p.f(x, y);
+      if (i == 0) value -= p.g(x, 0);
+      if (i == n - 1) value -= p.g(x, 1);
+      if (j == 0) value -= p.g(0, y);
+      if (j == n - 1) value -= p.g(1, y);
+      b(i, j) = value;
+    }
+  }
+  return b;
+}
+
+/// Interior solution of the discrete problem for the right-hand side b
+Field SolveDST(Field b, long N) {
+  const long n = N - 1;
+  const Plan plan(2 * N);
+  DST2D(plan, b);
+  // eigenvalues of the h^2-scaled operator; inverse DST-I is (2 / N) DST-I
+  // per dimension
+  vector<double> mu(n);
+  for (long k = 0; k < n; ++k) {
+    mu[k] = 2 * std::cos(M_PI * (k + 1) / N) - 2;
+  }
+  const double scale = 4.0 / ((double)N * N);
+#pragma omp parallel for schedule(static)
+  for (long l = 0; l < n; ++l) {
+    for (long k = 0; k < n; ++k) {
+      b(l, k) *= scale / (mu[l] + mu[k]);
+    }
+  }
+  DST2D(plan, b);
+  return b;
+}
+
+/// Red-black SOR with the optimal factor until the update is below tol
+Field SolveSOR(const Field &b, long N, double tol, int &iterations) {
+  const long n = N - 1;
+  const double omega = 2 / (1 + std::sin(M_PI / N));
+  Field u(n);
+  auto at = [&](long i, long j) {
+    return i < 0 || i >= n || j < 0 || j >= n ? 0.0 : u(i, j);
+  };
+  for (iterations = 1;; ++iterations) {
+    double change = 0;
+    for (int color = 0; color < 2; ++color) {
+#pragma omp parallel for schedule(static) reduction(max : change)
+      for (long i = 0; i < n; ++i) {
+        for (long j = (i + color) % 2; j < n; j += 2) {
+          const double gs = (at(i - 1, j) + at(i + 1, j) + at(i, j - 1) +
+                             at(i, j + 1) - b(i, j)) / 4;
+          const double delta = omega * (gs - u(i, j));
+          u(i, j) += delta;
+          change = std::max(change, std::abs(delta));
+        }
+      }
+    }
+    if (change < tol) {
+      return u;
+    }
+  }
+}
+
+/// max |A u - b| / max |b| for the h^2-scaled 5-point operator A
+double Residual(const Field &u, const Field &b) {
+  const long n = u.n;
+  auto at = [&](long i, long j) {
+    return i < 0 || i >= n || j < 0 || j >= n ? 0.0 : u(i, j);
+  };
+  double r = 0, scale = 0;
+#pragma omp parallel for schedule(static) reduction(max : r, scale)
+  for (long i = 0; i < n; ++i) {
+    for (long j = 0; j < n; ++j) {
+      const double Au = at(i - 1, j) + at(i + 1, j) + at(i, j - 1) +
+                        at(i, j + 1) - 4 * u(i, j);
+      r = std::max(r, std::abs(Au - b(i, j)));
+      scale = std::max(scale, std::abs(b(i, j)));
+    }
+  }
+  return r / scale;
+}
+
+/// Whole grid with its boundary, top row first as the notebook reads it
+void SaveField(const Problem &p, const Field &u, long N) {
+  std::ofstream file("field.txt");
+  const double h = 1.0 / N;
+  for (long i = N; i >= 0; --i) {
+    for (long j = 0; j <= N; ++j) {
+      const bool boundary = i == 0 || i == N || j == 0 || j == N;
+      file << (boundary ? p.g(j * h, i * h) : u(i - 1, j - 1)) << " ";
+    }
+    file << "\n";
+  }
+  printf("Field's been saved to './field.txt'\n");
+}
+
+int main(int argc, char **argv) {
+  long N = 8192;
+  std::string name = "laplace";
+  bool save = false;
+  for (int a = 1; a < argc; ++a) {
+    const std::string arg = argv[a];
+    if (arg == "--save") {
+      save = true;
+    } else if (arg == "laplace" || arg == "manufactured") {
+      name = arg;
+    } else {
+      N = std::stol(arg);
+    }
+  }
+  if (N < 2 || (N & (N - 1)) != 0) {
+    printf("N must be a power of two\n");
+    return 1;
+  }
+  const Problem problem = name == "laplace" ? Laplace() : Manufactured();
+
+  // the direct solution against SOR on a grid small enough to iterate
+  {
+    const long M = std::min<long>(N, 128);
+    const Field b = RightHandSide(problem, M);
+    int iterations;
+    const Field iterative = SolveSOR(b, M, 1e-13, iterations);
+    const Field direct = SolveDST(b, M);
+    double diff = 0;
+    for (long i = 0; i < (M - 1) * (M - 1); ++i) {
+      diff = std::max(diff, std::abs(direct.v[i] - iterative.v[i]));
+    }
+    printf("check on %ld x %ld: max |DST - SOR| = %.2e (SOR: %d iterations)\n",
+           M, M, diff, iterations);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const Field b = RightHandSide(problem, N);
+  const auto solve = std::chrono::steady_clock::now();
+  const Field u = SolveDST(b, N);
+  const auto end = std::chrono::steady_clock::now();
+  const std::chrono::duration<double> setup = solve - start, time = end - solve;
+
+  printf("%s, %ld x %ld grid, %d threads: right-hand side %.2f s, solve "
+         "%.2f s, residual %.2e\n",
+         name.c_str(), N, N, omp_get_max_threads(), setup.count(),
+         time.count(), Residual(u, b));
+  if (problem.exact) {
+    const double h = 1.0 / N;
+    double error = 0;
+#pragma omp parallel for schedule(static) reduction(max : error)
+    for (long i = 0; i < N - 1; ++i) {
+      for (long j = 0; j < N - 1; ++j) {
+        error = std::max(
+            error, std::abs(u(i, j) - problem.exact((j + 1) * h, (i + 1) * h)));
+      }
+    }
+    printf("max error against the exact solution %.2e (O(h^2), h = %.1e)\n",
+           error, h);
+  }
+  if (save) {
+    SaveField(problem, u, N);
+  }
+  return 0;
+}
@@ -0,0 +1,392 @@
+#pragma once
+
+#include <bits/stdc++.h>
+
+#include <omp.h>
+
+using namespace std;
+
+/*
+ * Arbitrary-precision non-negative integers in base 10^9 and their product.
+ *
+ * FFT::mult rounds a single precision convolution, exact only for a few
+ * thousand small digits. Here the convolution of the limbs is computed
+ * exactly with number theoretic transforms (NTT) modulo three primes
+ * p = c 2^k + 1 below 2^30 and recombined with the Chinese remainder
+ * theorem: a coefficient is below min(la, lb) 10^18, far under p1 p2 p3
+ * ~ 7.8e25, so the result is exact for any size the transforms support
+ * (2^23 limbs, 75 million digits; larger products split with Karatsuba
+ * first). BigInt::mult picks schoolbook, Karatsuba or NTT by size.
+ */
+
+/// Transforms modulo the prime P of primitive root G, P - 1 divisible by n.
+/// The forward transform (decimation in frequency) leaves its output in
+/// bit-reversed order and the inverse one (decimation in time) takes it so,
+/// which is all a convolution needs: no reordering pass at all.
+template <uint32_t P, uint32_t G>
+struct NTT {
+    /// w_len^j at roots[len / 2 + j] for every stage, with the quotients
+    /// floor(w 2^32 / P) that turn a product mod P into two multiplications
+    /// (Shoup)
+    struct Roots {
+        vector<uint32_t> roots, quotients;
+
+        Roots(size_t n, bool invert) : roots(max<size_t>(n, 2)), quotients(roots.size()) {
+            // the last stage by blocks of powers, each earlier one every
+            // other root of the next
+            const size_t top = n / 2;
+            uint32_t w = power(G, (P - 1) / max<size_t>(n, 2));
+            if (invert)
+                w = power(w, P - 2);
+            const uint32_t wq = ((uint64_t)w << 32) / P;
+            #pragma omp parallel for schedule(static) if (n >= (1 << 14))
+            for (size_t j0 = 0; j0 < top; j0 += 1024) {
+                roots[top + j0] = power(w, j0);
+                for (size_t j = j0 + 1; j < min(top, j0 + 1024); ++j) {
+                    const uint32_t x = roots[top + j - 1];
+                    const uint32_t v = x * w - (uint32_t)(((uint64_t)x * wq) >> 32) * P;
+                    roots[top + j] = v >= P ? v - P : v;
+                }
+            }
+            for (size_t half = top / 2; half >= 1; half >>= 1)
+                for (size_t j = 0; j < half; ++j)
+                    roots[half + j] = roots[2 * half + 2 * j];
+            #pragma omp parallel for schedule(static) if (n >= (1 << 14))
+            for (size_t i = 1; i < n; ++i)
+                quotients[i] = ((uint64_t)roots[i] << 32) / P;
+        }
+
+        /// x w_len^j mod P for stage half = len / 2
+        uint32_t mul(uint32_t x, size_t half, size_t j) const {
+            const uint32_t q = ((uint64_t)x * quotients[half + j]) >> 32;
+            const uint32_t v = x * roots[half + j] - q * P; // in [0, 2P)
+            return v >= P ? v - P : v;
+        }
+    };
+
+    static uint32_t power(uint64_t base, uint64_t e) {
+        uint64_t result = 1;
+        for (base %= P; e > 0; e >>= 1, base = base * base % P)
+            if (e & 1)
+                result = result * base % P;
+        return (uint32_t)result;
+    }
+
+    /// Runs butterfly(i, j) over the blocks i of 2 half values and their
+    /// offsets j, shared among the threads
+    template <typename Butterfly>
+    static void stage(size_t n, size_t half, Butterfly butterfly) {
+        // many short blocks are shared out whole, few long ones by j
+        if (n / half >= 128) {
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < n; i += 2 * half)
+                for (size_t j = 0; j < half; ++j)
+                    butterfly(i, j);
+        } else {
+            for (size_t i = 0; i < n; i += 2 * half) {
+                #pragma omp for schedule(static)
+                for (size_t j = 0; j < half; ++j)
+                    butterfly(i, j);
+            }
+        }
+    }
+
+    /// In-place forward transform of n = a.size() values, n a power of two;
+    /// the output is in bit-reversed order
+    static void forward(vector<uint32_t> &a, const Roots &w) {
+        const size_t n = a.size();
+        #pragma omp parallel if (n >= (1 << 14))
+        for (size_t half = n / 2; half >= 1; half >>= 1) {
+            stage(n, half, [&](size_t i, size_t j) {
+                const uint32_t u = a[i + j], v = a[i + j + half];
+                a[i + j] = u + v >= P ? u + v - P : u + v;
+                a[i + j + half] = w.mul(u >= v ? u - v : u + P - v, half, j);
+            });
+        }
+    }
+
+    /// Inverse of forward, w built with invert: bit-reversed input, natural
+    /// order output divided by n
+    static void inverse(vector<uint32_t> &a, const Roots &w) {
+        const size_t n = a.size();
+        const uint64_t inv_n = power(n, P - 2);
+        #pragma omp parallel if (n >= (1 << 14))
+        {
+            for (size_t half = 1; half < n; half <<= 1) {
+                stage(n, half, [&](size_t i, size_t j) {
+                    const uint32_t u = a[i + j], v = w.mul(a[i + j + half], half, j);
+                    a[i + j] = u + v >= P ? u + v - P : u + v;
+                    a[i + j + half] = u >= v ? u - v : u + P - v;
+                });
+            }
+            #pragma omp for schedule(static)
+            for (size_t i = 0; i < n; ++i)
+                a[i] = a[i] * inv_n % P;
+        }
+    }
+
+    /// Cyclic convolution of a and b modulo P, n a power of two
+    static vector<uint32_t> convolve(const vector<uint32_t> &a,
+                                     const vector<uint32_t> &b, size_t n) {
+        vector<uint32_t> fa(n), fb(n);
+        for (size_t i = 0; i < a.size(); ++i)
+            fa[i] = a[i] % P;
+        for (size_t i = 0; i < b.size(); ++i)
+            fb[i] = b[i] % P;
+        const Roots w(n, false);
+        forward(fa, w), forward(fb, w);
+        #pragma omp parallel for schedule(static) if (n >= (1 << 14))
+        for (size_t i = 0; i < n; ++i)
+            fa[i] = (uint64_t)fa[i] * fb[i] % P;
+        inverse(fa, Roots(n, true));
+        return fa;
+    }
+};
+
+class BigInt {
+public:
+    static constexpr uint32_t BASE = 1000000000; // 9 decimal digits per limb
+    /// Below this many limbs in the shorter operand: schoolbook
+    static constexpr size_t KARATSUBA_CUTOFF = 64;
+    /// From this many limbs in the shorter operand: NTT
+    static constexpr size_t FFT_CUTOFF = 512;
+    /// Largest NTT length, limited by 998244353 = 119 2^23 + 1
+    static constexpr size_t FFT_MAX = size_t(1) << 23;
+    /// Limbs per block of the parallel carry propagation
+    static constexpr size_t CARRY_BLOCK = 4096;
+
+    vector<uint32_t> limbs; // least significant first, no leading zeros
+
+    BigInt() {}
+
+    explicit BigInt(const string &decimal) {
+        for (long end = (long)decimal.size(); end > 0; end -= 9) {
+            const long begin = max(0L, end - 9);
+            limbs.push_back((uint32_t)stoul(decimal.substr(begin, end - begin)));
+        }
+        trim();
+    }
+
+    string str() const {
+        if (limbs.empty())
+            return "0";
+        string s = to_string(limbs.back());
+        char digits[16];
+        for (size_t i = limbs.size() - 1; i-- > 0;) {
+            snprintf(digits, sizeof(digits), "%09u", limbs[i]);
+            s += digits;
+        }
+        return s;
+    }
+
+    bool operator==(const BigInt &other) const { return limbs == other.limbs; }
+
+    /// Product with the fastest method for the operand sizes
+    static BigInt mult(const BigInt &a, const BigInt &b) {
+        const size_t shorter = min(a.limbs.size(), b.limbs.size());
+        if (shorter < KARATSUBA_CUTOFF)
+            return mult_schoolbook(a, b);
+        if (shorter < FFT_CUTOFF)
+            return mult_karatsuba(a, b);
+        if (fft_size(a, b) <= FFT_MAX)
+            return mult_fft(a, b);
+        return karatsuba(a, b, mult);
+    }
+
+    /// O(la lb) long multiplication
+    static BigInt mult_schoolbook(const BigInt &a, const BigInt &b) {
+        BigInt r;
+        if (a.limbs.empty() || b.limbs.empty())
+            return r;
+        const size_t la = a.limbs.size(), lb = b.limbs.size();
+        r.limbs.assign(la + lb, 0);
+        for (size_t i = 0; i < la; ++i) {
+            uint64_t carry = 0;
+            for (size_t j = 0; j < lb; ++j) {
+                const uint64_t t =
+                    r.limbs[i + j] + (uint64_t)a.limbs[i] * b.limbs[j] + carry;
+                r.limbs[i + j] = t % BASE;
+                carry = t / BASE;
+            }
+            r.limbs[i + lb] = (uint32_t)carry;
+        }
+        r.trim();
+        return r;
+    }
+
+    /// O(n^1.585) Karatsuba down to schoolbook, the three products of the
+    /// large levels as OpenMP tasks
+    static BigInt mult_karatsuba(const BigInt &a, const BigInt &b) {
+        if (omp_in_parallel())
+            return karatsuba_rec(a, b);
+        BigInt r;
+        #pragma omp parallel
+        #pragma omp single
+        r = karatsuba_rec(a, b);
+        return r;
+    }
+
+    /// O(n log n) exact convolution by NTT modulo three primes, CRT and a
+    /// parallel carry propagation
+    static BigInt mult_fft(const BigInt &a, const BigInt &b) {
+        BigInt r;
+        if (a.limbs.empty() || b.limbs.empty())
+            return r;
+        const size_t n = fft_size(a, b);
+        if (n > FFT_MAX)
+            throw invalid_argument("BigInt::mult_fft: operands too long");
+        const vector<uint32_t> c1 = NTT<P1, 3>::convolve(a.limbs, b.limbs, n);
+        const vector<uint32_t> c2 = NTT<P2, 3>::convolve(a.limbs, b.limbs, n);
+        const vector<uint32_t> c3 = NTT<P3, 3>::convolve(a.limbs, b.limbs, n);
+
+        // Garner: c = x1 + p1 (x2 + p2 x3) with xk < pk, written in base
+        // 10^9 without 128-bit divisions: y = x2 + p2 x3 < 2^57 is split as
+        // yh BASE + yl, so c = (x1 + p1 yl) + p1 yh BASE
+        const size_t m = a.limbs.size() + b.limbs.size() - 1;
+        const uint64_t p1_inv_p2 = NTT<P2, 3>::power(P1, P2 - 2);
+        const uint64_t p1_inv_p3 = NTT<P3, 3>::power(P1, P3 - 2);
+        const uint64_t p2_inv_p3 = NTT<P3, 3>::power(P2, P3 - 2);
+        vector<array<uint32_t, 3>> coefficients(m);
+        #pragma omp parallel for schedule(static)
+        for (size_t i = 0; i < m; ++i) {
+            const uint64_t x1 = c1[i];
+            const uint64_t x2 = (c2[i] + P2 - x1 % P2) % P2 * p1_inv_p2 % P2;
+            const uint64_t x3 =
+                ((c3[i] + P3 - x1 % P3) % P3 * p1_inv_p3 % P3 + P3 - x2 % P3) %
+                P3 * p2_inv_p3 % P3;
+            const uint64_t y = x2 + x3 * P2;
+            const uint64_t low = x1 + (y % BASE) * P1;
+            const uint64_t high = low / BASE + (y / BASE) * P1;
+            coefficients[i] = {uint32_t(low % BASE), uint32_t(high % BASE),
+                               uint32_t(high / BASE)};
+        }
+        r.limbs = carry(coefficients);
+        r.trim();
+        return r;
+    }
+
+private:
+    static constexpr uint32_t P1 = 998244353, P2 = 167772161, P3 = 469762049;
+
+    /// Power of two holding the la + lb - 1 coefficients of the product
+    static size_t fft_size(const BigInt &a, const BigInt &b) {
+        size_t n = 1;
+        while (n < a.limbs.size() + b.limbs.size() - 1)
+            n <<= 1;
+        return n;
+    }
+
+    void trim() {
+        while (!limbs.empty() && limbs.back() == 0)
+            limbs.pop_back();
+    }
+
+    /// Limbs of sum_i c[i] BASE^i, c[i] given by three base 10^9 digits.
+    /// Blocks are normalized in parallel, each leaving a carry; the carries
+    /// are then added block after block, which only ripples as far as a run
+    /// of BASE - 1 limbs.
+    static vector<uint32_t> carry(const vector<array<uint32_t, 3>> &c) {
+        const size_t m = c.size() + 2, blocks = (m + CARRY_BLOCK - 1) / CARRY_BLOCK;
+        auto digit = [&](size_t i, size_t k) -> uint64_t {
+            return i >= k && i - k < c.size() ? c[i - k][k] : 0;
+        };
+        vector<uint32_t> limbs(m + 1, 0);
+        vector<uint64_t> out(blocks);
+        #pragma omp parallel for schedule(static)
+        for (size_t k = 0; k < blocks; ++k) {
+            uint64_t carry = 0;
+            for (size_t i = k * CARRY_BLOCK; i < min(m, (k + 1) * CARRY_BLOCK);
+                 ++i) {
+                const uint64_t t = digit(i, 0) + digit(i, 1) + digit(i, 2) + carry;
+                limbs[i] = t % BASE;
+                carry = t / BASE;
+            }
+            out[k] = carry;
+        }
+        for (size_t k = 0; k < blocks; ++k) {
+            uint64_t carry = out[k];
+            for (size_t i = min(m, (k + 1) * CARRY_BLOCK); carry > 0; ++i) {
+                const uint64_t t = limbs[i] + carry;
+                limbs[i] = t % BASE;
+                carry = t / BASE;
+            }
+        }
+        return limbs;
+    }
+
+    /// r += x BASE^shift, r long enough
+    static void add_at(vector<uint32_t> &r, const vector<uint32_t> &x,
+                       size_t shift) {
+        uint32_t carry = 0;
+        size_t i = 0;
+        for (; i < x.size() || carry; ++i) {
+            uint32_t t = r[shift + i] + (i < x.size() ? x[i] : 0) + carry;
+            carry = t >= BASE;
+            r[shift + i] = carry ? t - BASE : t;
+        }
+    }
+
+    /// r -= x, r >= x
+    static void sub(vector<uint32_t> &r, const vector<uint32_t> &x) {
+        uint32_t borrow = 0;
+        for (size_t i = 0; i < x.size() || borrow; ++i) {
+            const uint32_t y = (i < x.size() ? x[i] : 0) + borrow;
+            borrow = r[i] < y;
+            r[i] = borrow ? r[i] + BASE - y : r[i] - y;
+        }
+    }
+
+    /// The lowest m limbs (low) or the others of x
+    static BigInt split(const BigInt &x, size_t m, bool low) {
+        BigInt part;
+        const size_t cut = min(m, x.limbs.size());
+        if (low)
+            part.limbs.assign(x.limbs.begin(), x.limbs.begin() + cut);
+        else
+            part.limbs.assign(x.limbs.begin() + cut, x.limbs.end());
+        part.trim();
+        return part;
+    }
+
+    /// One Karatsuba level, a = a1 B^m + a0: a0 b0 + ((a0 + a1)(b0 + b1) -
+    /// a0 b0 - a1 b1) B^m + a1 b1 B^2m with the products from `product`
+    template <typename Product>
+    static BigInt karatsuba(const BigInt &a, const BigInt &b, Product product,
+                            bool tasks = false) {
+        const size_t m = max(a.limbs.size(), b.limbs.size()) / 2;
+        const BigInt a0 = split(a, m, true), a1 = split(a, m, false);
+        const BigInt b0 = split(b, m, true), b1 = split(b, m, false);
+        BigInt sa = a0, sb = b0;
+        sa.limbs.resize(max(a0.limbs.size(), a1.limbs.size()) + 1, 0);
+        sb.limbs.resize(max(b0.limbs.size(), b1.limbs.size()) + 1, 0);
+        add_at(sa.limbs, a1.limbs, 0);
+        add_at(sb.limbs, b1.limbs, 0);
+        sa.trim(), sb.trim();
+
+        BigInt z0, z1, z2;
+        #pragma omp task shared(z0) if (tasks)
+        z0 = product(a0, b0);
+        #pragma omp task shared(z2) if (tasks)
+        z2 = product(a1, b1);
+        z1 = product(sa, sb);
+        #pragma omp taskwait
+
+        sub(z1.limbs, z0.limbs);
+        sub(z1.limbs, z2.limbs);
+        z1.trim();
+        BigInt r;
+        r.limbs.assign(a.limbs.size() + b.limbs.size() + 2, 0);
+        add_at(r.limbs, z0.limbs, 0);
+        add_at(r.limbs, z1.limbs, m);
+        add_at(r.limbs, z2.limbs, 2 * m);
+        r.trim();
+        return r;
+    }
+
+    static BigInt karatsuba_rec(const BigInt &a, const BigInt &b) {
+        if (min(a.limbs.size(), b.limbs.size()) < KARATSUBA_CUTOFF)
+            return mult_schoolbook(a, b);
+        const bool tasks = a.limbs.size() + b.limbs.size() > 8 * FFT_CUTOFF;
+        return karatsuba(a, b, karatsuba_rec, tasks);
+    }
+};
@@ -0,0 +1,152 @@
+// Filters a signal of any length through a FIR filter with StreamConvolver.
+// Usage: convolve filter.txt [input|-] [--method=save|add] [--fft=N]
+//                 [--binary] [--quiet]
+// The filter is a text file of taps. The input (a file, or standard input
+// for - or nothing, so a pipe works) is text samples, or raw float32 with
+// --binary; the output goes to standard output in the same format, unless
+// --quiet. The throughput goes to standard error.
+#include <chrono>
+
+#include "convolver.hpp"
+
+using namespace chrono;
+
+/// Samples read and written per call
+static const size_t CHUNK = 1 << 16;
+
+/// Up to `max` samples from in, text or raw float32
+static size_t read_samples(FILE *in, bool binary, float *samples, size_t max) {
+    if (binary)
+        return fread(samples, sizeof(float), max, in);
+    size_t n = 0;
+    while (n < max && fscanf(in, "%f", &samples[n]) == 1)
+        ++n;
+    return n;
+}
+
+static void write_samples(FILE *out, bool binary, const vector<float> &samples) {
+    if (binary) {
+        fwrite(samples.data(), sizeof(float), samples.size(), out);
+        return;
+    }
+    for (float x : samples)
+        fprintf(out, "%.7g\n", x);
+}
+
+static const char *USAGE = "usage: convolve filter.txt [input|-] [--method=save|add] "
+                           "[--fft=N] [--binary] [--quiet]\n";
+
+/// FFT size of --fft=N: a power of two, 0 if not
+static int parse_fft_size(const string &value) {
+    size_t end = 0;
+    long n = 0;
+    try {
+        n = stol(value, &end);
+    } catch (const exception &) {
+        return 0;
+    }
+    if (end != value.size() || n < 2 || n > (1L << 30) || (n & (n - 1)) != 0)
+        return 0;
+    return (int)n;
+}
+
+int main(int argc, char **argv) {
+    string filter_path, input_path = "-";
+    StreamConvolver::Method method = StreamConvolver::OVERLAP_SAVE;
+    int fft_size = 0;
+    bool binary = false, quiet = false;
+    vector<string> positional;
+    for (int i = 1; i < argc; ++i) {
+        const string arg = argv[i];
+        if (arg == "--method=add")
+            method = StreamConvolver::OVERLAP_ADD;
+        else if (arg == "--method=save")
+            method = StreamConvolver::OVERLAP_SAVE;
+        else if (arg.rfind("--fft=", 0) == 0) {
+            fft_size = parse_fft_size(arg.substr(6));
+            if (fft_size == 0) {
+                fprintf(stderr, "--fft needs a power of two, got %s\n%s",
+                        arg.substr(6).c_str(), USAGE);
+                return 1;
+            }
+        }
+        else if (arg == "--binary")
+            binary = true;
+        else if (arg == "--quiet")
+            quiet = true;
+        else if (arg.rfind("--", 0) == 0) {
+            fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return 1;
+        } else
+            positional.push_back(arg);
+    }
+    if (positional.empty()) {
+        fprintf(stderr, "%s", USAGE);
+        return 1;
+    }
+    filter_path = positional[0];
+    if (positional.size() > 1)
+        input_path = positional[1];
+
+    vector<float> filter;
+    ifstream filter_file(filter_path);
+    if (!filter_file) {
+        fprintf(stderr, "cannot open %s\n", filter_path.c_str());
+        return 1;
+    }
+    for (float tap; filter_file >> tap;)
+        filter.push_back(tap);
+    if (filter.empty()) {
+        fprintf(stderr, "no filter taps in %s\n%s", filter_path.c_str(), USAGE);
+        return 1;
+    }
+    if (fft_size > 0 && fft_size < 2 * (int)filter.size()) {
+        fprintf(stderr, "--fft=%d is below twice the %d filter taps\n",
+                fft_size, (int)filter.size());
+        return 1;
+    }
+
+    FILE *in = input_path == "-" ? stdin : fopen(input_path.c_str(), binary ? "rb" : "r");
+    if (in == NULL) {
+        fprintf(stderr, "cannot open %s\n", input_path.c_str());
+        return 1;
+    }
+
+    StreamConvolver convolver(filter, method, fft_size);
+    vector<float> samples(CHUNK), out;
+    out.reserve(CHUNK + convolver.latency());
+    size_t total = 0;
+    duration<double> busy(0);
+    const auto start = steady_clock::now();
+    for (;;) {
+        const size_t n = read_samples(in, binary, samples.data(), CHUNK);
+        const auto t0 = steady_clock::now();
+        if (n > 0)
+            convolver.push(samples.data(), n, out);
+        else
+            convolver.flush(out);
+        busy += steady_clock::now() - t0;
+        total += n;
+        if (!quiet)
+            write_samples(stdout, binary, out);
+        out.clear();
+        if (n == 0)
+            break;
+    }
+    const duration<double> wall = steady_clock::now() - start;
+    if (in != stdin)
+        fclose(in);
+
+    fprintf(stderr,
+            "%zu samples, %d taps, overlap-%s, FFT %d, blocks of %d, latency "
+            "<= %d samples\n",
+            total, (int)filter.size(),
+            method == StreamConvolver::OVERLAP_SAVE ? "save" : "add",
+            convolver.fft_size(), convolver.block(), convolver.latency());
+    fprintf(stderr,
+            "convolution %.3f s, %.1f Msamples/s; with I/O %.3f s, %.1f "
+            "Msamples/s\n",
+            busy.count(), total / busy.count() * 1e-6, wall.count(),
+            total / wall.count() * 1e-6);
+    return 0;
+}
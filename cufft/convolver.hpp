@@ -0,0 +1,145 @@
+#pragma once
+
+#include "fft_cpu.hpp"
+
+/*
+ * Streaming convolution of an unbounded real signal with a real FIR filter
+ * of M taps, in blocks of one fixed FFT size N >= 2 M.
+ *
+ * FFT::mult transforms whole inputs at once; here the signal is cut into
+ * blocks of L = N - M + 1 new samples. Overlap-save transforms every block
+ * with the M - 1 samples before it and keeps the last L outputs, which are
+ * free of wrap-around; overlap-add transforms the zero-padded block alone
+ * and adds the M - 1 samples it spills into the next block. Both multiply
+ * by the filter spectrum computed once. The signal being real, two
+ * consecutive blocks go through one complex transform as its real and
+ * imaginary parts (the filter is real, so they do not mix).
+ *
+ * Memory is O(N) whatever the signal length, and every sample leaves at
+ * most 2 L samples after it entered (latency()).
+ */
+class StreamConvolver {
+public:
+    enum Method { OVERLAP_SAVE, OVERLAP_ADD };
+
+    /// fft_size 0 picks 8 times the filter length, at least 1024
+    StreamConvolver(const vector<float> &filter, Method method = OVERLAP_SAVE,
+                    int fft_size = 0)
+        : method(method), taps((int)filter.size()),
+          plan(choose_size((int)filter.size(), fft_size)) {
+        if (filter.empty())
+            throw invalid_argument("StreamConvolver: empty filter");
+        const int n = plan.size();
+        if (n < 2 * taps || (n & (n - 1)) != 0)
+            throw invalid_argument(
+                "StreamConvolver: FFT size must be a power of two >= 2 taps");
+        step = n - taps + 1;
+        spectrum.assign(n, 0);
+        copy(filter.begin(), filter.end(), spectrum.begin());
+        plan.execute(spectrum.data(), false);
+        work.resize(n);
+        history.assign(taps - 1, 0);
+        staged.reserve(2 * step);
+    }
+
+    /// New samples per block
+    int block() const { return step; }
+
+    /// Samples pushed before the output of a sample comes out, at most
+    int latency() const { return 2 * step; }
+
+    int fft_size() const { return plan.size(); }
+
+    /// Feeds n samples; appends every output sample completed so far to out
+    void push(const float *in, size_t n, vector<float> &out) {
+        pushed += n;
+        while (n > 0) {
+            const size_t take = min(n, 2 * (size_t)step - staged.size());
+            staged.insert(staged.end(), in, in + take);
+            in += take;
+            n -= take;
+            if (staged.size() == 2 * (size_t)step)
+                process(out, 2 * step);
+        }
+    }
+
+    /// Ends the signal: appends the outputs still pending, up to the
+    /// length M - 1 + samples pushed of the full convolution
+    void flush(vector<float> &out) {
+        const size_t total = pushed + taps - 1;
+        while (emitted < total) {
+            staged.resize(2 * step, 0);
+            process(out, (int)min<size_t>(2 * step, total - emitted));
+        }
+        pushed = emitted = 0;
+        staged.clear();
+        history.assign(taps - 1, 0);
+        tail.clear();
+    }
+
+private:
+    Method method;
+    int taps, step = 0;
+    FFTPlan plan;
+    vector<fcomplex> spectrum, work;
+    vector<float> staged, history, tail;
+    size_t pushed = 0, emitted = 0;
+
+    static int choose_size(int taps, int fft_size) {
+        if (fft_size > 0)
+            return fft_size;
+        int n = 1024;
+        while (n < 8 * taps)
+            n <<= 1;
+        return n;
+    }
+
+    /// Convolves the 2 L staged samples, appends the first `count` outputs
+    void process(vector<float> &out, int count) {
+        const int n = plan.size(), h = taps - 1;
+        const float *a = staged.data(), *b = staged.data() + step;
+        if (method == OVERLAP_SAVE) {
+            // block a after the history, block b after the end of a
+            // (L > M - 1)
+            for (int i = 0; i < h; ++i)
+                work[i] = fcomplex(history[i], a[step - h + i]);
+            for (int i = 0; i < step; ++i)
+                work[h + i] = fcomplex(a[i], b[i]);
+            copy(b + step - h, b + step, history.begin());
+        } else {
+            for (int i = 0; i < step; ++i)
+                work[i] = fcomplex(a[i], b[i]);
+            fill(work.begin() + step, work.end(), fcomplex(0));
+        }
+
+        plan.execute(work.data(), false);
+        for (int i = 0; i < n; ++i) {
+            const fcomplex x = work[i], y = spectrum[i];
+            work[i] = fcomplex(x.real() * y.real() - x.imag() * y.imag(),
+                               x.real() * y.imag() + x.imag() * y.real());
+        }
+        plan.execute(work.data(), true);
+
+        const size_t first = out.size();
+        out.resize(first + 2 * step);
+        float *y = out.data() + first;
+        if (method == OVERLAP_SAVE) {
+            for (int i = 0; i < step; ++i) {
+                y[i] = work[h + i].real();
+                y[step + i] = work[h + i].imag();
+            }
+        } else {
+            // a gets the spill of the previous block, b that of a
+            tail.resize(h, 0);
+            for (int i = 0; i < step; ++i) {
+                y[i] = work[i].real() + (i < h ? tail[i] : 0);
+                y[step + i] = work[i].imag() + (i < h ? work[step + i].real() : 0);
+            }
+            for (int i = 0; i < h; ++i)
+                tail[i] = work[step + i].imag();
+        }
+        out.resize(first + count);
+        emitted += count;
+        staged.clear();
+    }
+};
@@ -199,6 +199,10 @@ int main()
        
     }
     
+#ifdef FFT_PERF
+    // stdout goes to out.txt
+    perf_report(stderr);
+#endif
     
     return 0;
 }
@@ -1,15 +1,91 @@
+#pragma once
+
 #include <bits/stdc++.h>
 
+// -DFFT_PERF times every FFT::fft call for perf_report() (a counter read
+// per call, so only for whole-array transforms)
+#ifdef FFT_PERF
+#include "../openmp/perf_region.h"
+#endif
+
 using namespace std;
 
 using fcomplex = complex<float>;
+#ifdef __CUDACC__
 using  f2complex = float2;
+#endif
+
+/// Transform of one fixed size n, a power of two, with the bit-reversal
+/// permutation and the twiddles (from cos and sin, not a recurrence)
+/// computed once, for code that transforms many blocks of the same size;
+/// in single (FFTPlan) or double precision
+template <typename Real>
+class BasicFFTPlan {
+public:
+    using value_type = complex<Real>;
+
+    explicit BasicFFTPlan(int n) : n(n), twiddles(max(n, 2)) {
+        for (int i = 1, j = 0; i < n; ++i) {
+            int bit = n >> 1;
+            for (; j >= bit; bit >>= 1)
+                j -= bit;
+            j += bit;
+            if (i < j)
+                swaps.push_back({i, j});
+        }
+        // exp(-2 pi i j / len) at len / 2 + j
+        for (int half = 1; half < n; half <<= 1)
+            for (int j = 0; j < half; ++j)
+                twiddles[half + j] = polar(1.0, -M_PI * j / half);
+    }
+
+    int size() const { return n; }
+
+    void execute(value_type *a, bool invert) const {
+        for (const auto &s : swaps)
+            swap(a[s.first], a[s.second]);
+
+        for (int half = 1; half < n; half <<= 1) {
+            const value_type *w = &twiddles[half];
+            for (int i = 0; i < n; i += 2 * half) {
+                for (int j = 0; j < half; ++j) {
+                    // written out: operator* checks for infinities
+                    const value_type x = a[i + j + half];
+                    const Real wr = w[j].real(), wi = invert ? -w[j].imag() : w[j].imag();
+                    const value_type u = a[i + j];
+                    const value_type v(x.real() * wr - x.imag() * wi,
+                                       x.real() * wi + x.imag() * wr);
+                    a[i + j] = u + v;
+                    a[i + j + half] = u - v;
+                }
+            }
+        }
+
+        if (invert)
+            for (int i = 0; i < n; ++i)
+                a[i] /= n;
+    }
+
+private:
+    int n;
+    vector<pair<int, int>> swaps;
+    vector<value_type> twiddles;
+};
+
+using FFTPlan = BasicFFTPlan<float>;
 
 class FFT {
 public:
     void fft(vector<fcomplex> &a, bool invert) {
+        fft(a.data(), (int)a.size(), invert);
+    }
 
-        int n = (int)a.size();
+    /// In-place transform of n contiguous values, n a power of two
+    void fft(fcomplex *a, int n, bool invert) {
+#ifdef FFT_PERF
+        static perf_region region = PERF_REGION_INIT("FFT::fft");
+        perf_scope scope = perf_begin(&region);
+#endif
 
         for (int i = 1, j = 0; i < n; ++i) {
             int bit = n >> 1;
@@ -37,6 +113,13 @@ public:
         if (invert)
             for (int i = 0; i < n; ++i)
                 a[i] /= n;
+
+#ifdef FFT_PERF
+        // 5 n log n flops; every stage reads and writes the whole array
+        const double stages = log2((double)n);
+        perf_end(&scope);
+        perf_work(&region, 5.0 * n * stages, 2.0 * sizeof(fcomplex) * n * stages);
+#endif
         return;
     }
 
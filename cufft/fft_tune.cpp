@@ -0,0 +1,63 @@
+// Tunes the CPU FFT for a list of sizes and compares it with FFT::fft.
+// Usage: fft_tune [log2 n ...]   (default 10 12 14 16 18 20 22)
+// The first run searches and writes fft_wisdom.txt (FFT_WISDOM to change
+// it); the next ones read the parameters from there.
+#include "fft_tune.hpp"
+
+using namespace chrono;
+
+int main(int argc, char **argv) {
+    vector<int> logs;
+    for (int i = 1; i < argc; ++i)
+        logs.push_back(stoi(argv[i]));
+    if (logs.empty())
+        logs = {10, 12, 14, 16, 18, 20, 22};
+
+    FFTTuner tuner;
+    printf("%10s %8s %6s %5s %8s %10s %12s %12s %8s %9s\n", "n", "search,s",
+           "radix", "tile", "crossover", "threads", "FFT::fft,s", "tuned,s",
+           "speedup", "error");
+    for (int lg : logs) {
+        const int n = 1 << lg;
+        const auto start = steady_clock::now();
+        const FFTParams p = tuner.params(n);
+        const duration<double> search = steady_clock::now() - start;
+        const TunableFFT &plan = tuner.plan(n);
+
+        // the same input through both, as a check
+        vector<fcomplex> a(n), b;
+        for (int i = 0; i < n; ++i)
+            a[i] = fcomplex(sin(0.1 * i), cos(0.3 * i));
+        b = a;
+        FFT().fft(a, false);
+        plan.execute(b.data(), false, p);
+        double error = 0, norm = 0;
+        for (int i = 0; i < n; ++i) {
+            error = max(error, (double)abs(a[i] - b[i]));
+            norm = max(norm, (double)abs(a[i]));
+        }
+
+        // FFT::fft timed like the candidates: forward and inverse pairs
+        double baseline = 1e300;
+        for (int rep = 0; rep < 3; ++rep) {
+            int runs = 0;
+            const auto t0 = steady_clock::now();
+            duration<double> elapsed(0);
+            do {
+                FFT().fft(a, false);
+                FFT().fft(a, true);
+                runs += 2;
+                elapsed = steady_clock::now() - t0;
+            } while (elapsed.count() < 0.01);
+            baseline = min(baseline, elapsed.count() / runs);
+        }
+        const double tuned = FFTTuner::measure(plan, p);
+        printf("%10d %8.3f %6d %5d %8d %10d %12.3e %12.3e %8.2f %9.1e\n", n,
+               search.count(), p.radix, p.tile, p.crossover, p.threads,
+               baseline, tuned, baseline / tuned, error / norm);
+    }
+#ifdef FFT_PERF
+    perf_report(stderr);
+#endif
+    return 0;
+}
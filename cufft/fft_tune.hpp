@@ -0,0 +1,309 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+#include <omp.h>
+
+#include "fft_cpu.hpp"
+
+/*
+ * CPU FFT with tunable schedule, and the autotuner that picks its
+ * parameters per transform size and remembers them in a wisdom file.
+ *
+ * After the bit-reversal permutation, the stages whose blocks fit in a
+ * tile run tile by tile, each tile (all its stages) on one thread while it
+ * is in cache. The larger stages run one after the other over the whole
+ * array, their blocks shared among the threads, or, for blocks longer than
+ * the crossover, the butterflies inside each block (few long blocks would
+ * leave threads idle). With radix 4, two radix-2 stages are fused into one
+ * pass, halving the loads and stores.
+ *
+ * FFTTuner::params(n) times candidate parameters the first time it sees n
+ * on this machine (from a fraction of a second to a few seconds for 2^22
+ * points), stores the winner in the
+ * wisdom file (FFT_WISDOM, fft_wisdom.txt by default) and finds it there
+ * from then on, also in later runs.
+ */
+
+struct FFTParams {
+    int radix = 2;       // 2 or 4
+    int tile = 1024;     // values per tile of the first stages
+    int crossover = 0;   // blocks longer than this split their butterflies
+    int threads = 1;
+};
+
+/// Twiddles and permutation of one size, run with any FFTParams
+class TunableFFT {
+public:
+    explicit TunableFFT(int n) : n(n), twiddles(max(n, 2)) {
+        for (int i = 1, j = 0; i < n; ++i) {
+            int bit = n >> 1;
+            for (; j >= bit; bit >>= 1)
+                j -= bit;
+            j += bit;
+            if (i < j)
+                swaps.push_back({i, j});
+        }
+        for (int half = 1; half < n; half <<= 1)
+            for (int j = 0; j < half; ++j)
+                twiddles[half + j] = polar(1.0, -M_PI * j / half);
+    }
+
+    int size() const { return n; }
+
+    void execute(fcomplex *a, bool invert, const FFTParams &p) const {
+        const int tile = min(p.tile, n);
+        const int crossover = p.crossover > 0 ? p.crossover : n;
+        #pragma omp parallel num_threads(p.threads)
+        {
+            #pragma omp for schedule(static)
+            for (size_t s = 0; s < swaps.size(); ++s)
+                swap(a[swaps[s].first], a[swaps[s].second]);
+
+            // stages within a tile, one tile per thread
+            #pragma omp for schedule(static)
+            for (int t = 0; t < n; t += tile)
+                for (int half = 1; half < tile;)
+                    half = stages(a + t, tile, half, tile, p.radix, invert,
+                                  [&](int blocks, int len, auto &&pass) {
+                                      for (int b = 0; b < blocks; ++b)
+                                          for (int j = 0; j < len; ++j)
+                                              pass(b, j);
+                                  });
+
+            // the remaining ones over the whole array
+            for (int half = tile; half < n;)
+                half = stages(a, n, half, n, p.radix, invert,
+                              [&](int blocks, int len, auto &&pass) {
+                                  if (n / blocks <= crossover) {
+                                      #pragma omp for schedule(static)
+                                      for (int b = 0; b < blocks; ++b)
+                                          for (int j = 0; j < len; ++j)
+                                              pass(b, j);
+                                  } else {
+                                      for (int b = 0; b < blocks; ++b) {
+                                          #pragma omp for schedule(static)
+                                          for (int j = 0; j < len; ++j)
+                                              pass(b, j);
+                                      }
+                                  }
+                              });
+
+            if (invert) {
+                #pragma omp for schedule(static)
+                for (int i = 0; i < n; ++i)
+                    a[i] /= n;
+            }
+        }
+    }
+
+private:
+    int n;
+    vector<pair<int, int>> swaps;
+    vector<fcomplex> twiddles;
+
+    /// x * w, or x * conj(w) for the inverse; operator* checks for infinities
+    static fcomplex rotate(fcomplex x, fcomplex w, bool invert) {
+        const float wr = w.real(), wi = invert ? -w.imag() : w.imag();
+        return fcomplex(x.real() * wr - x.imag() * wi,
+                        x.real() * wi + x.imag() * wr);
+    }
+
+    /// One pass over the m values at a starting at stage `half`: radix 4
+    /// (stages half and 2 half) when it fits below `end`, else radix 2.
+    /// `loop(blocks, len, pass)` calls pass(block, j) for all blocks and
+    /// j < len. Returns the next half.
+    template <typename Loop>
+    int stages(fcomplex *a, int m, int half, int end, int radix, bool invert,
+               Loop loop) const {
+        if (radix == 4 && 4 * half <= end) {
+            const fcomplex *w1 = &twiddles[half], *w2 = &twiddles[2 * half];
+            loop(m / (4 * half), half, [&](int b, int j) {
+                fcomplex *x = a + b * 4 * half + j;
+                const fcomplex a0 = x[0], a1 = rotate(x[half], w1[j], invert);
+                const fcomplex a2 = x[2 * half],
+                               a3 = rotate(x[3 * half], w1[j], invert);
+                const fcomplex b0 = a0 + a1, b1 = a0 - a1, b2 = a2 + a3,
+                               b3 = a2 - a3;
+                const fcomplex c2 = rotate(b2, w2[j], invert),
+                               c3 = rotate(b3, w2[j + half], invert);
+                x[0] = b0 + c2;
+                x[2 * half] = b0 - c2;
+                x[half] = b1 + c3;
+                x[3 * half] = b1 - c3;
+            });
+            return 4 * half;
+        }
+        const fcomplex *w = &twiddles[half];
+        loop(m / (2 * half), half, [&](int b, int j) {
+            fcomplex *x = a + b * 2 * half + j;
+            const fcomplex u = x[0], v = rotate(x[half], w[j], invert);
+            x[0] = u + v;
+            x[half] = u - v;
+        });
+        return 2 * half;
+    }
+};
+
+class FFTTuner {
+public:
+    explicit FFTTuner(string path = "") : path(path) {
+        if (this->path.empty()) {
+            const char *env = getenv("FFT_WISDOM");
+            this->path = env != NULL ? env : "fft_wisdom.txt";
+        }
+        load();
+    }
+
+    /// Tuned parameters for size n and up to omp_get_max_threads()
+    /// threads, timed now if the wisdom has none
+    FFTParams params(int n) {
+        lock_guard<mutex> lock(guard);
+        const pair<int, int> key(n, omp_get_max_threads());
+        auto found = wisdom.find(key);
+        if (found != wisdom.end())
+            return found->second;
+        const FFTParams best = tune(n);
+        wisdom[key] = best;
+        save();
+        return best;
+    }
+
+    /// Plan of size n, built once
+    const TunableFFT &plan(int n) {
+        lock_guard<mutex> lock(guard);
+        auto &p = plans[n];
+        if (!p)
+            p = make_unique<TunableFFT>(n);
+        return *p;
+    }
+
+    /// FFT::fft with the tuned schedule
+    void fft(vector<fcomplex> &a, bool invert) {
+        const int n = (int)a.size();
+        const FFTParams p = params(n);
+        plan(n).execute(a.data(), invert, p);
+    }
+
+    /// Seconds per transform with p, best of up to three timings of
+    /// forward and inverse pairs, 0.2 s at most unless one pair takes longer
+    static double measure(const TunableFFT &fft, const FFTParams &p) {
+        vector<fcomplex> a(fft.size());
+        for (int i = 0; i < fft.size(); ++i)
+            a[i] = fcomplex(sin(i), cos(3 * i));
+        double best = 1e300;
+        const auto begin = chrono::steady_clock::now();
+        for (int rep = 0; rep < 3; ++rep) {
+            int runs = 0;
+            const auto start = chrono::steady_clock::now();
+            chrono::duration<double> elapsed(0);
+            // forward and inverse keep the data bounded
+            do {
+                fft.execute(a.data(), false, p);
+                fft.execute(a.data(), true, p);
+                runs += 2;
+                elapsed = chrono::steady_clock::now() - start;
+            } while (elapsed.count() < 0.01);
+            best = min(best, elapsed.count() / runs);
+            const chrono::duration<double> total = chrono::steady_clock::now() - begin;
+            if (total.count() > 0.2)
+                break;
+        }
+        return best;
+    }
+
+private:
+    string path;
+    map<pair<int, int>, FFTParams> wisdom; // by size and thread budget
+    map<int, unique_ptr<TunableFFT>> plans;
+    mutex guard;
+
+    /// Coordinate search: radix and tile, then crossover, then threads
+    FFTParams tune(int n) {
+        auto &p = plans[n];
+        if (!p)
+            p = make_unique<TunableFFT>(n);
+        const TunableFFT &fft = *p;
+        const int max_threads = omp_get_max_threads();
+
+        FFTParams best;
+        best.threads = max_threads;
+        best.tile = min(n, 1024);
+        double best_time = 1e300;
+        auto consider = [&](const FFTParams &candidate) {
+            const double t = measure(fft, candidate);
+            if (t < best_time) {
+                best_time = t;
+                best = candidate;
+            }
+        };
+
+        for (int radix : {2, 4}) {
+            for (int tile = 256; tile <= min(n, 1 << 16); tile *= 4) {
+                FFTParams c = best;
+                c.radix = radix;
+                c.tile = tile;
+                consider(c);
+            }
+            if (n < 256) {
+                FFTParams c = best;
+                c.radix = radix;
+                c.tile = n;
+                consider(c);
+            }
+        }
+        const FFTParams base = best;
+        for (int crossover = 4 * base.tile; crossover < n; crossover *= 4) {
+            FFTParams c = base;
+            c.crossover = crossover;
+            consider(c);
+        }
+        const FFTParams shape = best;
+        for (int threads = 1; threads < max_threads; threads *= 2) {
+            FFTParams c = shape;
+            c.threads = threads;
+            consider(c);
+        }
+        return best;
+    }
+
+    /// Lines "n max_threads radix tile crossover threads"
+    void load() {
+        ifstream file(path);
+        string line;
+        while (getline(file, line)) {
+            if (line.empty() || line[0] == '#')
+                continue;
+            istringstream fields(line);
+            int n, budget;
+            FFTParams p;
+            // a damaged line is dropped, its size is tuned again
+            if (fields >> n >> budget >> p.radix >> p.tile >> p.crossover >>
+                    p.threads &&
+                valid(n, budget, p))
+                wisdom[{n, budget}] = p;
+        }
+    }
+
+    static bool power_of_two(int x) { return x > 0 && (x & (x - 1)) == 0; }
+
+    /// Parameters execute() can run: tiles and blocks split evenly
+    static bool valid(int n, int budget, const FFTParams &p) {
+        return power_of_two(n) && budget >= 1 &&
+               (p.radix == 2 || p.radix == 4) && power_of_two(p.tile) &&
+               (p.crossover == 0 || power_of_two(p.crossover)) &&
+               p.threads >= 1;
+    }
+
+    void save() const {
+        ofstream out(path);
+        out << "# n max_threads radix tile crossover threads\n";
+        for (const auto &entry : wisdom) {
+            const FFTParams &p = entry.second;
+            out << entry.first.first << " " << entry.first.second << " "
+                << p.radix << " " << p.tile << " " << p.crossover << " "
+                << p.threads << "\n";
+        }
+    }
+};
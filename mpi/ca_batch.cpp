@@ -0,0 +1,658 @@
+// Batch engine for elementary cellular automata: sweeps of many rules and
+// initial states at once, with statistics per run instead of states.
+// Usage: mpirun -np P ca_batch [--rules=0-255] [--seeds=1-64] [--cells=1024]
+//            [--steps=1024] [--lanes=64|512] [--constant] [--csv=FILE]
+//            [--compare]
+//   --rules, --seeds: lists and ranges such as 30,90,110 or 0-255. Seed 0
+//   is the single centered 1 of cellular_automata.cpp, seed s > 0 a random
+//   state of density 1/2 (Philox with key s, the same on every machine).
+//   --constant: zero boundaries instead of periodic ones.
+//   --csv: rule,seed,density,entropy,period per run (ca_batch.csv).
+//   --compare: also runs a few of the runs one at a time with the update of
+//   cellular_automata.cpp, checks they give the same statistics and reports
+//   the speedup.
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <exception>
+#include <mpi.h>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../openmp/philox.h"
+
+// Bit slicing: word i of a batch holds cell i of up to 64 W simulations, one
+// per bit (lane). One pass of bitwise operations over the words steps all
+// the lanes, so a step costs a few operations per 64 (or, with W = 8 words
+// that the compiler keeps in 512-bit registers, per 512) cells.
+//
+// The rule is a template parameter: its algebraic normal form (the XOR of
+// products of l, c, r that equals it) is computed at compile time and only
+// its monomials are evaluated, e.g. rule 30 = l ^ c ^ r ^ c r. All 256
+// instantiations are in a table. A batch whose lanes have different rules
+// (the leftovers of a sweep) uses the generic form instead: the OR of the 8
+// minterms, each masked by the lanes whose rule contains it.
+//
+// Statistics are gathered on the words too:
+//   density  fraction of ones in the final state;
+//   entropy  Shannon entropy of the 3-cell windows of the final state, per
+//            cell (1 for a random state, 0 for a uniform one);
+//   period   cycle length of the whole state (0: none seen), found by
+//            Brent's method: a snapshot taken at steps 0, 1, 3, 7, ... is
+//            compared with every later state, a lane whose state equals it
+//            for the first time has cycled.
+// Counts per lane use vertical counters: bit b of the count of every lane
+// lives in word b, and adding a word is a ripple of AND/XOR.
+
+using std::vector;
+
+/// GCC vector of 8 words: the bitwise operators apply to all of them and
+/// the compiler keeps it in one 512-bit register (or two 256-bit ones)
+typedef uint64_t Words8 __attribute__((vector_size(64)));
+
+/// W words of lanes, 64 W simulations
+template <int W>
+struct Lanes {
+  static_assert(W == 1 || W == 8, "64 or 512 lanes");
+  typename std::conditional<W == 1, uint64_t, Words8>::type w;
+
+  static Lanes Zero() { return Lanes{}; }
+  uint64_t Word(int k) const {
+    if constexpr (W == 1) {
+      return w;
+    } else {
+      return w[k];
+    }
+  }
+  bool Any() const {
+    uint64_t any = 0;
+    for (int k = 0; k < W; ++k) {
+      any |= Word(k);
+    }
+    return any != 0;
+  }
+  int Bit(int lane) const { return Word(lane / 64) >> (lane % 64) & 1; }
+  void SetWord(int k, uint64_t value) {
+    if constexpr (W == 1) {
+      w = value;
+    } else {
+      w[k] = value;
+    }
+  }
+  void Set(int lane) {
+    if constexpr (W == 1) {
+      w |= uint64_t(1) << lane;
+    } else {
+      w[lane / 64] |= uint64_t(1) << (lane % 64);
+    }
+  }
+
+  friend Lanes operator&(const Lanes &a, const Lanes &b) { return {a.w & b.w}; }
+  friend Lanes operator|(const Lanes &a, const Lanes &b) { return {a.w | b.w}; }
+  friend Lanes operator^(const Lanes &a, const Lanes &b) { return {a.w ^ b.w}; }
+  friend Lanes operator~(const Lanes &a) { return {~a.w}; }
+  Lanes &operator|=(const Lanes &b) { return *this = *this | b; }
+  Lanes &operator^=(const Lanes &b) { return *this = *this ^ b; }
+};
+
+/// Algebraic normal form of a rule: bit m set if the product of the
+/// neighbours in m (4: left, 2: center, 1: right) is one of its terms
+constexpr int RuleANF(int rule) {
+  int anf = rule;
+  for (int b = 1; b < 8; b <<= 1) {
+    for (int m = 0; m < 8; ++m) {
+      if (m & b) {
+        anf ^= (anf >> (m ^ b) & 1) << m;
+      }
+    }
+  }
+  return anf;
+}
+
+/// A rule fixed at compile time
+template <int RULE>
+struct Specialized {
+  template <typename L>
+  L operator()(const L &l, const L &c, const L &r) const {
+    constexpr int anf = RuleANF(RULE);
+    L out = L::Zero();
+    if constexpr (anf & 1) out = ~out;
+    if constexpr (anf >> 1 & 1) out ^= r;
+    if constexpr (anf >> 2 & 1) out ^= c;
+    if constexpr (anf >> 3 & 1) out ^= c & r;
+    if constexpr (anf >> 4 & 1) out ^= l;
+    if constexpr (anf >> 5 & 1) out ^= l & r;
+    if constexpr (anf >> 6 & 1) out ^= l & c;
+    if constexpr (anf >> 7 & 1) out ^= l & c & r;
+    return out;
+  }
+};
+
+/// A rule per lane: mask[k] has the lanes whose rule maps pattern k to 1
+template <typename L>
+struct Mixed {
+  L mask[8];
+
+  L operator()(const L &l, const L &c, const L &r) const {
+    const L nl = ~l, nc = ~c, nr = ~r;
+    const L a0 = nl & nc, a1 = nl & c, a2 = l & nc, a3 = l & c;
+    return (a0 & nr & mask[0]) | (a0 & r & mask[1]) | (a1 & nr & mask[2]) |
+           (a1 & r & mask[3]) | (a2 & nr & mask[4]) | (a2 & r & mask[5]) |
+           (a3 & nr & mask[6]) | (a3 & r & mask[7]);
+  }
+};
+
+struct Config {
+  int cells = 1024, steps = 1024, lanes = 64;
+  bool periodic = true;
+};
+
+struct Result {
+  int rule, seed, period;
+  double density, entropy;
+};
+
+/// A set of runs simulated together; rule -1 if their rules differ
+struct Batch {
+  int rule;
+  vector<std::pair<int, int>> runs;  // (rule, seed)
+};
+
+/// Bits of cells 64 g .. 64 g + 63 of the initial state of `seed`
+uint64_t InitialBits(int seed, int cells, int g) {
+  if (seed == 0) {
+    const int center = cells / 2;
+    return center / 64 == g ? uint64_t(1) << (center % 64) : 0;
+  }
+  const philox4x32_ctr block = philox4x32_10(
+      {{(uint32_t)(g / 2), 0, 0, 0}}, {{(uint32_t)seed, 0}});
+  const int k = 2 * (g % 2);
+  uint64_t bits = block.v[k] | (uint64_t)block.v[k + 1] << 32;
+  if (64 * (g + 1) > cells) {
+    bits &= (uint64_t(1) << (cells - 64 * g)) - 1;  // past the last cell
+  }
+  return bits;
+}
+
+/// In-place transpose of a 64 x 64 bit matrix: bit i of a[j] goes to bit j
+/// of a[i]
+void Transpose64(uint64_t a[64]) {
+  uint64_t m = 0x00000000FFFFFFFFull;
+  for (int j = 32; j != 0; j >>= 1, m ^= m << j) {
+    for (int k = 0; k < 64; k = (k + j + 1) & ~j) {
+      const uint64_t t = (a[k] >> j ^ a[k + j]) & m;
+      a[k] ^= t << j;
+      a[k + j] ^= t;
+    }
+  }
+}
+
+/// count(lane) += bit of x, for up to 2^planes.size() - 1 additions
+template <typename L>
+void Count(vector<L> &planes, L x) {
+  for (auto &plane : planes) {
+    const L carry = plane & x;
+    plane ^= x;
+    x = carry;
+    if (!x.Any()) {
+      return;
+    }
+  }
+}
+
+template <typename L>
+int CountOf(const vector<L> &planes, int lane) {
+  int count = 0;
+  for (size_t b = 0; b < planes.size(); ++b) {
+    count |= planes[b].Bit(lane) << b;
+  }
+  return count;
+}
+
+/// Entropy per cell of the 3-cell window counts
+double WindowEntropy(const long counts[8], int cells) {
+  double h = 0;
+  for (int k = 0; k < 8; ++k) {
+    if (counts[k] > 0) {
+      const double p = (double)counts[k] / cells;
+      h -= p * std::log2(p);
+    }
+  }
+  return h / 3;
+}
+
+/// One step of all lanes, boundary words `before` and `after`
+template <typename L>
+using StepFunction = void (*)(const L *state, L *next, int n, const L &before,
+                              const L &after, const void *rule);
+
+template <typename L, typename Rule>
+void Step(const L *state, L *next, int n, const L &before, const L &after,
+          const void *data) {
+  // the compile-time rules have no data
+  Rule rule{};
+  if constexpr (!std::is_empty_v<Rule>) {
+    rule = *static_cast<const Rule *>(data);
+  }
+  if (n == 1) {
+    next[0] = rule(before, state[0], after);
+    return;
+  }
+  next[0] = rule(before, state[0], state[1]);
+  for (int i = 1; i < n - 1; ++i) {
+    next[i] = rule(state[i - 1], state[i], state[i + 1]);
+  }
+  next[n - 1] = rule(state[n - 2], state[n - 1], after);
+}
+
+/// Simulates the runs of one batch on lanes of type L, `step` with `rule`
+template <typename L>
+vector<Result> Simulate(const Config &config, const Batch &batch,
+                        StepFunction<L> step, const void *rule) {
+  constexpr int WORDS = sizeof(L) / 8;
+  const int n = config.cells, used = batch.runs.size();
+  vector<L> state(n), next(n), snapshot(n);
+
+  // lanes are rows, cells columns: transposed 64 x 64 at a time
+  uint64_t block[64];
+  for (int g = 0; g * 64 < n; ++g) {
+    for (int word = 0; word < WORDS; ++word) {
+      for (int j = 0; j < 64; ++j) {
+        const int lane = word * 64 + j;
+        block[j] = lane < used
+                       ? InitialBits(batch.runs[lane].second, n, g)
+                       : 0;
+      }
+      Transpose64(block);
+      for (int i = 0; i < 64 && g * 64 + i < n; ++i) {
+        state[g * 64 + i].SetWord(word, block[i]);
+      }
+    }
+  }
+
+  L active = L::Zero();
+  for (int lane = 0; lane < used; ++lane) {
+    active.Set(lane);
+  }
+  L cycled = ~active;
+  vector<int> period(used, 0);
+  std::copy(state.begin(), state.end(), snapshot.begin());
+  int snapshot_step = 0, power = 1;
+
+  const L zero = L::Zero();
+  for (int t = 1; t <= config.steps; ++t) {
+    step(state.data(), next.data(), n, config.periodic ? state[n - 1] : zero,
+         config.periodic ? state[0] : zero, rule);
+    std::swap(state, next);
+
+    if (!(~cycled).Any()) {
+      continue;
+    }
+    L differ = L::Zero();
+    for (int i = 0; i < n; ++i) {
+      differ |= state[i] ^ snapshot[i];
+    }
+    const L found = ~differ & ~cycled;
+    if (found.Any()) {
+      for (int lane = 0; lane < used; ++lane) {
+        if (found.Bit(lane)) {
+          period[lane] = t - snapshot_step;
+        }
+      }
+      cycled |= found;
+    }
+    if (t - snapshot_step == power) {
+      std::copy(state.begin(), state.end(), snapshot.begin());
+      snapshot_step = t;
+      power *= 2;
+    }
+  }
+
+  // ones and 3-cell windows of the final state
+  int bits = 1;
+  while ((1 << bits) <= n) {
+    ++bits;
+  }
+  vector<L> ones(bits, L::Zero());
+  vector<vector<L>> windows(8, vector<L>(bits, L::Zero()));
+  for (int i = 0; i < n; ++i) {
+    const L &l = i > 0 ? state[i - 1] : config.periodic ? state[n - 1] : zero;
+    const L &r = i + 1 < n ? state[i + 1] : config.periodic ? state[0] : zero;
+    const L &c = state[i];
+    Count(ones, c);
+    for (int k = 0; k < 8; ++k) {
+      Count(windows[k], (k & 4 ? l : ~l) & (k & 2 ? c : ~c) & (k & 1 ? r : ~r));
+    }
+  }
+
+  vector<Result> results(used);
+  for (int lane = 0; lane < used; ++lane) {
+    long counts[8];
+    for (int k = 0; k < 8; ++k) {
+      counts[k] = CountOf(windows[k], lane);
+    }
+    results[lane] = {batch.runs[lane].first, batch.runs[lane].second,
+                     period[lane], (double)CountOf(ones, lane) / n,
+                     WindowEntropy(counts, n)};
+  }
+  return results;
+}
+
+template <typename L, size_t... RULES>
+constexpr std::array<StepFunction<L>, 256>
+MakeRuleTable(std::index_sequence<RULES...>) {
+  return {&Step<L, Specialized<RULES>>...};
+}
+
+template <typename L>
+vector<Result> RunBatch(const Config &config, const Batch &batch) {
+  static const auto table = MakeRuleTable<L>(std::make_index_sequence<256>());
+  if (batch.rule >= 0) {
+    return Simulate<L>(config, batch, table[batch.rule], nullptr);
+  }
+  Mixed<L> mixed;
+  for (auto &m : mixed.mask) {
+    m = L::Zero();
+  }
+  for (size_t lane = 0; lane < batch.runs.size(); ++lane) {
+    for (int k = 0; k < 8; ++k) {
+      if (batch.runs[lane].first >> k & 1) {
+        mixed.mask[k].Set(lane);
+      }
+    }
+  }
+  return Simulate<L>(config, batch, &Step<L, Mixed<L>>, &mixed);
+}
+
+/// One run at a time with the int8 cells and rule table of
+/// cellular_automata.cpp, the same statistics
+Result RunScalar(const Config &config, int rule, int seed) {
+  const int n = config.cells;
+  vector<int8_t> transforms(8), state(n), next(n), snapshot;
+  for (int k = 0; k < 8; ++k) {
+    transforms[k] = rule >> k & 1;
+  }
+  for (int g = 0; g * 64 < n; ++g) {
+    const uint64_t bits = InitialBits(seed, n, g);
+    for (int i = 0; i < 64 && g * 64 + i < n; ++i) {
+      state[g * 64 + i] = bits >> i & 1;
+    }
+  }
+  snapshot = state;
+  int period = 0, snapshot_step = 0, power = 1;
+  for (int t = 1; t <= config.steps; ++t) {
+    int8_t left = config.periodic ? state[n - 1] : 0;
+    for (int i = 0; i < n; ++i) {
+      const int8_t right =
+          i + 1 < n ? state[i + 1] : config.periodic ? state[0] : 0;
+      next[i] = transforms[right + state[i] * 2 + left * 4];
+      left = state[i];
+    }
+    std::swap(state, next);
+    if (period == 0 && state == snapshot) {
+      period = t - snapshot_step;
+    }
+    if (t - snapshot_step == power) {
+      snapshot = state;
+      snapshot_step = t;
+      power *= 2;
+    }
+  }
+  long ones = 0, counts[8] = {};
+  for (int i = 0; i < n; ++i) {
+    const int l = i > 0 ? state[i - 1] : config.periodic ? state[n - 1] : 0;
+    const int r = i + 1 < n ? state[i + 1] : config.periodic ? state[0] : 0;
+    ones += state[i];
+    ++counts[4 * l + 2 * state[i] + r];
+  }
+  return {rule, seed, period, (double)ones / n, WindowEntropy(counts, n)};
+}
+
+/// Decimal int filling all of text; false if it is not one
+bool ParseInt(const std::string &text, int &value) {
+  size_t end = 0;
+  try {
+    value = std::stoi(text, &end);
+  } catch (const std::exception &) {
+    return false;
+  }
+  return end == text.size();
+}
+
+/// "a-b,c,..." into the numbers it lists; false if the text is not such a
+/// list
+bool ParseList(const std::string &text, vector<int> &list) {
+  list.clear();
+  size_t pos = 0;
+  while (pos < text.size()) {
+    size_t end = text.find(',', pos);
+    if (end == std::string::npos) {
+      end = text.size();
+    }
+    const std::string item = text.substr(pos, end - pos);
+    const size_t dash = item.find('-');
+    int first, last;
+    if (!ParseInt(item.substr(0, dash), first)) {
+      return false;
+    }
+    if (dash == std::string::npos) {
+      last = first;
+    } else if (!ParseInt(item.substr(dash + 1), last)) {
+      return false;
+    }
+    for (int v = first; v <= last; ++v) {
+      list.push_back(v);
+    }
+    pos = end + 1;
+  }
+  return true;
+}
+
+
+/// Full batches of one rule, then the leftovers of all rules together
+vector<Batch> MakeBatches(const vector<int> &rules, const vector<int> &seeds,
+                          int lanes) {
+  vector<Batch> batches;
+  vector<std::pair<int, int>> leftovers;
+  for (int rule : rules) {
+    size_t s = 0;
+    for (; s + lanes <= seeds.size(); s += lanes) {
+      Batch batch{rule, {}};
+      for (size_t k = s; k < s + lanes; ++k) {
+        batch.runs.push_back({rule, seeds[k]});
+      }
+      batches.push_back(batch);
+    }
+    for (; s < seeds.size(); ++s) {
+      leftovers.push_back({rule, seeds[s]});
+    }
+  }
+  for (size_t s = 0; s < leftovers.size(); s += lanes) {
+    Batch batch{-1, {}};
+    batch.runs.assign(leftovers.begin() + s,
+                      leftovers.begin() + std::min(leftovers.size(), s + lanes));
+    const bool one_rule = std::all_of(
+        batch.runs.begin(), batch.runs.end(),
+        [&](const std::pair<int, int> &run) {
+          return run.first == batch.runs[0].first;
+        });
+    if (one_rule) {
+      batch.rule = batch.runs[0].first;
+    }
+    batches.push_back(batch);
+  }
+  return batches;
+}
+
+int main(int argc, char **argv) {
+  MPI_Init(&argc, &argv);
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+  Config config;
+  vector<int> rules, seeds;
+  ParseList("0-255", rules);
+  ParseList("1-64", seeds);
+  std::string csv = "ca_batch.csv";
+  bool compare = false;
+  for (int a = 1; a < argc; ++a) {
+    const std::string arg = argv[a];
+    auto value = [&](const char *name) {
+      const std::string prefix = std::string(name) + "=";
+      return arg.rfind(prefix, 0) == 0 ? arg.substr(prefix.size())
+                                       : std::string();
+    };
+    // every rank parses the same arguments, so all of them stop together
+    bool parsed = true;
+    if (!value("--rules").empty()) {
+      parsed = ParseList(value("--rules"), rules);
+    } else if (!value("--seeds").empty()) {
+      parsed = ParseList(value("--seeds"), seeds);
+    } else if (!value("--cells").empty()) {
+      parsed = ParseInt(value("--cells"), config.cells);
+    } else if (!value("--steps").empty()) {
+      parsed = ParseInt(value("--steps"), config.steps);
+    } else if (!value("--lanes").empty()) {
+      parsed = ParseInt(value("--lanes"), config.lanes);
+    } else if (!value("--csv").empty()) {
+      csv = value("--csv");
+    } else if (arg == "--constant") {
+      config.periodic = false;
+    } else if (arg == "--compare") {
+      compare = true;
+    } else {
+      if (rank == 0) {
+        fprintf(stderr, "unknown argument %s\n", arg.c_str());
+      }
+      MPI_Finalize();
+      return 1;
+    }
+    if (!parsed) {
+      if (rank == 0) {
+        fprintf(stderr, "bad value in %s: numbers, lists like 0-3,7\n",
+                arg.c_str());
+      }
+      MPI_Finalize();
+      return 1;
+    }
+  }
+  for (int rule : rules) {
+    if (rule < 0 || rule > 255) {
+      if (rank == 0) {
+        fprintf(stderr, "rules are 0 to 255\n");
+      }
+      MPI_Finalize();
+      return 1;
+    }
+  }
+  if ((config.lanes != 64 && config.lanes != 512) || config.cells <= 0 ||
+      config.steps < 0) {
+    if (rank == 0) {
+      fprintf(stderr, "--lanes is 64 or 512, --cells positive\n");
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  // opened before the sweep, so a bad path does not waste it
+  FILE *out = NULL;
+  int opened = 1;
+  if (rank == 0) {
+    out = fopen(csv.c_str(), "w");
+    if (out == NULL) {
+      fprintf(stderr, "cannot write %s\n", csv.c_str());
+      opened = 0;
+    }
+  }
+  MPI_Bcast(&opened, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (!opened) {
+    MPI_Finalize();
+    return 1;
+  }
+
+  // batches dealt round-robin over the ranks
+  const vector<Batch> batches = MakeBatches(rules, seeds, config.lanes);
+  MPI_Barrier(MPI_COMM_WORLD);
+  const double start = MPI_Wtime();
+  vector<double> mine;
+  for (size_t b = rank; b < batches.size(); b += size) {
+    const vector<Result> results =
+        config.lanes == 64 ? RunBatch<Lanes<1>>(config, batches[b])
+                           : RunBatch<Lanes<8>>(config, batches[b]);
+    for (const Result &r : results) {
+      mine.insert(mine.end(), {(double)r.rule, (double)r.seed,
+                               (double)r.period, r.density, r.entropy});
+    }
+  }
+  MPI_Barrier(MPI_COMM_WORLD);
+  const double elapsed = MPI_Wtime() - start;
+
+  // results to rank 0, 5 numbers per run
+  int count = mine.size();
+  vector<int> counts(size), offsets(size);
+  MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, MPI_COMM_WORLD);
+  vector<double> all;
+  if (rank == 0) {
+    for (int r = 1; r < size; ++r) {
+      offsets[r] = offsets[r - 1] + counts[r - 1];
+    }
+    all.resize(offsets[size - 1] + counts[size - 1]);
+  }
+  MPI_Gatherv(mine.data(), count, MPI_DOUBLE, all.data(), counts.data(),
+              offsets.data(), MPI_DOUBLE, 0, MPI_COMM_WORLD);
+
+  if (rank == 0) {
+    vector<Result> results;
+    for (size_t k = 0; k < all.size(); k += 5) {
+      results.push_back({(int)all[k], (int)all[k + 1], (int)all[k + 2],
+                         all[k + 3], all[k + 4]});
+    }
+    std::sort(results.begin(), results.end(),
+              [](const Result &a, const Result &b) {
+                return std::make_pair(a.rule, a.seed) <
+                       std::make_pair(b.rule, b.seed);
+              });
+    fprintf(out, "rule,seed,density,entropy,period\n");
+    for (const Result &r : results) {
+      fprintf(out, "%d,%d,%.6f,%.6f,%d\n", r.rule, r.seed, r.density,
+              r.entropy, r.period);
+    }
+    fclose(out);
+
+    const double updates = (double)results.size() * config.cells * config.steps;
+    printf("%zu runs (%zu batches of up to %d lanes) of %d cells, %d steps, "
+           "%s boundaries, %d ranks: %.3f s, %.2f Gcell updates/s\n",
+           results.size(), batches.size(), config.lanes, config.cells,
+           config.steps, config.periodic ? "periodic" : "constant", size,
+           elapsed, updates / elapsed * 1e-9);
+    printf("statistics written to %s\n", csv.c_str());
+
+    if (compare) {
+      // up to 16 runs spread over the sweep, one at a time
+      const int samples = std::min<int>(16, results.size());
+      int mismatches = 0;
+      const double scalar_start = MPI_Wtime();
+      for (int k = 0; k < samples; ++k) {
+        const Result &batched = results[(size_t)k * results.size() / samples];
+        const Result single = RunScalar(config, batched.rule, batched.seed);
+        if (single.period != batched.period ||
+            single.density != batched.density ||
+            std::abs(single.entropy - batched.entropy) > 1e-12) {
+          ++mismatches;
+        }
+      }
+      const double scalar = (MPI_Wtime() - scalar_start) / samples;
+      const double batched = elapsed * size / results.size();
+      printf("one run at a time: %.3g s per run; batched: %.3g s per run and "
+             "core, %.1fx faster; %d of %d sampled runs differ\n",
+             scalar, batched, scalar / batched, mismatches, samples);
+    }
+  }
+
+  MPI_Finalize();
+  return 0;
+}
@@ -6,6 +6,8 @@
 #include <stdexcept>
 #include <vector>
 
+#include "../openmp/trace.hpp"
+
 using std::cin, std::cout, std::endl, std::vector;
 
 /// Initialize vector of future states according to rule (0-255)
@@ -106,7 +108,9 @@ public:
 
   void Run() {
     while (iterations_number_-- > 0) {
+      TRACE_SCOPE("iteration");
       if (is_init_) {
+        TRACE_SCOPE("exchange borders");
         // Actual chunks are stored in worker threads
         // this thread sends to workers only left and right borders of
         // particular chunk
@@ -140,8 +144,11 @@ public:
 
       } else {
         // get new borders
+        Trace::Get().Begin("receive borders");
         MPI_Recv(&left_, 1, MPI_INT8_T, 0, 0, MPI_COMM_WORLD, &st_);
         MPI_Recv(&right_, 1, MPI_INT8_T, 0, 1, MPI_COMM_WORLD, &st_);
+        Trace::Get().End("receive borders");
+        Trace::Get().Begin("update");
         for (int i = 0; i < chunk_; ++i) {
           auto right = (i + 1 == chunk_) ? right_ : buffer_[i + 1];
           auto idx = GetIdx(left_, buffer_[i], right);
@@ -154,7 +161,9 @@ public:
           left_ = buffer_[0];
           right_ = buffer_[chunk_ - 1];
         }
+        Trace::Get().End("update");
         // send chunk new borders
+        TRACE_SCOPE("send borders");
         MPI_Ssend(&left_, 1, MPI_INT8_T, 0, 2, MPI_COMM_WORLD);
         MPI_Ssend(&right_, 1, MPI_INT8_T, 0, 3, MPI_COMM_WORLD);
       }
@@ -211,6 +220,8 @@ int main(int argc, char **argv) {
   std::ofstream file("speed.txt", std::ios_base::app);
 
   auto p = InitProcess(rank);
+  // TRACE=ca.%d.json writes one timeline per rank
+  Trace::FromEnv(rank);
 
   double start = MPI_Wtime();
   p->Run();
@@ -220,5 +231,6 @@ int main(int argc, char **argv) {
     file << "elapsed time: " << end - start << endl;
   }
 
+  Trace::Get().Stop();
   MPI_Finalize();
 }
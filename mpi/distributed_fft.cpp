@@ -0,0 +1,442 @@
+// Distributed FFT of single precision complex data over MPI ranks.
+// Usage: mpirun -np p distributed_fft 1d [log2 N] [repeats]
+//        mpirun -np p distributed_fft 2d [N0] [N1] [repeats]
+//        mpirun -np p distributed_fft 3d [N0] [N1] [N2] [repeats]
+#include <mpi.h>
+#include <omp.h>
+
+#include "../cufft/fft_cpu.hpp"
+
+// Every transform is a sequence of local FFTs along the dimension a rank
+// holds entirely, separated by global transposes (MPI_Ialltoall) that
+// bring the next dimension local:
+//
+// 1-D, six-step: N = R x C is seen as an R x C row-major matrix whose rows
+// are dealt to the ranks in blocks. Transpose, R-point FFTs of the rows,
+// twiddle by w_N^(c k1), transpose, C-point FFTs, transpose: the output is
+// in natural order, in blocks of N / p, like the input (R and C multiples
+// of p).
+//
+// 2-D, slabs: ranks hold N0 / p rows. Row FFTs, transpose, column FFTs
+// (now rows), transpose back (N0 and N1 multiples of p).
+//
+// 3-D, pencils: on a P0 x P1 grid, rank (r0, r1) holds x in block r0 and y
+// in block r1 with z complete. z FFTs, transpose y <-> z among the P1 ranks
+// of its grid row, y FFTs, transpose x <-> y among the P0 ranks of its grid
+// column, x FFTs. p can go up to min(N0 N1, N1 N2) instead of N0 for slabs.
+// The output is left in x pencils, [z / P1][y / P0][x], as transforms
+// followed by pointwise work and the inverse usually want it.
+//
+// A transpose is cut into TRANSPOSE_CHUNKS pieces along its outer
+// dimension: the FFTs of piece k + 1 are computed while piece k is in
+// flight, and received pieces are unpacked while the later ones arrive.
+// The local FFTs are FFT::fft of cufft/fft_cpu.hpp, one row per OpenMP
+// thread.
+
+/// Pieces a transpose is cut into to overlap it with the local FFTs
+static const long TRANSPOSE_CHUNKS = 4;
+
+/// Seconds spent in local FFTs (and twiddles) by this rank
+static double fft_seconds = 0;
+
+/// FFTs of the contiguous rows [first, last) of length n
+void RowFFTs(fcomplex *data, long first, long last, int n, bool invert) {
+  const double start = MPI_Wtime();
+#pragma omp parallel for schedule(static)
+  for (long r = first; r < last; ++r) {
+    FFT().fft(data + r * n, n, invert);
+  }
+  fft_seconds += MPI_Wtime() - start;
+}
+
+/// Global transpose among the ranks of comm. `in` is [batches][rows][cols]
+/// on every rank, with cols a multiple of the rank count p; rank q receives
+/// columns [q cols / p, (q + 1) cols / p) of everyone. Before batches
+/// [b0, b1) are sent, produce(b0, b1) computes them in place; element
+/// (b, i, j) of rank q lands at out[place(q, b, i, j - q cols / p)].
+template <typename Produce, typename Place>
+void Transpose(vector<fcomplex> &in, long batches, long rows, long cols,
+               MPI_Comm comm, vector<fcomplex> &out, Produce produce,
+               Place place) {
+  int p;
+  MPI_Comm_size(comm, &p);
+  const long width = cols / p;
+  const long chunks = min(TRANSPOSE_CHUNKS, batches);
+
+  vector<vector<fcomplex>> send(chunks), recv(chunks);
+  vector<MPI_Request> requests(chunks);
+  auto first = [&](long k) { return k * batches / chunks; };
+
+  for (long k = 0; k < chunks; ++k) {
+    const long b0 = first(k), b1 = first(k + 1), block = (b1 - b0) * rows * width;
+    produce(b0, b1);
+    send[k].resize(block * p);
+    recv[k].resize(block * p);
+    fcomplex *buffer = send[k].data();
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int q = 0; q < p; ++q) {
+      for (long b = b0; b < b1; ++b) {
+        for (long i = 0; i < rows; ++i) {
+          copy_n(&in[(b * rows + i) * cols + q * width], width,
+                 &buffer[((q * (b1 - b0) + b - b0) * rows + i) * width]);
+        }
+      }
+    }
+    MPI_Ialltoall(send[k].data(), block, MPI_C_FLOAT_COMPLEX, recv[k].data(),
+                  block, MPI_C_FLOAT_COMPLEX, comm, &requests[k]);
+    // let the pieces already posted progress
+    int done;
+    MPI_Testall(k + 1, requests.data(), &done, MPI_STATUSES_IGNORE);
+  }
+
+  for (long k = 0; k < chunks; ++k) {
+    MPI_Wait(&requests[k], MPI_STATUS_IGNORE);
+    const long b0 = first(k), b1 = first(k + 1);
+    const fcomplex *buffer = recv[k].data();
+#pragma omp parallel for collapse(2) schedule(static)
+    for (int q = 0; q < p; ++q) {
+      for (long b = b0; b < b1; ++b) {
+        for (long i = 0; i < rows; ++i) {
+          const fcomplex *piece =
+              &buffer[((q * (b1 - b0) + b - b0) * rows + i) * width];
+          for (long j = 0; j < width; ++j) {
+            out[place(q, b, i, j)] = piece[j];
+          }
+        }
+      }
+    }
+  }
+}
+
+/// 1-D FFT of R x C values, R x C / p per rank in natural order
+void FFT1D(vector<fcomplex> &x, long R, long C, MPI_Comm comm, bool invert) {
+  int p, rank;
+  MPI_Comm_size(comm, &p);
+  MPI_Comm_rank(comm, &rank);
+  const long N = R * C, r_local = R / p, c_local = C / p;
+  vector<fcomplex> t(x.size());
+  auto nothing = [](long, long) {};
+
+  // [r / p][c] -> [c / p][r]
+  Transpose(x, r_local, 1, C, comm, t, nothing,
+            [&](int q, long b, long, long j) {
+              return j * R + q * r_local + b;
+            });
+  // R-point FFTs over r and twiddles, [c / p][k1] -> [k1 / p][c]
+  auto columns = [&](long b0, long b1) {
+    RowFFTs(t.data(), b0, b1, R, invert);
+    const double start = MPI_Wtime();
+    const double sign = invert ? 1 : -1;
+#pragma omp parallel for schedule(static)
+    for (long b = b0; b < b1; ++b) {
+      const long c = rank * c_local + b;
+      for (long k1 = 0; k1 < R; ++k1) {
+        const double angle = sign * 2 * M_PI * (double)(c * k1 % N) / N;
+        t[b * R + k1] *= fcomplex(cos(angle), sin(angle));
+      }
+    }
+    fft_seconds += MPI_Wtime() - start;
+  };
+  Transpose(t, c_local, 1, R, comm, x, columns,
+            [&](int q, long b, long, long j) {
+              return j * C + q * c_local + b;
+            });
+  // C-point FFTs over c, [k1 / p][k2] -> [k2 / p][k1], index k1 + R k2
+  auto rows = [&](long b0, long b1) {
+    RowFFTs(x.data(), b0, b1, C, invert);
+  };
+  Transpose(x, r_local, 1, C, comm, t, rows,
+            [&](int q, long b, long, long j) {
+              return j * R + q * r_local + b;
+            });
+  x.swap(t);
+}
+
+/// 2-D FFT of N0 x N1 values, N0 / p rows per rank
+void FFT2D(vector<fcomplex> &x, long N0, long N1, MPI_Comm comm, bool invert) {
+  int p;
+  MPI_Comm_size(comm, &p);
+  const long r_local = N0 / p, c_local = N1 / p;
+  vector<fcomplex> t(x.size());
+
+  auto rows = [&](long b0, long b1) {
+    RowFFTs(x.data(), b0, b1, N1, invert);
+  };
+  Transpose(x, r_local, 1, N1, comm, t, rows,
+            [&](int q, long b, long, long j) {
+              return j * N0 + q * r_local + b;
+            });
+  auto columns = [&](long b0, long b1) {
+    RowFFTs(t.data(), b0, b1, N0, invert);
+  };
+  Transpose(t, c_local, 1, N0, comm, x, columns,
+            [&](int q, long b, long, long j) {
+              return j * N1 + q * c_local + b;
+            });
+}
+
+/// P0 x P1 grid with communicators along its rows and columns
+struct Grid {
+  MPI_Comm comm, row, col;
+  int P0, P1, r0, r1;
+
+  explicit Grid(MPI_Comm world) {
+    int size, rank;
+    MPI_Comm_size(world, &size);
+    int dims[2] = {0, 0}, periods[2] = {0, 0};
+    MPI_Dims_create(size, 2, dims);
+    MPI_Cart_create(world, 2, dims, periods, 0, &comm);
+    MPI_Comm_rank(comm, &rank);
+    int coords[2];
+    MPI_Cart_coords(comm, rank, 2, coords);
+    P0 = dims[0];
+    P1 = dims[1];
+    r0 = coords[0];
+    r1 = coords[1];
+    // `row` spans the P1 ranks of grid row r0, `col` the P0 of column r1
+    MPI_Comm_split(comm, r0, r1, &row);
+    MPI_Comm_split(comm, r1, r0, &col);
+  }
+};
+
+/// 3-D FFT of N0 x N1 x N2 values from z pencils [N0 / P0][N1 / P1][N2] to
+/// x pencils [N2 / P1][N1 / P0][N0]
+void FFT3D(vector<fcomplex> &x, long N0, long N1, long N2, const Grid &grid,
+           bool invert) {
+  const long x_local = N0 / grid.P0, y_local = N1 / grid.P1;
+  const long z_out = N2 / grid.P1, y_out = N1 / grid.P0;
+  vector<fcomplex> t(x.size());
+
+  // z FFTs, [x / P0][y / P1][z] -> [z / P1][x / P0][y]
+  auto z = [&](long b0, long b1) {
+    RowFFTs(x.data(), b0 * y_local, b1 * y_local, N2, invert);
+  };
+  Transpose(x, x_local, y_local, N2, grid.row, t, z,
+            [&](int q, long b, long i, long j) {
+              return (j * x_local + b) * N1 + q * y_local + i;
+            });
+  // y FFTs, [z / P1][x / P0][y] -> [z / P1][y / P0][x]
+  auto y = [&](long b0, long b1) {
+    RowFFTs(t.data(), b0 * x_local, b1 * x_local, N1, invert);
+  };
+  Transpose(t, z_out, x_local, N1, grid.col, x, y,
+            [&](int q, long b, long i, long j) {
+              return (b * y_out + j) * N0 + q * x_local + i;
+            });
+  RowFFTs(x.data(), 0, z_out * y_out, N0, invert);
+}
+
+/// exp(2 pi i k n / N), the transform of which is N at k and 0 elsewhere
+fcomplex Wave(long k, long n, long N) {
+  const double angle = 2 * M_PI * (double)(k * n % N) / N;
+  return fcomplex(cos(angle), sin(angle));
+}
+
+/// Largest |x[i] - N delta(i, peak)| / N over all ranks
+double PeakError(const vector<fcomplex> &x, long peak, double N,
+                 MPI_Comm comm) {
+  double error = 0;
+  for (long i = 0; i < (long)x.size(); ++i) {
+    error = max(error, (double)abs(x[i] - fcomplex(i == peak ? N : 0)) / N);
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &error, 1, MPI_DOUBLE, MPI_MAX, comm);
+  return error;
+}
+
+/// Largest |x[i] - y[i]| / max |y| over all ranks
+double Difference(const vector<fcomplex> &x, const vector<fcomplex> &y,
+                  MPI_Comm comm) {
+  double diff = 0, norm = 0;
+  for (long i = 0; i < (long)x.size(); ++i) {
+    diff = max(diff, (double)abs(x[i] - y[i]));
+    norm = max(norm, (double)abs(y[i]));
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &diff, 1, MPI_DOUBLE, MPI_MAX, comm);
+  MPI_Allreduce(MPI_IN_PLACE, &norm, 1, MPI_DOUBLE, MPI_MAX, comm);
+  return diff / norm;
+}
+
+/// Seconds of a single-rank run of the same case in distributed_fft.csv,
+/// 0 if there is none
+double SingleRankSeconds(const string &transform, const string &dims,
+                         int threads) {
+  ifstream file("distributed_fft.csv");
+  string line;
+  double best = 0;
+  while (getline(file, line)) {
+    vector<string> fields;
+    stringstream stream(line);
+    string field;
+    while (getline(stream, field, ',')) {
+      fields.push_back(field);
+    }
+    if (fields.size() >= 6 && fields[0] == transform && fields[1] == dims &&
+        fields[2] == "1" && fields[3] == to_string(threads)) {
+      const double seconds = stod(fields[5]);
+      best = best == 0 ? seconds : min(best, seconds);
+    }
+  }
+  return best;
+}
+
+int main(int argc, char **argv) {
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+  int size, rank;
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+  const string transform = argc > 1 ? argv[1] : "2d";
+  const int count = transform == "1d" ? 1 : transform == "2d" ? 2 : 3;
+  long n[3] = {1, 1, 1};
+  const long defaults[3][3] = {{22}, {2048, 2048}, {128, 128, 128}};
+  for (int d = 0; d < count; ++d) {
+    n[d] = argc > 2 + d ? stol(argv[2 + d]) : defaults[count - 1][d];
+  }
+  const int repeats = argc > 2 + count ? stoi(argv[2 + count]) : 5;
+  if (count == 1) {
+    // six-step split of 2^n[0] into R x C
+    const long log_n = n[0];
+    n[0] = 1L << (log_n / 2);
+    n[1] = 1L << (log_n - log_n / 2);
+  }
+
+  Grid grid(MPI_COMM_WORLD);
+  bool fits = count < 3 ? n[0] % size == 0 && n[1] % size == 0
+                        : n[0] % grid.P0 == 0 && n[1] % grid.P1 == 0 &&
+                              n[2] % grid.P1 == 0 && n[1] % grid.P0 == 0;
+  for (int d = 0; d < 3; ++d) {
+    fits = fits && (n[d] & (n[d] - 1)) == 0;
+  }
+  if (!fits) {
+    if (rank == 0) {
+      printf("sizes must be powers of two, divisible by the %d ranks "
+             "(grid %d x %d for 3d)\n",
+             size, grid.P0, grid.P1);
+    }
+    MPI_Finalize();
+    return 1;
+  }
+  const long N = n[0] * n[1] * n[2], local = N / size;
+
+  // a plane wave of wavenumber k, generated in place: the output must be
+  // N at k and 0 elsewhere, which checks every index of the transposes
+  const long k[3] = {n[0] / 3, n[1] / 5, n[2] / 7};
+  vector<fcomplex> x(local), input(local);
+  long peak = -1;
+  auto generate = [&] {
+    if (count == 1) {
+      const long wavenumber = k[0] + n[0] * k[1];
+#pragma omp parallel for schedule(static)
+      for (long i = 0; i < local; ++i) {
+        input[i] = Wave(wavenumber, rank * local + i, N);
+      }
+      peak = wavenumber / local == rank ? wavenumber % local : -1;
+    } else if (count == 2) {
+      const long rows = n[0] / size;
+#pragma omp parallel for schedule(static)
+      for (long i = 0; i < rows; ++i) {
+        for (long j = 0; j < n[1]; ++j) {
+          input[i * n[1] + j] =
+              Wave(k[0], rank * rows + i, n[0]) * Wave(k[1], j, n[1]);
+        }
+      }
+      peak = k[0] / rows == rank ? (k[0] % rows) * n[1] + k[1] : -1;
+    } else {
+      const long xs = n[0] / grid.P0, ys = n[1] / grid.P1;
+#pragma omp parallel for collapse(2) schedule(static)
+      for (long i = 0; i < xs; ++i) {
+        for (long j = 0; j < ys; ++j) {
+          for (long l = 0; l < n[2]; ++l) {
+            input[(i * ys + j) * n[2] + l] =
+                Wave(k[0], grid.r0 * xs + i, n[0]) *
+                Wave(k[1], grid.r1 * ys + j, n[1]) * Wave(k[2], l, n[2]);
+          }
+        }
+      }
+      // x pencils: [z / P1][y / P0][x]
+      const long zs = n[2] / grid.P1, yo = n[1] / grid.P0;
+      peak = k[2] / zs == grid.r1 && k[1] / yo == grid.r0
+                 ? ((k[2] % zs) * yo + k[1] % yo) * n[0] + k[0]
+                 : -1;
+    }
+  };
+  auto forward = [&](bool invert) {
+    if (count == 1) {
+      FFT1D(x, n[0], n[1], grid.comm, invert);
+    } else if (count == 2) {
+      FFT2D(x, n[0], n[1], grid.comm, invert);
+    } else {
+      FFT3D(x, n[0], n[1], n[2], grid, invert);
+    }
+  };
+  generate();
+
+  // best of the repeats, each the time of the slowest rank
+  double seconds = 1e300, local_fft = 0;
+  for (int r = 0; r < repeats; ++r) {
+    x = input;
+    fft_seconds = 0;
+    MPI_Barrier(grid.comm);
+    const double start = MPI_Wtime();
+    forward(false);
+    double t = MPI_Wtime() - start;
+    MPI_Allreduce(MPI_IN_PLACE, &t, 1, MPI_DOUBLE, MPI_MAX, grid.comm);
+    if (t < seconds) {
+      seconds = t;
+      local_fft = fft_seconds;
+    }
+  }
+  MPI_Allreduce(MPI_IN_PLACE, &local_fft, 1, MPI_DOUBLE, MPI_MAX, grid.comm);
+  const double error = PeakError(x, peak, N, grid.comm);
+  // 1-D and 2-D keep the layout, so the inverse must give the input back
+  double roundtrip = 0;
+  if (count < 3) {
+    forward(true);
+    roundtrip = Difference(x, input, grid.comm);
+  }
+
+  if (rank == 0) {
+    const int threads = omp_get_max_threads();
+    const double gflops = 5.0 * N * log2((double)N) / seconds * 1e-9;
+    string dims = to_string(count == 1 ? N : n[0]);
+    for (int d = 1; d < count; ++d) {
+      dims += "x" + to_string(n[d]);
+    }
+    if (count == 3) {
+      printf("3d FFT %s, pencils on a %d x %d grid, %d threads per rank\n",
+             dims.c_str(), grid.P0, grid.P1, threads);
+    } else {
+      printf("%s FFT %s, %d ranks, %d threads per rank\n", transform.c_str(),
+             dims.c_str(), size, threads);
+    }
+    printf("time %.4f s, %.2f GFLOP/s, local FFTs %.0f%% of the time, "
+           "error %.2e",
+           seconds, gflops, 100 * local_fft / seconds, error);
+    if (count < 3) {
+      printf(", roundtrip %.2e", roundtrip);
+    }
+    printf("\n");
+    const double single = SingleRankSeconds(transform, dims, threads);
+    if (single > 0 && size > 1) {
+      printf("speedup %.2f over 1 rank, efficiency %.1f%%\n", single / seconds,
+             100 * single / seconds / size);
+    }
+
+    // one line per run, to plot against the number of ranks
+    ifstream exists("distributed_fft.csv");
+    const bool header = !exists.good();
+    exists.close();
+    ofstream file("distributed_fft.csv", ios_base::app);
+    if (header) {
+      file << "transform,dims,ranks,threads,grid,seconds,gflops,fft_fraction,"
+              "error\n";
+    }
+    file << transform << "," << dims << "," << size << "," << threads << ","
+         << grid.P0 << "x" << grid.P1 << "," << seconds << "," << gflops
+         << "," << local_fft / seconds << "," << error << "\n";
+  }
+
+  MPI_Finalize();
+  return 0;
+}
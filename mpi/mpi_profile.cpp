@@ -0,0 +1,563 @@
+// PMPI profiling layer: per-rank, per-call counts, bytes, time and time spent
+// blocked, plus the point-to-point communication matrix, reported at
+// MPI_Finalize. No source changes are needed in the profiled program:
+//
+//   mpicxx -O2 -shared -fPIC mpi_profile.cpp -o libmpiprofile.so
+//   mpirun -np 4 -x LD_PRELOAD=./libmpiprofile.so ./cellular_automata
+//
+// or link it in front of the MPI library (mpicxx prog.cpp mpi_profile.cpp).
+//
+// Every wrapped call costs two time stamp counter reads and a few additions
+// (converted to seconds against MPI_Wtime at the end), so the layer can stay
+// on. Environment:
+//   MPI_PROFILE=prefix    output files prefix.csv and prefix_matrix.csv
+//                         (default mpi_profile), summary on stderr of rank 0
+//   MPI_PROFILE_SPLIT=1   split MPI_Recv into waiting for the message
+//                         (MPI_Mprobe) and receiving it, otherwise the whole
+//                         receive counts as blocked
+//
+// "Blocked" is time in calls that wait for other ranks: receives, waits,
+// synchronous and blocking sends, probes and collectives. Non-blocking
+// starts (MPI_Isend, MPI_Irecv, MPI_Ibcast, MPI_Ialltoall) and tests only
+// count as time. Compute time is the wall time between MPI_Init and
+// MPI_Finalize minus the MPI time.
+// The counters are not atomic: with MPI_THREAD_MULTIPLE only one thread
+// should communicate.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+namespace {
+
+enum Call {
+  SEND,
+  SSEND,
+  ISEND,
+  ISSEND,
+  RECV,
+  IRECV,
+  SENDRECV,
+  SENDRECV_REPLACE,
+  PROBE,
+  WAIT,
+  WAITALL,
+  WAITANY,
+  TEST,
+  TESTALL,
+  BARRIER,
+  BCAST,
+  IBCAST,
+  REDUCE,
+  ALLREDUCE,
+  GATHER,
+  GATHERV,
+  SCATTER,
+  ALLGATHER,
+  ALLTOALL,
+  IALLTOALL,
+  CALLS
+};
+
+const char *const NAMES[CALLS] = {
+    "MPI_Send",             "MPI_Ssend",            "MPI_Isend",
+    "MPI_Issend",           "MPI_Recv",             "MPI_Irecv",
+    "MPI_Sendrecv",         "MPI_Sendrecv_replace", "MPI_Probe",
+    "MPI_Wait",             "MPI_Waitall",          "MPI_Waitany",
+    "MPI_Test",             "MPI_Testall",          "MPI_Barrier",
+    "MPI_Bcast",            "MPI_Ibcast",           "MPI_Reduce",
+    "MPI_Allreduce",        "MPI_Gather",           "MPI_Gatherv",
+    "MPI_Scatter",          "MPI_Allgather",        "MPI_Alltoall",
+    "MPI_Ialltoall"};
+
+/// Doubles per call when the statistics are gathered on rank 0
+const int FIELDS = 5;
+
+/// Times are kept in clock ticks
+struct CallStats {
+  double count = 0, bytes = 0, time = 0, blocked = 0, max = 0;
+};
+
+struct Profile {
+  CallStats calls[CALLS];
+  std::vector<double> messages_to, bytes_to;
+  double init_time = 0, init_ticks = 0;
+  int rank = 0, size = 1;
+  bool split_recv = false;
+  /// Attribute holding the WorldRanks of a communicator
+  int world_ranks_key = MPI_KEYVAL_INVALID;
+} profile;
+
+/// Time stamp counter where there is one, a few ns against tens for
+/// MPI_Wtime; seconds per tick are measured between MPI_Init and MPI_Finalize
+double Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+  return (double)__rdtsc();
+#else
+  return PMPI_Wtime();
+#endif
+}
+
+/// Cached size of the last datatype seen, sends and receives mostly repeat
+long Bytes(int count, MPI_Datatype type) {
+  static MPI_Datatype last = MPI_DATATYPE_NULL;
+  static int last_size = 0;
+  if (type != last) {
+    last_size = 0;
+    if (type != MPI_DATATYPE_NULL) {
+      PMPI_Type_size(type, &last_size);
+    }
+    last = type;
+  }
+  return (long)count * last_size;
+}
+
+void Record(Call call, double start, long bytes, bool blocking) {
+  const double time = Ticks() - start;
+  CallStats &stats = profile.calls[call];
+  stats.count += 1;
+  stats.bytes += bytes;
+  stats.time += time;
+  stats.max = std::max(stats.max, time);
+  if (blocking) {
+    stats.blocked += time;
+  }
+}
+
+int FreeWorldRanks(MPI_Comm, int, void *ranks, void *) {
+  delete static_cast<std::vector<int> *>(ranks);
+  return MPI_SUCCESS;
+}
+
+/// MPI_COMM_WORLD rank of every destination rank of comm (the remote group
+/// of an intercommunicator), translated on the first send and cached on the
+/// communicator, so it goes away with it
+const std::vector<int> &WorldRanks(MPI_Comm comm) {
+  void *cached = nullptr;
+  int found = 0;
+  PMPI_Comm_get_attr(comm, profile.world_ranks_key, &cached, &found);
+  if (found) {
+    return *static_cast<std::vector<int> *>(cached);
+  }
+  int inter = 0;
+  PMPI_Comm_test_inter(comm, &inter);
+  MPI_Group group, world_group;
+  if (inter) {
+    PMPI_Comm_remote_group(comm, &group);
+  } else {
+    PMPI_Comm_group(comm, &group);
+  }
+  PMPI_Comm_group(MPI_COMM_WORLD, &world_group);
+  int size = 0;
+  PMPI_Group_size(group, &size);
+  std::vector<int> ranks(size);
+  for (int r = 0; r < size; ++r) {
+    ranks[r] = r;
+  }
+  auto *world = new std::vector<int>(size);
+  PMPI_Group_translate_ranks(group, size, ranks.data(), world_group,
+                             world->data());
+  PMPI_Group_free(&group);
+  PMPI_Group_free(&world_group);
+  PMPI_Comm_set_attr(comm, profile.world_ranks_key, world);
+  return *world;
+}
+
+/// Point-to-point send to dest of comm, counted in MPI_COMM_WORLD ranks
+void Sent(int dest, MPI_Comm comm, long bytes) {
+  if (dest == MPI_PROC_NULL || profile.messages_to.empty()) {
+    return;
+  }
+  int world = dest;
+  if (comm != MPI_COMM_WORLD) {
+    const std::vector<int> &ranks = WorldRanks(comm);
+    world = dest >= 0 && dest < (int)ranks.size() ? ranks[dest] : -1;
+  }
+  if (world >= 0 && world < profile.size) {
+    profile.messages_to[world] += 1;
+    profile.bytes_to[world] += bytes;
+  }
+}
+
+void Start() {
+  PMPI_Comm_rank(MPI_COMM_WORLD, &profile.rank);
+  PMPI_Comm_size(MPI_COMM_WORLD, &profile.size);
+  profile.messages_to.assign(profile.size, 0);
+  profile.bytes_to.assign(profile.size, 0);
+  const char *split = std::getenv("MPI_PROFILE_SPLIT");
+  profile.split_recv = split != nullptr && std::atoi(split) != 0;
+  PMPI_Comm_create_keyval(MPI_COMM_NULL_COPY_FN, FreeWorldRanks,
+                          &profile.world_ranks_key, nullptr);
+  profile.init_time = PMPI_Wtime();
+  profile.init_ticks = Ticks();
+}
+
+/// Gather everything on rank 0, print the summary and write the CSV files
+void Report() {
+  const double wall = PMPI_Wtime() - profile.init_time;
+  const double ticks = Ticks() - profile.init_ticks;
+  const double seconds = ticks > 0 ? wall / ticks : 0;
+  const int size = profile.size;
+  const int row = CALLS * FIELDS + 1;
+
+  std::vector<double> mine(row), all(profile.rank == 0 ? (long)row * size : 0);
+  for (int c = 0; c < CALLS; ++c) {
+    const CallStats &s = profile.calls[c];
+    double *f = &mine[c * FIELDS];
+    f[0] = s.count;
+    f[1] = s.bytes;
+    f[2] = s.time * seconds;
+    f[3] = s.blocked * seconds;
+    f[4] = s.max * seconds;
+  }
+  mine[row - 1] = wall;
+  PMPI_Gather(mine.data(), row, MPI_DOUBLE, all.data(), row, MPI_DOUBLE, 0,
+              MPI_COMM_WORLD);
+
+  std::vector<double> messages(profile.rank == 0 ? (long)size * size : 0);
+  std::vector<double> bytes(messages.size());
+  PMPI_Gather(profile.messages_to.data(), size, MPI_DOUBLE, messages.data(),
+              size, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  PMPI_Gather(profile.bytes_to.data(), size, MPI_DOUBLE, bytes.data(), size,
+              MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  if (profile.rank != 0) {
+    return;
+  }
+
+  const char *env = std::getenv("MPI_PROFILE");
+  const std::string prefix = env != nullptr ? env : "mpi_profile";
+
+  FILE *csv = std::fopen((prefix + ".csv").c_str(), "w");
+  if (csv != nullptr) {
+    std::fprintf(csv, "rank,call,count,bytes,time_s,blocked_s,max_call_s\n");
+  }
+  double max_wall = 0, mpi_time = 0, blocked_time = 0;
+  for (int r = 0; r < size; ++r) {
+    const double *f = &all[(long)r * row];
+    const double rank_wall = f[row - 1];
+    double rank_mpi = 0;
+    for (int c = 0; c < CALLS; ++c) {
+      const double *s = f + c * FIELDS;
+      rank_mpi += s[2];
+      blocked_time += s[3];
+      if (csv != nullptr && s[0] > 0) {
+        std::fprintf(csv, "%d,%s,%.0f,%.0f,%.9f,%.9f,%.9f\n", r, NAMES[c],
+                     s[0], s[1], s[2], s[3], s[4]);
+      }
+    }
+    if (csv != nullptr) {
+      std::fprintf(csv, "%d,wall,1,0,%.9f,0,%.9f\n", r, rank_wall, rank_wall);
+      std::fprintf(csv, "%d,compute,1,0,%.9f,0,0\n", r, rank_wall - rank_mpi);
+    }
+    max_wall = std::max(max_wall, rank_wall);
+    mpi_time += rank_mpi;
+  }
+  if (csv != nullptr) {
+    std::fclose(csv);
+  }
+
+  FILE *matrix = std::fopen((prefix + "_matrix.csv").c_str(), "w");
+  if (matrix != nullptr) {
+    std::fprintf(matrix, "source,dest,messages,bytes\n");
+    for (int s = 0; s < size; ++s) {
+      for (int d = 0; d < size; ++d) {
+        if (messages[(long)s * size + d] > 0) {
+          std::fprintf(matrix, "%d,%d,%.0f,%.0f\n", s, d,
+                       messages[(long)s * size + d], bytes[(long)s * size + d]);
+        }
+      }
+    }
+    std::fclose(matrix);
+  }
+
+  const double rank_seconds = std::max(1e-300, max_wall * size);
+  std::fprintf(stderr,
+               "MPI profile: %d ranks, %.6f s wall, %.1f %% in MPI, %.1f %% "
+               "blocked (of rank-seconds)\n",
+               size, max_wall, 100 * mpi_time / rank_seconds,
+               100 * blocked_time / rank_seconds);
+  std::fprintf(stderr, "%-20s %12s %14s %12s %12s %12s\n", "call", "calls",
+               "bytes", "time, s", "blocked, s", "max call, s");
+  for (int c = 0; c < CALLS; ++c) {
+    double total[FIELDS] = {0};
+    for (int r = 0; r < size; ++r) {
+      const double *s = &all[(long)r * row + c * FIELDS];
+      for (int k = 0; k < 4; ++k) {
+        total[k] += s[k];
+      }
+      total[4] = std::max(total[4], s[4]);
+    }
+    if (total[0] > 0) {
+      std::fprintf(stderr, "%-20s %12.0f %14.0f %12.6f %12.6f %12.6f\n",
+                   NAMES[c], total[0], total[1], total[2], total[3],
+                   total[4]);
+    }
+  }
+  std::fprintf(stderr, "per rank: %s.csv, communication matrix: %s_matrix.csv\n",
+               prefix.c_str(), prefix.c_str());
+}
+
+} // namespace
+
+int MPI_Init(int *argc, char ***argv) {
+  int result = PMPI_Init(argc, argv);
+  Start();
+  return result;
+}
+
+int MPI_Init_thread(int *argc, char ***argv, int required, int *provided) {
+  int result = PMPI_Init_thread(argc, argv, required, provided);
+  Start();
+  return result;
+}
+
+int MPI_Finalize() {
+  Report();
+  return PMPI_Finalize();
+}
+
+int MPI_Send(const void *buf, int count, MPI_Datatype type, int dest, int tag,
+             MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Send(buf, count, type, dest, tag, comm);
+  const long bytes = Bytes(count, type);
+  Record(SEND, start, bytes, true);
+  Sent(dest, comm, bytes);
+  return result;
+}
+
+int MPI_Ssend(const void *buf, int count, MPI_Datatype type, int dest, int tag,
+              MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Ssend(buf, count, type, dest, tag, comm);
+  const long bytes = Bytes(count, type);
+  Record(SSEND, start, bytes, true);
+  Sent(dest, comm, bytes);
+  return result;
+}
+
+int MPI_Isend(const void *buf, int count, MPI_Datatype type, int dest,
+              int tag, MPI_Comm comm, MPI_Request *request) {
+  const double start = Ticks();
+  int result = PMPI_Isend(buf, count, type, dest, tag, comm, request);
+  const long bytes = Bytes(count, type);
+  Record(ISEND, start, bytes, false);
+  Sent(dest, comm, bytes);
+  return result;
+}
+
+int MPI_Issend(const void *buf, int count, MPI_Datatype type, int dest,
+               int tag, MPI_Comm comm, MPI_Request *request) {
+  const double start = Ticks();
+  int result = PMPI_Issend(buf, count, type, dest, tag, comm, request);
+  const long bytes = Bytes(count, type);
+  Record(ISSEND, start, bytes, false);
+  Sent(dest, comm, bytes);
+  return result;
+}
+
+int MPI_Recv(void *buf, int count, MPI_Datatype type, int source, int tag,
+             MPI_Comm comm, MPI_Status *status) {
+  MPI_Status local;
+  MPI_Status *st = status == MPI_STATUS_IGNORE ? &local : status;
+  const double start = Ticks();
+  int result;
+  if (profile.split_recv) {
+    // the wait for the sender is the probe, the rest is the copy
+    MPI_Message message;
+    PMPI_Mprobe(source, tag, comm, &message, st);
+    const double arrived = Ticks();
+    profile.calls[RECV].blocked += arrived - start;
+    result = PMPI_Mrecv(buf, count, type, &message, st);
+  } else {
+    result = PMPI_Recv(buf, count, type, source, tag, comm, st);
+  }
+  int received = 0;
+  PMPI_Get_count(st, type, &received);
+  Record(RECV, start, Bytes(received, type), !profile.split_recv);
+  return result;
+}
+
+int MPI_Irecv(void *buf, int count, MPI_Datatype type, int source, int tag,
+              MPI_Comm comm, MPI_Request *request) {
+  const double start = Ticks();
+  int result = PMPI_Irecv(buf, count, type, source, tag, comm, request);
+  Record(IRECV, start, Bytes(count, type), false);
+  return result;
+}
+
+int MPI_Sendrecv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 int dest, int sendtag, void *recvbuf, int recvcount,
+                 MPI_Datatype recvtype, int source, int recvtag, MPI_Comm comm,
+                 MPI_Status *status) {
+  const double start = Ticks();
+  int result = PMPI_Sendrecv(sendbuf, sendcount, sendtype, dest, sendtag,
+                             recvbuf, recvcount, recvtype, source, recvtag,
+                             comm, status);
+  const long bytes = Bytes(sendcount, sendtype);
+  Record(SENDRECV, start, bytes + Bytes(recvcount, recvtype), true);
+  Sent(dest, comm, bytes);
+  return result;
+}
+
+int MPI_Sendrecv_replace(void *buf, int count, MPI_Datatype type, int dest,
+                         int sendtag, int source, int recvtag, MPI_Comm comm,
+                         MPI_Status *status) {
+  const double start = Ticks();
+  int result = PMPI_Sendrecv_replace(buf, count, type, dest, sendtag, source,
+                                     recvtag, comm, status);
+  const long bytes = Bytes(count, type);
+  Record(SENDRECV_REPLACE, start, 2 * bytes, true);
+  Sent(dest, comm, bytes);
+  return result;
+}
+
+int MPI_Probe(int source, int tag, MPI_Comm comm, MPI_Status *status) {
+  const double start = Ticks();
+  int result = PMPI_Probe(source, tag, comm, status);
+  Record(PROBE, start, 0, true);
+  return result;
+}
+
+int MPI_Wait(MPI_Request *request, MPI_Status *status) {
+  const double start = Ticks();
+  int result = PMPI_Wait(request, status);
+  Record(WAIT, start, 0, true);
+  return result;
+}
+
+int MPI_Waitall(int count, MPI_Request requests[], MPI_Status statuses[]) {
+  const double start = Ticks();
+  int result = PMPI_Waitall(count, requests, statuses);
+  Record(WAITALL, start, 0, true);
+  return result;
+}
+
+int MPI_Waitany(int count, MPI_Request requests[], int *index,
+                MPI_Status *status) {
+  const double start = Ticks();
+  int result = PMPI_Waitany(count, requests, index, status);
+  Record(WAITANY, start, 0, true);
+  return result;
+}
+
+int MPI_Test(MPI_Request *request, int *flag, MPI_Status *status) {
+  const double start = Ticks();
+  int result = PMPI_Test(request, flag, status);
+  Record(TEST, start, 0, false);
+  return result;
+}
+
+int MPI_Testall(int count, MPI_Request requests[], int *flag,
+                MPI_Status statuses[]) {
+  const double start = Ticks();
+  int result = PMPI_Testall(count, requests, flag, statuses);
+  Record(TESTALL, start, 0, false);
+  return result;
+}
+
+int MPI_Barrier(MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Barrier(comm);
+  Record(BARRIER, start, 0, true);
+  return result;
+}
+
+int MPI_Bcast(void *buf, int count, MPI_Datatype type, int root,
+              MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Bcast(buf, count, type, root, comm);
+  Record(BCAST, start, Bytes(count, type), true);
+  return result;
+}
+
+int MPI_Ibcast(void *buf, int count, MPI_Datatype type, int root,
+               MPI_Comm comm, MPI_Request *request) {
+  const double start = Ticks();
+  int result = PMPI_Ibcast(buf, count, type, root, comm, request);
+  Record(IBCAST, start, Bytes(count, type), false);
+  return result;
+}
+
+int MPI_Reduce(const void *sendbuf, void *recvbuf, int count,
+               MPI_Datatype type, MPI_Op op, int root, MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Reduce(sendbuf, recvbuf, count, type, op, root, comm);
+  Record(REDUCE, start, Bytes(count, type), true);
+  return result;
+}
+
+int MPI_Allreduce(const void *sendbuf, void *recvbuf, int count,
+                  MPI_Datatype type, MPI_Op op, MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Allreduce(sendbuf, recvbuf, count, type, op, comm);
+  Record(ALLREDUCE, start, Bytes(count, type), true);
+  return result;
+}
+
+int MPI_Gather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+               void *recvbuf, int recvcount, MPI_Datatype recvtype, int root,
+               MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Gather(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+                           recvtype, root, comm);
+  Record(GATHER, start, Bytes(sendcount, sendtype), true);
+  return result;
+}
+
+int MPI_Gatherv(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                void *recvbuf, const int recvcounts[], const int displs[],
+                MPI_Datatype recvtype, int root, MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Gatherv(sendbuf, sendcount, sendtype, recvbuf, recvcounts,
+                            displs, recvtype, root, comm);
+  Record(GATHERV, start, Bytes(sendcount, sendtype), true);
+  return result;
+}
+
+int MPI_Scatter(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                void *recvbuf, int recvcount, MPI_Datatype recvtype, int root,
+                MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Scatter(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+                            recvtype, root, comm);
+  Record(SCATTER, start, Bytes(recvcount, recvtype), true);
+  return result;
+}
+
+int MPI_Allgather(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                  MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Allgather(sendbuf, sendcount, sendtype, recvbuf,
+                              recvcount, recvtype, comm);
+  Record(ALLGATHER, start, Bytes(sendcount, sendtype), true);
+  return result;
+}
+
+int MPI_Alltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                 void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                 MPI_Comm comm) {
+  const double start = Ticks();
+  int result = PMPI_Alltoall(sendbuf, sendcount, sendtype, recvbuf, recvcount,
+                             recvtype, comm);
+  Record(ALLTOALL, start, Bytes(sendcount, sendtype), true);
+  return result;
+}
+
+int MPI_Ialltoall(const void *sendbuf, int sendcount, MPI_Datatype sendtype,
+                  void *recvbuf, int recvcount, MPI_Datatype recvtype,
+                  MPI_Comm comm, MPI_Request *request) {
+  const double start = Ticks();
+  int result = PMPI_Ialltoall(sendbuf, sendcount, sendtype, recvbuf,
+                              recvcount, recvtype, comm, request);
+  Record(IALLTOALL, start, Bytes(sendcount, sendtype), false);
+  return result;
+}
@@ -0,0 +1,353 @@
+// Distributed matrix multiplication C = A * B on a 2-D grid of processes.
+// Usage: mpirun -np p summa [N] [block] [summa|cannon]
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+#include <omp.h>
+
+using std::vector;
+
+// Matrices are distributed block-cyclically (as in ScaLAPACK): block (I, J)
+// of nb x nb elements lives on process (I mod P, J mod Q) of the P x Q grid,
+// which keeps the work balanced whatever the matrix size. Every process only
+// ever holds its local blocks, generated in place, plus two panels, so N is
+// limited by the memory of all nodes together, not of one.
+//
+// SUMMA: for every block column k of A and block row k of B, the owners
+// broadcast them along process rows and columns and every process adds the
+// product of the two panels to its C. The broadcast of panel k + 1 is
+// started before multiplying panel k, and the local multiply tests the
+// requests between row chunks so they progress meanwhile.
+//
+// Cannon (P = Q, N a multiple of nb * P): after skewing, every process
+// multiplies its local A and B, then passes A left and B up; the next
+// blocks are received while the current ones are multiplied.
+//
+// The local multiply is an OpenMP kernel; one rank per node or socket with
+// OMP_NUM_THREADS cores each is the intended layout.
+
+/// Rows of C per progress check of the local multiply
+static const long GEMM_CHUNK = 64;
+/// Columns of C and B kept in cache by the local multiply
+static const long GEMM_COLS = 512;
+
+/// P x Q Cartesian grid with communicators along its rows and columns
+struct Grid {
+  MPI_Comm comm, row, col;
+  int P, Q, r, c, rank;
+
+  Grid() {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    int dims[2] = {0, 0}, periods[2] = {1, 1};
+    MPI_Dims_create(size, 2, dims);
+    MPI_Cart_create(MPI_COMM_WORLD, 2, dims, periods, 0, &comm);
+    MPI_Comm_rank(comm, &rank);
+    int coords[2];
+    MPI_Cart_coords(comm, rank, 2, coords);
+    P = dims[0];
+    Q = dims[1];
+    r = coords[0];
+    c = coords[1];
+    // rank in `row` is the grid column and in `col` the grid row
+    MPI_Comm_split(comm, r, c, &row);
+    MPI_Comm_split(comm, c, r, &col);
+  }
+
+  int Rank(int r, int c) const {
+    int coords[2] = {(r % P + P) % P, (c % Q + Q) % Q}, rank;
+    MPI_Cart_rank(comm, coords, &rank);
+    return rank;
+  }
+};
+
+/// Elements of an n-long dimension owned by process p of `procs` when cut
+/// into blocks of nb, dealt round-robin
+long LocalSize(long n, long nb, int p, int procs) {
+  const long blocks = n / nb;
+  long local = blocks / procs * nb;
+  const long extra = blocks % procs;
+  if (p < extra) {
+    local += nb;
+  } else if (p == extra) {
+    local += n % nb;
+  }
+  return local;
+}
+
+/// Global index of local index l on process p
+long GlobalIndex(long l, long nb, int p, int procs) {
+  return (l / nb * procs + p) * nb + l % nb;
+}
+
+/// Uniform in [-1, 1), a function of (seed, i, j) only: splitmix64
+double Entry(uint64_t seed, long i, long j) {
+  uint64_t z = seed + 0x9E3779B97F4A7C15ull * ((uint64_t)i * 0x100000001B3ull + j + 1);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  z ^= z >> 31;
+  return (z >> 11) * (2.0 / 9007199254740992.0) - 1;
+}
+
+/// Local part of an N x N block-cyclic matrix, row-major
+struct DistMatrix {
+  long N, nb, rows, cols;
+  int r, c, P, Q;
+  vector<double> data;
+
+  DistMatrix(const Grid &grid, long N, long nb)
+      : N(N), nb(nb), rows(LocalSize(N, nb, grid.r, grid.P)),
+        cols(LocalSize(N, nb, grid.c, grid.Q)), r(grid.r), c(grid.c),
+        P(grid.P), Q(grid.Q), data(rows * cols) {}
+
+  long Row(long li) const { return GlobalIndex(li, nb, r, P); }
+  long Col(long lj) const { return GlobalIndex(lj, nb, c, Q); }
+
+  void Generate(uint64_t seed) {
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < rows; ++i) {
+      for (long j = 0; j < cols; ++j) {
+        data[i * cols + j] = Entry(seed, Row(i), Col(j));
+      }
+    }
+  }
+
+  /// M x for a vector x known everywhere, the result known everywhere
+  vector<double> Apply(const vector<double> &x, MPI_Comm comm) const {
+    vector<double> y(N, 0.0);
+    for (long i = 0; i < rows; ++i) {
+      double sum = 0;
+      for (long j = 0; j < cols; ++j) {
+        sum += data[i * cols + j] * x[Col(j)];
+      }
+      y[Row(i)] = sum;
+    }
+    MPI_Allreduce(MPI_IN_PLACE, y.data(), N, MPI_DOUBLE, MPI_SUM, comm);
+    return y;
+  }
+};
+
+/// C += A * B (m x k by k x n, row-major with leading dimensions), in
+/// chunks of rows; progress() is called between chunks
+template <typename Progress>
+void LocalGemm(long m, long n, long k, const double *A, long lda,
+               const double *B, long ldb, double *C, long ldc,
+               Progress progress) {
+  for (long i0 = 0; i0 < m; i0 += GEMM_CHUNK) {
+    const long i1 = std::min(m, i0 + GEMM_CHUNK);
+#pragma omp parallel for collapse(2) schedule(static)
+    for (long j0 = 0; j0 < n; j0 += GEMM_COLS) {
+      for (long i = i0; i < i1; ++i) {
+        const long j1 = std::min(n, j0 + GEMM_COLS);
+        double *c = C + i * ldc;
+        for (long l = 0; l < k; ++l) {
+          const double a = A[i * lda + l];
+          const double *b = B + l * ldb;
+#pragma omp simd
+          for (long j = j0; j < j1; ++j) {
+            c[j] += a * b[j];
+          }
+        }
+      }
+    }
+    progress();
+  }
+}
+
+/// Time spent in the local multiply and its flops, per process
+struct Compute {
+  double seconds = 0, flops = 0;
+};
+
+template <typename Progress>
+void TimedGemm(Compute &compute, long m, long n, long k, const double *A,
+               long lda, const double *B, long ldb, double *C, long ldc,
+               Progress progress) {
+  const double start = omp_get_wtime();
+  LocalGemm(m, n, k, A, lda, B, ldb, C, ldc, progress);
+  compute.seconds += omp_get_wtime() - start;
+  compute.flops += 2.0 * m * n * k;
+}
+
+Compute Summa(const Grid &grid, const DistMatrix &A, const DistMatrix &B,
+              DistMatrix &C) {
+  const long N = A.N, nb = A.nb, panels = (N + nb - 1) / nb;
+  // A panel: local rows x nb, B panel: nb x local columns
+  vector<double> a_panel[2] = {vector<double>(A.rows * nb),
+                               vector<double>(A.rows * nb)};
+  vector<double> b_panel[2] = {vector<double>(nb * B.cols),
+                               vector<double>(nb * B.cols)};
+  MPI_Request requests[2][2];
+
+  auto post = [&](long k) {
+    const long width = std::min(nb, N - k * nb);
+    const int a_owner = k % grid.Q, b_owner = k % grid.P;
+    double *a = a_panel[k % 2].data(), *b = b_panel[k % 2].data();
+    if (grid.c == a_owner) {
+      const long offset = k / grid.Q * nb;
+      for (long i = 0; i < A.rows; ++i) {
+        std::copy_n(&A.data[i * A.cols + offset], width, a + i * width);
+      }
+    }
+    if (grid.r == b_owner) {
+      const long offset = k / grid.P * nb;
+      std::copy_n(&B.data[offset * B.cols], width * B.cols, b);
+    }
+    MPI_Ibcast(a, A.rows * width, MPI_DOUBLE, a_owner, grid.row,
+               &requests[k % 2][0]);
+    MPI_Ibcast(b, width * B.cols, MPI_DOUBLE, b_owner, grid.col,
+               &requests[k % 2][1]);
+  };
+
+  Compute compute;
+  post(0);
+  for (long k = 0; k < panels; ++k) {
+    if (k + 1 < panels) {
+      post(k + 1);
+    }
+    MPI_Waitall(2, requests[k % 2], MPI_STATUSES_IGNORE);
+    const long width = std::min(nb, N - k * nb);
+    auto progress = [&] {
+      if (k + 1 < panels) {
+        int done;
+        MPI_Testall(2, requests[(k + 1) % 2], &done, MPI_STATUSES_IGNORE);
+      }
+    };
+    TimedGemm(compute, C.rows, C.cols, width, a_panel[k % 2].data(), width,
+              b_panel[k % 2].data(), B.cols, C.data.data(), C.cols, progress);
+  }
+  return compute;
+}
+
+/// A and B are left shifted (skewed), regenerate them to use them again
+Compute Cannon(const Grid &grid, DistMatrix &A, DistMatrix &B, DistMatrix &C) {
+  const int P = grid.P, r = grid.r, c = grid.c;
+  const long n = A.data.size();
+  // skew: process (r, c) gets A from (r, c + r) and B from (r + c, c)
+  MPI_Sendrecv_replace(A.data.data(), n, MPI_DOUBLE, grid.Rank(r, c - r), 0,
+                       grid.Rank(r, c + r), 0, grid.comm, MPI_STATUS_IGNORE);
+  MPI_Sendrecv_replace(B.data.data(), n, MPI_DOUBLE, grid.Rank(r - c, c), 1,
+                       grid.Rank(r + c, c), 1, grid.comm, MPI_STATUS_IGNORE);
+
+  vector<double> a_next(n), b_next(n);
+  Compute compute;
+  for (int s = 0; s < P; ++s) {
+    MPI_Request requests[4];
+    int pending = 0;
+    if (s + 1 < P) {
+      MPI_Irecv(a_next.data(), n, MPI_DOUBLE, grid.Rank(r, c + 1), 2,
+                grid.comm, &requests[pending++]);
+      MPI_Irecv(b_next.data(), n, MPI_DOUBLE, grid.Rank(r + 1, c), 3,
+                grid.comm, &requests[pending++]);
+      MPI_Isend(A.data.data(), n, MPI_DOUBLE, grid.Rank(r, c - 1), 2,
+                grid.comm, &requests[pending++]);
+      MPI_Isend(B.data.data(), n, MPI_DOUBLE, grid.Rank(r - 1, c), 3,
+                grid.comm, &requests[pending++]);
+    }
+    auto progress = [&] {
+      int done;
+      MPI_Testall(pending, requests, &done, MPI_STATUSES_IGNORE);
+    };
+    TimedGemm(compute, C.rows, C.cols, A.cols, A.data.data(), A.cols,
+              B.data.data(), B.cols, C.data.data(), C.cols, progress);
+    MPI_Waitall(pending, requests, MPI_STATUSES_IGNORE);
+    if (s + 1 < P) {
+      A.data.swap(a_next);
+      B.data.swap(b_next);
+    }
+  }
+  return compute;
+}
+
+/// |A (B x) - C x| / |A (B x)| for a random x: checks C = A B in O(N^2 / p)
+double Residual(const Grid &grid, const DistMatrix &A, const DistMatrix &B,
+                const DistMatrix &C) {
+  vector<double> x(A.N);
+  for (long i = 0; i < A.N; ++i) {
+    x[i] = Entry(3, i, 0);
+  }
+  vector<double> abx = A.Apply(B.Apply(x, grid.comm), grid.comm);
+  vector<double> cx = C.Apply(x, grid.comm);
+  double diff = 0, norm = 0;
+  for (long i = 0; i < A.N; ++i) {
+    diff += (abx[i] - cx[i]) * (abx[i] - cx[i]);
+    norm += abx[i] * abx[i];
+  }
+  return std::sqrt(diff / norm);
+}
+
+int main(int argc, char **argv) {
+  int provided;
+  MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided);
+
+  const long N = argc > 1 ? std::stol(argv[1]) : 4096;
+  const long nb = argc > 2 ? std::stol(argv[2]) : 128;
+  std::string algorithm = argc > 3 ? argv[3] : "summa";
+
+  Grid grid;
+  if (algorithm == "cannon" && (grid.P != grid.Q || N % (nb * grid.P) != 0)) {
+    if (grid.rank == 0) {
+      printf("Cannon needs a square grid and N divisible by block * %d, "
+             "running SUMMA\n",
+             grid.P);
+    }
+    algorithm = "summa";
+  }
+
+  DistMatrix A(grid, N, nb), B(grid, N, nb), C(grid, N, nb);
+  A.Generate(1);
+  B.Generate(2);
+
+  MPI_Barrier(grid.comm);
+  const double start = MPI_Wtime();
+  Compute compute = algorithm == "cannon" ? Cannon(grid, A, B, C)
+                                          : Summa(grid, A, B, C);
+  double seconds = MPI_Wtime() - start;
+  MPI_Allreduce(MPI_IN_PLACE, &seconds, 1, MPI_DOUBLE, MPI_MAX, grid.comm);
+
+  // efficiency against the local kernel: what p ranks would reach if they
+  // never waited for data
+  double kernel_gflops = compute.flops / compute.seconds * 1e-9;
+  MPI_Allreduce(MPI_IN_PLACE, &kernel_gflops, 1, MPI_DOUBLE, MPI_SUM,
+                grid.comm);
+
+  A.Generate(1);
+  B.Generate(2);
+  const double residual = Residual(grid, A, B, C);
+
+  if (grid.rank == 0) {
+    const int size = grid.P * grid.Q;
+    const int threads = omp_get_max_threads();
+    const double gflops = 2.0 * N * N * N / seconds * 1e-9;
+    printf("%s N = %ld, block %ld, grid %d x %d, %d threads per rank\n",
+           algorithm.c_str(), N, nb, grid.P, grid.Q, threads);
+    printf("time %.3f s, %.2f GFLOP/s, %.2f GFLOP/s per rank, local kernel "
+           "%.2f GFLOP/s per rank, efficiency %.1f%%, residual %.2e\n",
+           seconds, gflops, gflops / size, kernel_gflops / size,
+           100 * gflops / kernel_gflops, residual);
+
+    // one line per run, to plot against the number of ranks
+    std::ifstream exists("summa.csv");
+    const bool header = !exists.good();
+    exists.close();
+    std::ofstream file("summa.csv", std::ios_base::app);
+    if (header) {
+      file << "algorithm,N,block,P,Q,threads,seconds,gflops,kernel_gflops,"
+              "efficiency,residual\n";
+    }
+    file << algorithm << "," << N << "," << nb << "," << grid.P << ","
+         << grid.Q << "," << threads << "," << seconds << "," << gflops << ","
+         << kernel_gflops << "," << gflops / kernel_gflops << "," << residual
+         << "\n";
+  }
+
+  MPI_Finalize();
+  return 0;
+}
@@ -1,4 +1,6 @@
 // Gauss-Seidel method
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <cmath>
@@ -8,29 +10,44 @@
 #include <omp.h>
 #include <random>
 #include <thread>
+#include <utility>
+
+#include "numa_alloc.h"
+#include "perf_region.h"
+#include "reduce.h"
+#include "thread_pool.hpp"
+#include "trace.hpp"
 
 using std::cin, std::cout, std::endl;
 
 static const auto THREADS = std::thread::hardware_concurrency();
 
+/// Rows of A per block of a sweep, and of the initialization
+static const long SWEEP_ROWS = 64;
+
+/// Blocks [first, last) of thread t of the pool: a fixed contiguous share,
+/// the same in FillData and in every sweep
+static std::pair<long, long> ThreadBlocks(long blocks, int t) {
+  const long threads = ThreadPool::Global().Size();
+  return {blocks * t / threads, blocks * (t + 1) / threads};
+}
+
 bool is_diagonally_dominant(double *matrix, size_t N) {
-  int i, j;
-  double sum;
-  bool flag = 1;
-
-#pragma omp parallel for num_threads(THREADS)
-  for (i = 0; i < N; i++) {
-    sum = 0;
-#pragma omp parallel for reduction(+ : sum) shared(flag)
-    for (j = 0; j < N; j++) {
-      if (!flag)
-        continue;
-      sum += abs(matrix[i * N + j]);
+  // one level of parallelism over the rows, the row sums stay private
+  std::atomic<bool> flag{true};
+
+  ThreadPool::Global().ParallelFor(0, N, [&](long i) {
+    if (!flag.load(std::memory_order_relaxed)) {
+      return;
+    }
+    double sum = 0;
+    for (size_t j = 0; j < N; j++) {
+      sum += std::abs(matrix[i * N + j]);
     }
-    if (sum >= 2 * abs(matrix[i * N + i])) {
-      flag = 0;
+    if (sum >= 2 * std::abs(matrix[i * N + i])) {
+      flag = false;
     }
-  }
+  });
 
   return flag;
 }
@@ -49,27 +66,34 @@ void PrintData(double *A, double *b, size_t N) {
   cout << endl;
 }
 
+/// A and b are generated by the pool threads, each on the blocks of rows it
+/// updates in the sweeps (ThreadBlocks), so those rows were first touched
+/// (placed in memory) by the thread that reads them. Every row has its own
+/// generator, the data does not depend on which thread fills it.
 void FillData(double *A, double *b, double *true_x, double &eps, size_t N) {
-  std::mt19937 gen;
   std::random_device rand_device;
-  gen.seed(rand_device());
-  std::uniform_real_distribution<double> dist(-50.0, 50.0);
+  const unsigned seed = rand_device();
   for (int i = 0; i < N; ++i) {
     true_x[i] = i; // easy to check
   }
-  for (int i = 0; i < N; ++i) {
-    double sum = 0;
-    for (int j = 0; j < N; ++j) {
-      A[i * N + j] = dist(gen);
-      sum += 2 * abs(A[i * N + j]); // for more probable convergence
+  const long blocks = (N + SWEEP_ROWS - 1) / SWEEP_ROWS;
+  ThreadPool::Global().ForEachThread([&](int t) {
+    const auto range = ThreadBlocks(blocks, t);
+    const size_t end = std::min<size_t>(N, range.second * SWEEP_ROWS);
+    for (size_t i = range.first * SWEEP_ROWS; i < end; ++i) {
+      std::mt19937 gen(seed + i);
+      std::uniform_real_distribution<double> dist(-50.0, 50.0);
+      double sum = 0;
+      for (size_t j = 0; j < N; ++j) {
+        A[i * N + j] = dist(gen);
+        sum += 2 * abs(A[i * N + j]); // for more probable convergence
+      }
+      A[i * N + i] += sum;
+      b[i] = 0;
+      for (size_t j = 0; j < N; ++j)
+        b[i] += A[i * N + j] * true_x[j];
     }
-    A[i * N + i] += sum;
-  }
-  for (int i = 0; i < N; ++i) {
-    b[i] = 0;
-    for (int j = 0; j < N; ++j)
-      b[i] += A[i * N + j] * true_x[j];
-  }
+  });
 
   while (true) {
     cout << "Enter precision: ";
@@ -83,27 +107,38 @@ void FillData(double *A, double *b, double *true_x, double &eps, size_t N) {
   }
 }
 
+static perf_region sweep_region = PERF_REGION_INIT("Solver sweep");
+
 int Solver(double *A, double *b, double *x, double *x_prev, size_t N,
            std::function<bool(void)> predicate) {
   int cnt_iter = 0;
+  // the same team for every sweep instead of two fork/joins per iteration
+  ThreadPool &pool = ThreadPool::Global();
 
   do {
-
-#pragma omp parallel for num_threads(THREADS)
-    for (int i = 0; i < N; ++i) {
-      x_prev[i] = x[i];
-    }
-
-#pragma omp parallel for num_threads(THREADS)
-    for (int i = 0; i < N; ++i) {
-      double var = 0;
-      for (int j = 0; j < N; ++j) {
-        if (j != i) {
-          var += (A[i * N + j] * x[j]);
+    TRACE_SCOPE("sweep");
+    std::copy(x, x + N, x_prev);
+
+    // every thread sweeps the rows it placed in FillData, counters are
+    // read once per sweep and thread
+    const long blocks = (N + SWEEP_ROWS - 1) / SWEEP_ROWS;
+    pool.ForEachThread([&](int t) {
+      perf_scope scope = perf_begin(&sweep_region);
+      const auto range = ThreadBlocks(blocks, t);
+      const size_t end = std::min<size_t>(N, range.second * SWEEP_ROWS);
+      for (size_t i = range.first * SWEEP_ROWS; i < end; ++i) {
+        double var = 0;
+        for (size_t j = 0; j < N; ++j) {
+          if (j != i) {
+            var += (A[i * N + j] * x[j]);
+          }
         }
+        x[i] = (b[i] - var) / A[i * N + i];
       }
-      x[i] = (b[i] - var) / A[i * N + i];
-    }
+      perf_end(&scope);
+    });
+    // A is streamed from memory once per sweep
+    perf_work(&sweep_region, 2.0 * N * N, sizeof(double) * N * N);
     ++cnt_iter;
   } while (predicate());
   return cnt_iter;
@@ -115,7 +150,7 @@ int main() {
   cin >> N;
   double *A, *b, *x, *x_prev, *true_x;
 
-  A = (double *)malloc(N * N * sizeof(double));
+  A = (double *)numa_alloc(N * N * sizeof(double));
   b = (double *)malloc(N * sizeof(double));
   x = (double *)malloc(N * sizeof(double));
   x_prev = (double *)malloc(N * sizeof(double));
@@ -124,6 +159,9 @@ int main() {
 
   FillData(A, b, true_x, eps, N);
 
+  // TRACE=axisb.json writes a timeline of the sweeps
+  Trace::FromEnv();
+
   // PrintData(A, b, N);
 
   int iterations;
@@ -133,12 +171,13 @@ int main() {
   if (is_diagonally_dominant(A, N)) {
     start = omp_get_wtime();
     iterations = Solver(A, b, x, x_prev, N, [&x, &x_prev, N, eps]() {
-      double norm = 0;
-#pragma omp parallel for num_threads(THREADS) reduction(+ : norm)
-      for (int i = 0; i < N; ++i) {
-        norm += (x[i] - x_prev[i]) * (x[i] - x_prev[i]);
-      }
-      return norm > eps * eps;
+      // the distance of given iterates is the same for any thread count,
+      // but the sweep reads x while other threads update it, so the
+      // iterates themselves (and the iteration count) can differ from run
+      // to run
+      double dist2 = reduce_dist2(x, x_prev, N);
+      Trace::Get().Counter("distance", std::sqrt(dist2));
+      return dist2 > eps * eps;
     });
 
   } else {
@@ -152,6 +191,7 @@ int main() {
   }
 
   double end = omp_get_wtime();
+  Trace::Get().Stop();
 
   double mse = 0;
   for (int i = 0; i < N; ++i) {
@@ -161,8 +201,9 @@ int main() {
 
   cout << "After " << iterations << " iterations and " << (end - start)
        << " seconds got solution with MSE = " << mse << endl;
+  perf_report(stdout);
 
-  free(A);
+  numa_free(A);
   free(b);
   free(x);
   free(x_prev);
@@ -0,0 +1,118 @@
+// Direct dense A x = b: LU in double against LU in float with iterative
+// refinement (and GMRES-IR when refinement stalls), both to double accuracy.
+// Usage: AxisbLU [N=4096] [cond=1e3]
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "lu.hpp"
+
+using std::cout, std::endl, std::vector;
+
+/// A = (I - 2 u u^T) S (I - 2 v v^T) with |u| = |v| = 1 and singular values
+/// S geometric from 1 to 1 / cond, so cond_2(A) = cond exactly; row by row
+/// in O(N^2)
+vector<double> Generate(int N, double cond) {
+  std::mt19937_64 gen(1);
+  std::normal_distribution<double> dist;
+  vector<double> u(N), v(N), s(N), A((long)N * N);
+  double nu = 0, nv = 0;
+  for (int i = 0; i < N; ++i) {
+    u[i] = dist(gen);
+    v[i] = dist(gen);
+    nu += u[i] * u[i];
+    nv += v[i] * v[i];
+    s[i] = std::pow(cond, -(double)i / std::max(1, N - 1));
+  }
+  // a random order of the singular values on the diagonal
+  std::shuffle(s.begin(), s.end(), gen);
+  double uSv = 0;
+  vector<double> Su(N), Sv(N);
+  for (int i = 0; i < N; ++i) {
+    u[i] /= std::sqrt(nu);
+    v[i] /= std::sqrt(nv);
+  }
+  for (int i = 0; i < N; ++i) {
+    Su[i] = s[i] * u[i];
+    Sv[i] = s[i] * v[i];
+    uSv += u[i] * Sv[i];
+  }
+  // S - 2 u (S u)^T - 2 (S v) v^T + 4 (u^T S v) u v^T
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < N; ++i) {
+    double *row = &A[(long)i * N];
+    for (int j = 0; j < N; ++j) {
+      row[j] = -2 * u[i] * Su[j] - 2 * Sv[i] * v[j] + 4 * uSv * u[i] * v[j];
+    }
+    row[i] += s[i];
+  }
+  return A;
+}
+
+double ForwardError(const vector<double> &x, const vector<double> &x_true) {
+  double e = 0, norm = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    e = std::max(e, std::abs(x[i] - x_true[i]));
+    norm = std::max(norm, std::abs(x_true[i]));
+  }
+  return e / norm;
+}
+
+int main(int argc, char *argv[]) {
+  const int N = argc > 1 ? std::stoi(argv[1]) : 4096;
+  const double cond = argc > 2 ? std::stod(argv[2]) : 1e3;
+  const double flops = 2.0 / 3 * N * (double)N * N;
+
+  const vector<double> A = Generate(N, cond);
+  vector<double> x_true(N), b(N), x(N);
+  std::mt19937_64 gen(2);
+  std::uniform_real_distribution<double> dist(-1, 1);
+  for (double &v : x_true) v = dist(gen);
+  MatVec(N, A.data(), x_true.data(), b.data());
+  cout << "N = " << N << ", cond(A) = " << cond << ", "
+       << omp_get_max_threads() << " threads" << endl;
+
+  // double: factor and solve
+  double start = omp_get_wtime();
+  LU<double> D(N);
+  std::copy(A.begin(), A.end(), D.Data());
+  if (!D.Factor()) {
+    cout << "A is singular" << endl;
+    return 1;
+  }
+  const double double_factor = omp_get_wtime() - start;
+  x = b;
+  D.Solve(x.data());
+  const double double_time = omp_get_wtime() - start;
+  vector<double> r(N);
+  Residual(N, A.data(), b.data(), x.data(), r.data());
+  const double double_backward =
+      NormInf(r) / (NormInf(N, A.data()) * NormInf(x) + NormInf(b));
+  cout << "double LU:  factor " << double_factor << " s ("
+       << flops / double_factor * 1e-9 << " GFLOP/s), total " << double_time
+       << " s, backward error " << double_backward << ", forward error "
+       << ForwardError(x, x_true) << endl;
+
+  // float factors, double accuracy
+  start = omp_get_wtime();
+  const RefineStats stats = MixedSolve(N, A.data(), b.data(), x.data());
+  const double mixed_time = omp_get_wtime() - start;
+  if (stats.fallback) {
+    cout << "float factors not good enough, solved in double" << endl;
+  }
+  cout << "mixed LU:   factor " << stats.factor_time << " s ("
+       << flops / stats.factor_time * 1e-9 << " GFLOP/s), "
+       << stats.refinements << " refinements";
+  if (stats.gmres > 0) {
+    cout << " + " << stats.gmres << " GMRES-IR iterations";
+  }
+  cout << " in " << stats.refine_time << " s, total " << mixed_time
+       << " s, backward error " << stats.backward_error << ", forward error "
+       << ForwardError(x, x_true) << endl;
+  cout << "speedup " << double_time / mixed_time << endl;
+  return 0;
+}
@@ -1,67 +1,17 @@
-#include <fstream>
+#include <algorithm>
 #include <iostream>
 #include <stdlib.h>
-#include <string>
 #include <thread>
 
 // include omp header file here
 #include <omp.h>
 
-#define RGB_COMPONENT_COLOR 255
+#include "perf_region.h"
+#include "ppm.hpp"
+#include "thread_pool.hpp"
 
 static const auto THREADS = std::thread::hardware_concurrency();
 
-struct PPMPixel {
-  int red;
-  int green;
-  int blue;
-};
-
-typedef struct {
-  int x, y, all;
-  PPMPixel *data;
-} PPMImage;
-
-void readPPM(const char *filename, PPMImage &img) {
-  std::ifstream file(filename);
-  if (file) {
-    std::string s;
-    int rgb_comp_color;
-    file >> s;
-    if (s != "P3") {
-      std::cout << "error in format" << std::endl;
-      exit(9);
-    }
-    file >> img.x >> img.y;
-    file >> rgb_comp_color;
-    img.all = img.x * img.y;
-    std::cout << s << std::endl;
-    std::cout << "x=" << img.x << " y=" << img.y << " all=" << img.all
-              << std::endl;
-    img.data = new PPMPixel[img.all];
-    for (int i = 0; i < img.all; i++) {
-      file >> img.data[i].red >> img.data[i].green >> img.data[i].blue;
-    }
-
-  } else {
-    std::cout << "the file:" << filename << "was not found" << std::endl;
-  }
-  file.close();
-}
-
-void writePPM(const char *filename, PPMImage &img) {
-  std::ofstream file(filename, std::ofstream::out);
-  file << "P3" << std::endl;
-  file << img.x << " " << img.y << " " << std::endl;
-  file << RGB_COMPONENT_COLOR << std::endl;
-
-  for (int i = 0; i < img.all; i++) {
-    file << img.data[i].red << " " << img.data[i].green << " "
-         << img.data[i].blue << (((i + 1) % img.x == 0) ? "\n" : " ");
-  }
-  file.close();
-}
-
 // the function for shifting
 
 void shiftPPM_omp(PPMImage &img, int shift) {
@@ -90,9 +40,31 @@ void shiftPPM_omp(PPMImage &img, int shift) {
       data.blue = new_data.blue;
     }
   }
+  delete[] new_img.data;
+}
+
+/// shiftPPM_omp on the persistent pool: no team is created per shift
+void shiftPPM_pool(PPMImage &img, int shift) {
+  ThreadPool &pool = ThreadPool::Global();
+  const int x = img.x, all = img.all;
+  PPMPixel *data = img.data, *new_data = new PPMPixel[all];
+
+  for (int k = 0; k < shift; ++k) {
+    pool.ParallelFor(0, img.y, [=](int i) {
+      for (int j = 0; j < x; j++) {
+        new_data[(i * x + j + 1) % all] = data[i * x + j];
+      }
+    });
+    pool.ParallelFor(0, img.y, [=](int i) {
+      std::copy(new_data + i * x, new_data + (i + 1) * x, data + i * x);
+    });
+  }
+  delete[] new_data;
 }
 
 void shiftPPM(PPMImage &img, int shift) {
+  static perf_region region = PERF_REGION_INIT("shiftPPM");
+  perf_scope scope = perf_begin(&region);
   PPMImage new_img;
   new_img.data = new PPMPixel[img.all];
 
@@ -115,6 +87,66 @@ void shiftPPM(PPMImage &img, int shift) {
       data.blue = new_data.blue;
     }
   }
+  delete[] new_img.data;
+  perf_end(&scope);
+  // no arithmetic: every shift reads and writes the image twice
+  perf_work(&region, 0, 4.0 * sizeof(PPMPixel) * img.all * shift);
+}
+
+bool samePPM(const PPMImage &a, const PPMImage &b) {
+  for (int i = 0; i < a.all; ++i) {
+    if (a.data[i].red != b.data[i].red || a.data[i].green != b.data[i].green ||
+        a.data[i].blue != b.data[i].blue) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/// Compare the one-step loop against the single pass rotation
+void benchmarkShifts(const char *filename) {
+  PPMImage image, reference;
+  readPPM(filename, image);
+  readPPM(filename, reference);
+
+  printf("%8s %14s %14s %14s\n", "shifts", "loop omp, s", "rotate, s",
+         "inplace, s");
+  for (int shift : {1, 10, 100, 1000, 10000}) {
+    double start = omp_get_wtime();
+    shiftPPM_omp(reference, shift);
+    double loop_time = omp_get_wtime() - start;
+
+    start = omp_get_wtime();
+    rotatePPM(image, shift);
+    double rotate_time = omp_get_wtime() - start;
+    bool ok = samePPM(image, reference);
+
+    start = omp_get_wtime();
+    rotatePPMInplace(image, -shift);
+    rotatePPMInplace(image, shift);
+    double inplace_time = (omp_get_wtime() - start) / 2;
+    ok = ok && samePPM(image, reference);
+
+    printf("%8d %14f %14f %14f%s\n", shift, loop_time, rotate_time,
+           inplace_time, ok ? "" : "  MISMATCH");
+  }
+
+  // every intermediate frame of a 100 step animation, only checksummed here
+  long checksum = 0;
+  double start = omp_get_wtime();
+  animatePPM(image, 100, 1, ShiftDirection::Horizontal,
+             [&checksum](int, const PPMImage &frame) {
+               checksum += frame.data[0].red;
+             });
+  animatePPM(image, 100, 1, ShiftDirection::Linear,
+             [&checksum](int, const PPMImage &frame) {
+               checksum += frame.data[0].red;
+             });
+  printf("200 animation frames: %f seconds (checksum %ld).\n",
+         omp_get_wtime() - start, checksum);
+
+  delete[] image.data;
+  delete[] reference.data;
 }
 
 int main(int argc, char *argv[]) {
@@ -131,6 +163,7 @@ int main(int argc, char *argv[]) {
   printf("Time elapsed %d shifts: %f seconds.\n", shift, end - start);
 
   writePPM("new_car_1.ppm", image);
+  delete[] image.data;
   readPPM("car.ppm", image);
 
   start = omp_get_wtime();
@@ -140,5 +173,25 @@ int main(int argc, char *argv[]) {
          THREADS, end - start);
 
   writePPM("new_car_2.ppm", image);
+  delete[] image.data;
+
+  readPPM("car.ppm", image);
+  start = omp_get_wtime();
+  shiftPPM_pool(image, shift);
+  end = omp_get_wtime();
+  printf("Time elapsed %d shifts  %d threads (pool): %f seconds.\n", shift,
+         ThreadPool::Global().Size(), end - start);
+  delete[] image.data;
+
+  readPPM("car.ppm", image);
+  start = omp_get_wtime();
+  rotatePPM(image, shift);
+  end = omp_get_wtime();
+  printf("Time elapsed %d shifts (single pass rotate): %f seconds.\n", shift,
+         end - start);
+  delete[] image.data;
+
+  benchmarkShifts("car.ppm");
+  perf_report(stdout);
   return 0;
 }
@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <omp.h>
+
+#include "filters.hpp"
+
+using std::cout, std::endl;
+
+PPMImage AllocPPM(int x, int y) {
+  PPMImage img;
+  img.x = x;
+  img.y = y;
+  img.all = x * y;
+  img.data = new PPMPixel[img.all];
+  return img;
+}
+
+/// Smooth gradient with salt and pepper noise, something for a median to do
+PPMImage RandomPPM(int x, int y) {
+  PPMImage img = AllocPPM(x, y);
+  std::mt19937 gen(42);
+  std::uniform_int_distribution<int> noise(0, 19);
+  for (int i = 0; i < img.all; ++i) {
+    int v = noise(gen);
+    int base = (i % x + i / x) % 256;
+    img.data[i] = {v == 0 ? 0 : base, v == 1 ? 255 : 255 - base, base / 2};
+  }
+  return img;
+}
+
+/// Reference median by sorting every window
+void NaiveMedian(const uint8_t *src, uint8_t *dst, int w, int h, int r) {
+  std::vector<uint8_t> window;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      window.clear();
+      for (int dy = -r; dy <= r; ++dy) {
+        for (int dx = -r; dx <= r; ++dx) {
+          int sy = std::min(h - 1, std::max(0, y + dy));
+          int sx = std::min(w - 1, std::max(0, x + dx));
+          window.push_back(src[sy * w + sx]);
+        }
+      }
+      std::nth_element(window.begin(), window.begin() + window.size() / 2,
+                       window.end());
+      dst[y * w + x] = window[window.size() / 2];
+    }
+  }
+}
+
+/// Reference 2-D convolution with a separable kernel
+void NaiveConvolve(const float *src, float *dst, int w, int h,
+                   const std::vector<float> &kernel) {
+  int r = (int)kernel.size() / 2;
+  for (int y = 0; y < h; ++y) {
+    for (int x = 0; x < w; ++x) {
+      double sum = 0;
+      for (int dy = -r; dy <= r; ++dy) {
+        for (int dx = -r; dx <= r; ++dx) {
+          int sy = std::min(h - 1, std::max(0, y + dy));
+          int sx = std::min(w - 1, std::max(0, x + dx));
+          sum += kernel[dy + r] * kernel[dx + r] * src[sy * w + sx];
+        }
+      }
+      dst[y * w + x] = sum;
+    }
+  }
+}
+
+void Check() {
+  const int w = 71, h = 53;
+  std::mt19937 gen(7);
+  std::uniform_int_distribution<int> dist(0, 255);
+  std::vector<uint8_t> bytes(w * h), median(w * h), expected(w * h);
+  std::vector<float> plane(w * h), blurred(w * h), reference(w * h);
+  for (int i = 0; i < w * h; ++i) {
+    plane[i] = bytes[i] = dist(gen);
+  }
+
+  bool ok = true;
+  for (int r : {1, 3, 28}) {
+    MedianFilter(bytes.data(), median.data(), w, h, r);
+    NaiveMedian(bytes.data(), expected.data(), w, h, r);
+    ok = ok && median == expected;
+
+    BoxBlur(plane.data(), blurred.data(), w, h, r);
+    NaiveConvolve(plane.data(), reference.data(), w, h,
+                  std::vector<float>(2 * r + 1, 1.f / (2 * r + 1)));
+    for (int i = 0; i < w * h; ++i) {
+      ok = ok && std::abs(blurred[i] - reference[i]) < 1e-2;
+    }
+  }
+
+  GaussianBlur(plane.data(), blurred.data(), w, h, 2.0);
+  NaiveConvolve(plane.data(), reference.data(), w, h, GaussianKernel(2.0));
+  for (int i = 0; i < w * h; ++i) {
+    ok = ok && std::abs(blurred[i] - reference[i]) < 1e-2;
+  }
+
+  cout << "Filters match the naive versions: " << (ok ? "yes" : "NO") << endl;
+}
+
+int main(int argc, char *argv[]) {
+  Check();
+
+  // the images from the CUDA homework: two blurs and a cartoon-like median
+  PPMImage car;
+  readPPM("car.ppm", car);
+  PPMImage out = AllocPPM(car.x, car.y);
+  gaussianBlurPPM(car, out, 3.0);
+  writePPM("car_gauss.ppm", out);
+  boxBlurPPM(car, out, 5);
+  writePPM("car_box.ppm", out);
+  medianFilterPPM(car, out, 28);
+  writePPM("car_median.ppm", out);
+  delete[] car.data;
+  delete[] out.data;
+
+  int side = argc > 1 ? atoi(argv[1]) : 2048;
+  PPMImage image = RandomPPM(side, side);
+  PPMImage result = AllocPPM(side, side);
+  cout << side << "x" << side << " image, " << omp_get_max_threads()
+       << " threads" << endl;
+
+  double start = omp_get_wtime();
+  gaussianBlurPPM(image, result, 3.0);
+  cout << "Gaussian sigma 3: " << omp_get_wtime() - start << " seconds"
+       << endl;
+
+  for (int r : {2, 28}) {
+    start = omp_get_wtime();
+    boxBlurPPM(image, result, r);
+    cout << "Box " << 2 * r + 1 << "x" << 2 * r + 1 << ": "
+         << omp_get_wtime() - start << " seconds" << endl;
+  }
+
+  for (int r : {2, 28}) {
+    start = omp_get_wtime();
+    medianFilterPPM(image, result, r);
+    cout << "Median " << 2 * r + 1 << "x" << 2 * r + 1 << ": "
+         << omp_get_wtime() - start << " seconds" << endl;
+  }
+
+  delete[] image.data;
+  delete[] result.data;
+  return 0;
+}
@@ -0,0 +1,107 @@
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <omp.h>
+
+#include "histogram.hpp"
+
+using std::cout, std::endl, std::vector;
+
+/// The CUDA homework kernel on the CPU: one shared counter per bin, an atomic
+/// increment per pixel
+void NaiveGrayHistogram(const uint8_t *rgb, long pixels, uint64_t *hist) {
+  std::fill(hist, hist + 256, 0);
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < pixels; ++i) {
+    int gray = Gray(rgb[3 * i], rgb[3 * i + 1], rgb[3 * i + 2]);
+#pragma omp atomic
+    ++hist[gray];
+  }
+}
+
+template <typename T>
+bool CheckChannels(const vector<T> &data, int channels, int bits) {
+  vector<uint64_t> hist(channels << bits), expected(channels << bits);
+  for (size_t i = 0; i < data.size(); ++i) {
+    ++expected[(i % channels << bits) + (data[i] & ((1 << bits) - 1))];
+  }
+  ChannelHistogram(data.data(), data.size() / channels, channels, bits,
+                   hist.data());
+  return hist == expected;
+}
+
+int main(int argc, char *argv[]) {
+  const long side = argc > 1 ? atol(argv[1]) : 4096;
+  const long pixels = side * side;
+  const int repeats = 5;
+
+  std::mt19937 gen(1);
+  std::uniform_int_distribution<int> dist(0, 65535);
+  vector<uint8_t> rgb(3 * pixels);
+  for (auto &v : rgb) {
+    v = dist(gen) >> 8;
+  }
+
+  // correctness of the generic paths on small images
+  vector<uint8_t> bytes(3 * 1001);
+  vector<uint16_t> words(1001);
+  for (auto &v : bytes) {
+    v = dist(gen);
+  }
+  for (auto &v : words) {
+    v = dist(gen);
+  }
+  bool ok = CheckChannels(bytes, 1, 8) && CheckChannels(bytes, 3, 8) &&
+            CheckChannels(words, 1, 16) && CheckChannels(words, 1, 12);
+
+  vector<uint64_t> hist(256), naive(256);
+  NaiveGrayHistogram(rgb.data(), pixels, naive.data());
+  GrayHistogram(rgb.data(), pixels, hist.data());
+  ok = ok && hist == naive;
+  cout << "Histograms match: " << (ok ? "yes" : "NO") << endl;
+
+  double bytes_read = 3.0 * pixels * repeats;
+  double start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+    NaiveGrayHistogram(rgb.data(), pixels, naive.data());
+  }
+  double naive_time = omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+    GrayHistogram(rgb.data(), pixels, hist.data());
+  }
+  double time = omp_get_wtime() - start;
+
+  // plain streaming read of the same bytes, the bandwidth we should reach
+  uint64_t checksum = 0;
+  start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+#pragma omp parallel for reduction(+ : checksum)
+    for (long i = 0; i < 3 * pixels; ++i) {
+      checksum += rgb[i];
+    }
+  }
+  double stream_time = omp_get_wtime() - start;
+
+  printf("%ldx%ld RGB image, %d threads\n", side, side, omp_get_max_threads());
+  printf("shared atomic:    %8.4f s/image %8.2f GB/s\n", naive_time / repeats,
+         bytes_read / naive_time * 1e-9);
+  printf("privatized fused: %8.4f s/image %8.2f GB/s\n", time / repeats,
+         bytes_read / time * 1e-9);
+  printf("stream read:      %8.4f s/image %8.2f GB/s (checksum %lu)\n",
+         stream_time / repeats, bytes_read / stream_time * 1e-9, checksum);
+
+  // gray histogram of the homework picture, ready for plotting
+  PPMImage car;
+  readPPM("car.ppm", car);
+  GrayHistogramPPM(car, hist.data());
+  std::ofstream file("car_hist.txt");
+  for (int b = 0; b < 256; ++b) {
+    file << b << " " << hist[b] << endl;
+  }
+  delete[] car.data;
+  return 0;
+}
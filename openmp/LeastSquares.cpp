@@ -1,13 +1,20 @@
+#include <algorithm>
 #include <cassert>
 #include <chrono>
 #include <cmath>
+#include <cstring>
 #include <ctime>
 #include <functional>
 #include <iostream>
+#include <numeric>
 #include <omp.h>
 #include <random>
 #include <thread>
 #include <utility>
+#include <vector>
+
+#include "reduce.h"
+#include "thread_pool.hpp"
 
 using std::cin, std::cout, std::endl;
 
@@ -26,28 +33,306 @@ void InitData(double *x, double *y, double *y_true, size_t N, double a, double b
   }
 }
 
-std::pair<double, double> Solver(double *x, double *y, size_t N, int iter_num,
-                                 double learning_rate, double *y_true) {
+/// Data set generated chunk by chunk, so it never has to fit in memory.
+/// Chunk k always produces the same points whichever thread asks for it.
+struct DataStream {
+  static constexpr size_t CHUNK = 1 << 16;
+
+  size_t N;
+  double a, b;
+  unsigned seed;
+
+  size_t Chunks() const { return (N + CHUNK - 1) / CHUNK; }
+
+  /// Write chunk k into x, y_true and return its size
+  size_t Fill(size_t k, double *x, double *y_true) const {
+    std::mt19937_64 gen(seed + k);
+    std::uniform_real_distribution<double> dist(-50.0, 50.0);
+    size_t size = std::min(CHUNK, N - k * CHUNK);
+    for (size_t i = 0; i < size; ++i) {
+      x[i] = dist(gen);
+      y_true[i] = a * x[i] + b;
+    }
+    return size;
+  }
+};
+
+/// Sufficient statistics of the MSE loss: the gradient in (a, b) only
+/// depends on these five numbers
+struct Moments {
+  double n = 0, sx = 0, sxx = 0, sy = 0, sxy = 0;
+
+  Moments &operator+=(const Moments &o) {
+    n += o.n;
+    sx += o.sx;
+    sxx += o.sxx;
+    sy += o.sy;
+    sxy += o.sxy;
+    return *this;
+  }
+};
+
+/// Exact accumulators of sx, sxx, sy and sxy: the moments come out bit for
+/// bit the same whatever the number of threads
+struct MomentsAcc {
+  reduce_acc sx, sxx, sy, sxy;
+
+  MomentsAcc() {
+    reduce_acc_init(&sx);
+    reduce_acc_init(&sxx);
+    reduce_acc_init(&sy);
+    reduce_acc_init(&sxy);
+  }
+
+  /// Add one block of at most REDUCE_BLOCK points
+  void Add(const double *x, const double *y_true, size_t size) {
+    double sum, comp;
+    reduce_block_sum(x, size, &sum, &comp);
+    reduce_acc_add(&sx, sum);
+    reduce_acc_add(&sx, comp);
+    reduce_block_dot(x, x, size, &sum, &comp);
+    reduce_acc_add(&sxx, sum);
+    reduce_acc_add(&sxx, comp);
+    reduce_block_sum(y_true, size, &sum, &comp);
+    reduce_acc_add(&sy, sum);
+    reduce_acc_add(&sy, comp);
+    reduce_block_dot(x, y_true, size, &sum, &comp);
+    reduce_acc_add(&sxy, sum);
+    reduce_acc_add(&sxy, comp);
+  }
+
+  /// Add the blocks of a chunk, aligned to REDUCE_BLOCK like the chunk itself
+  void AddBlocks(const double *x, const double *y_true, size_t size) {
+    for (size_t first = 0; first < size; first += REDUCE_BLOCK) {
+      Add(x + first, y_true + first,
+          std::min<size_t>(REDUCE_BLOCK, size - first));
+    }
+  }
+
+  void Merge(const MomentsAcc &o) {
+    reduce_acc_merge(&sx, &o.sx);
+    reduce_acc_merge(&sxx, &o.sxx);
+    reduce_acc_merge(&sy, &o.sy);
+    reduce_acc_merge(&sxy, &o.sxy);
+  }
+
+  Moments Value(size_t N) const {
+    return {(double)N, reduce_acc_value(&sx), reduce_acc_value(&sxx),
+            reduce_acc_value(&sy), reduce_acc_value(&sxy)};
+  }
+};
+
+static_assert(DataStream::CHUNK % REDUCE_BLOCK == 0,
+              "stream chunks must hold whole reduction blocks");
+
+/// One streaming parallel pass over data in memory
+Moments Accumulate(const double *x, const double *y_true, size_t N) {
+  const size_t blocks = (N + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+  MomentsAcc total;
+
+#pragma omp parallel num_threads(THREADS) if (N > DataStream::CHUNK)
+  {
+    MomentsAcc mine;
+#pragma omp for schedule(static)
+    for (size_t k = 0; k < blocks; ++k) {
+      size_t first = k * REDUCE_BLOCK;
+      mine.Add(x + first, y_true + first,
+               std::min<size_t>(REDUCE_BLOCK, N - first));
+    }
+#pragma omp critical(moments_merge)
+    total.Merge(mine);
+  }
+  return total.Value(N);
+}
+
+/// One pass over a stream, chunks generated and consumed by the same thread
+Moments Accumulate(const DataStream &stream) {
+  MomentsAcc total;
+
+#pragma omp parallel num_threads(THREADS)
+  {
+    std::vector<double> x(DataStream::CHUNK), y_true(DataStream::CHUNK);
+    MomentsAcc mine;
+#pragma omp for schedule(dynamic)
+    for (size_t k = 0; k < stream.Chunks(); ++k) {
+      size_t size = stream.Fill(k, x.data(), y_true.data());
+      mine.AddBlocks(x.data(), y_true.data(), size);
+    }
+#pragma omp critical(moments_merge)
+    total.Merge(mine);
+  }
+  return total.Value(stream.N);
+}
+
+/// Gradient of mean((a_hat * x + b_hat - y)^2), O(1) given the moments
+std::pair<double, double> Gradient(const Moments &m, double a_hat,
+                                   double b_hat) {
+  return {2 * (a_hat * m.sxx + b_hat * m.sx - m.sxy) / m.n,
+          2 * (a_hat * m.sx + b_hat * m.n - m.sy) / m.n};
+}
+
+/// Gradient descent on precomputed moments: the same iterates as
+/// SolverTwoPass, but every iteration costs O(1) instead of two passes
+std::pair<double, double> Solver(const Moments &m, int iter_num,
+                                 double learning_rate) {
+  double a_hat = 0, b_hat = 0;
+  for (int j = 0; j < iter_num; ++j) {
+    auto grad = Gradient(m, a_hat, b_hat);
+    a_hat -= learning_rate * grad.first;
+    b_hat -= learning_rate * grad.second;
+  }
+  return {a_hat, b_hat};
+}
+
+/// Exact minimizer: the 2x2 normal equations, with the variance and
+/// covariance formed from the raw sums as E[x^2] - E[x]^2. That cancels
+/// digits when |mean x| is much larger than the spread of x; the data here
+/// is centred on 0.
+std::pair<double, double> NormalEquations(const Moments &m) {
+  double mean_x = m.sx / m.n, mean_y = m.sy / m.n;
+  double var_x = m.sxx / m.n - mean_x * mean_x;
+  double cov_xy = m.sxy / m.n - mean_x * mean_y;
+  double a_hat = cov_xy / var_x;
+  return {a_hat, mean_y - a_hat * mean_x};
+}
+
+/// Points of one chunk of the data set
+struct Chunk {
+  const double *x, *y_true;
+  size_t size;
+};
+
+/// Mini-batch SGD: the `chunks` chunks (`chunk(k)`) are visited in random
+/// order and every step moves along the gradient of the next `batch` points
+/// of the current chunk only
+template <typename GetChunk>
+std::pair<double, double> SolverSGD(size_t chunks, GetChunk chunk,
+                                    size_t batch, int steps,
+                                    double learning_rate, unsigned seed) {
+  std::mt19937_64 gen(seed);
+  std::uniform_int_distribution<size_t> pick_chunk(0, chunks - 1);
+  double a_hat = 0, b_hat = 0;
+
+  for (int j = 0; j < steps;) {
+    Chunk c = chunk(pick_chunk(gen));
+    for (size_t first = 0; first < c.size && j < steps; first += batch, ++j) {
+      Moments m = Accumulate(c.x + first, c.y_true + first,
+                             std::min(batch, c.size - first));
+      auto grad = Gradient(m, a_hat, b_hat);
+      a_hat -= learning_rate * grad.first;
+      b_hat -= learning_rate * grad.second;
+    }
+  }
+  return {a_hat, b_hat};
+}
+
+/// SGD over points in memory, in chunks of DataStream::CHUNK
+std::pair<double, double> SolverSGD(const double *x, const double *y_true,
+                                    size_t N, size_t batch, int steps,
+                                    double learning_rate, unsigned seed) {
+  const size_t chunks = (N + DataStream::CHUNK - 1) / DataStream::CHUNK;
+  return SolverSGD(
+      chunks,
+      [&](size_t k) {
+        size_t first = k * DataStream::CHUNK;
+        return Chunk{x + first, y_true + first,
+                     std::min(DataStream::CHUNK, N - first)};
+      },
+      batch, steps, learning_rate, seed);
+}
+
+/// SGD over a stream, each chunk generated when it is visited: memory is one
+/// chunk whatever N
+std::pair<double, double> SolverSGD(const DataStream &stream, size_t batch,
+                                    int steps, double learning_rate,
+                                    unsigned seed) {
+  std::vector<double> x(DataStream::CHUNK), y_true(DataStream::CHUNK);
+  return SolverSGD(
+      stream.Chunks(),
+      [&](size_t k) {
+        size_t size = stream.Fill(k, x.data(), y_true.data());
+        return Chunk{x.data(), y_true.data(), size};
+      },
+      batch, steps, learning_rate, seed);
+}
+
+/// The original solver, two parallel passes per iteration, on the persistent
+/// pool instead of two fresh OpenMP regions per iteration
+std::pair<double, double> SolverTwoPass(double *x, double *y, size_t N,
+                                        int iter_num, double learning_rate,
+                                        double *y_true) {
+  ThreadPool &pool = ThreadPool::Global();
   double a_hat = 0, b_hat = 0;
 
   for (int j = 0; j < iter_num; ++j) {
+    auto step = pool.ParallelReduce(
+        0, N, std::pair<double, double>{0, 0},
+        [&](long first, long last) {
+          double da = 0, db = 0;
+          for (long i = first; i < last; ++i) {
+            auto diff = y[i] - y_true[i];
+            da -= 2 * diff * x[i] * learning_rate / N;
+            db -= 2 * diff * learning_rate / N;
+          }
+          return std::pair<double, double>{da, db};
+        },
+        [](std::pair<double, double> l, std::pair<double, double> r) {
+          return std::pair<double, double>{l.first + r.first,
+                                           l.second + r.second};
+        });
+    a_hat += step.first;
+    b_hat += step.second;
 
-#pragma omp parallel for num_threads(THREADS) reduction(+: a_hat, b_hat)
-    for (size_t i = 0; i < N; ++i) {
-        auto diff = y[i] - y_true[i];
-        a_hat -= 2 * diff * x[i] * learning_rate / N;
-        b_hat -= 2 * diff * learning_rate / N;
+    pool.ParallelFor(0, N, [&](long i) { y[i] = a_hat * x[i] + b_hat; });
+  }
+  return {a_hat, b_hat};
+}
+
+/// Time both gradient descents for growing N; above `in_memory` points the
+/// arrays of the two-pass solver would not fit and only the stream is used
+void Benchmark(double a, double b, int iter_num, double learning_rate,
+               size_t max_n) {
+  const size_t in_memory = 100000000;
+  printf("%12s %14s %14s %14s %14s\n", "N", "two-pass, s", "fused, s",
+         "stream, s", "|a - a_hat|");
+  for (size_t N = 1000; N <= max_n; N *= 10) {
+    double two_pass_time = NAN, fused_time = NAN, error = NAN;
+    if (N <= in_memory) {
+      std::vector<double> x(N), y(N), y_true(N);
+      InitData(x.data(), y.data(), y_true.data(), N, a, b);
+
+      double start = omp_get_wtime();
+      SolverTwoPass(x.data(), y.data(), N, iter_num, learning_rate,
+                    y_true.data());
+      two_pass_time = omp_get_wtime() - start;
+
+      start = omp_get_wtime();
+      auto ab = Solver(Accumulate(x.data(), y_true.data(), N), iter_num,
+                       learning_rate);
+      fused_time = omp_get_wtime() - start;
+      error = std::abs(ab.first - a);
     }
 
-#pragma omp parallel for num_threads(THREADS)
-    for (size_t i = 0; i < N; ++i) {
-        y[i] = a_hat * x[i] + b_hat;
+    double start = omp_get_wtime();
+    auto ab = Solver(Accumulate(DataStream{N, a, b, 1}), iter_num,
+                     learning_rate);
+    double stream_time = omp_get_wtime() - start;
+    if (std::isnan(error)) {
+      error = std::abs(ab.first - a);
     }
+
+    printf("%12zu %14f %14f %14f %14g\n", N, two_pass_time, fused_time,
+           stream_time, error);
   }
-  return {a_hat, b_hat};
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+  if (argc > 1 && strcmp(argv[1], "--bench") == 0) {
+    size_t max_n = argc > 2 ? std::stoul(argv[2]) : 1000000000;
+    Benchmark(2.0, -3.0, 100, 1e-3, max_n);
+    return 0;
+  }
+
   int N;
   cout << "Enter vector size: ";
   cin >> N;
@@ -69,13 +354,32 @@ int main() {
 
   double start = omp_get_wtime();
 
-  auto ab = Solver(x, y, N, iter_num, learning_rate, y_true);
+  auto ab = SolverTwoPass(x, y, N, iter_num, learning_rate, y_true);
 
   double end = omp_get_wtime();
 
   cout << "After " << (end - start) << " seconds a_hat = " << ab.first
        << ", a = " << a << ", b_hat = " << ab.second << ", b = " << b << endl;
 
+  start = omp_get_wtime();
+  Moments m = Accumulate(x, y_true, N);
+  ab = Solver(m, iter_num, learning_rate);
+  end = omp_get_wtime();
+
+  cout << "Fused: after " << (end - start) << " seconds a_hat = " << ab.first
+       << ", b_hat = " << ab.second << endl;
+
+  ab = NormalEquations(m);
+  cout << "Normal equations: a_hat = " << ab.first << ", b_hat = " << ab.second
+       << endl;
+
+  start = omp_get_wtime();
+  ab = SolverSGD(x, y_true, N, 256, iter_num, learning_rate, 2);
+  end = omp_get_wtime();
+
+  cout << "SGD (batch 256): after " << (end - start)
+       << " seconds a_hat = " << ab.first << ", b_hat = " << ab.second << endl;
+
   free(x);
   free(y);
   free(y_true);
@@ -0,0 +1,147 @@
+// Multivariate least squares: TSQR, normal equations and gradient descent.
+// Build with -DUSE_MPI and mpicxx to spread the rows over MPI ranks.
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "tsqr.hpp"
+
+using std::cout, std::endl, std::vector;
+
+/// Synthetic regression b = A x_true, x_true = (1, ..., 1), generated chunk by
+/// chunk. Column j of A is scaled by cond^(-j / (p - 1)), so cond(A) ~ cond.
+struct Problem {
+  long m;
+  int p;
+  double cond, noise;
+  vector<double> scale;
+
+  Problem(long m, int p, double cond, double noise = 0)
+      : m(m), p(p), cond(cond), noise(noise), scale(p) {
+    for (int j = 0; j < p; ++j) {
+      scale[j] = std::pow(cond, -(double)j / std::max(1, p - 1));
+    }
+  }
+
+  int n() const { return p + 1; }
+  long Chunks() const { return (m + TSQR_CHUNK - 1) / TSQR_CHUNK; }
+
+  /// Rows of chunk k as [A | b], the same whoever generates them
+  int operator()(long k, double *block) const {
+    std::mt19937_64 gen(k);
+    std::normal_distribution<double> dist;
+    int c = std::min<long>(TSQR_CHUNK, m - k * TSQR_CHUNK);
+    for (int i = 0; i < c; ++i) {
+      double *row = block + (long)i * n();
+      double b = 0;
+      for (int j = 0; j < p; ++j) {
+        row[j] = dist(gen) * scale[j];
+        b += row[j];
+      }
+      row[p] = b + noise * dist(gen);
+    }
+    return c;
+  }
+};
+
+double Error(const vector<double> &x) {
+  double err = 0;
+  for (double v : x) {
+    err = std::max(err, std::abs(v - 1));
+  }
+  return err;
+}
+
+/// Gradient descent on the normal equations with step 1 / trace(A^T A), the
+/// multivariate version of the LeastSquares.cpp solver
+vector<double> GradientDescent(const vector<double> &G, int n, int iter_num) {
+  const int p = n - 1;
+  double trace = 0;
+  for (int j = 0; j < p; ++j) {
+    trace += G[j * n + j];
+  }
+  auto gram = [&](int i, int j) { return i <= j ? G[i * n + j] : G[j * n + i]; };
+  vector<double> x(p), grad(p);
+  for (int it = 0; it < iter_num; ++it) {
+#pragma omp parallel for schedule(static)
+    for (int i = 0; i < p; ++i) {
+      double s = -G[i * n + p];
+      for (int j = 0; j < p; ++j) {
+        s += gram(i, j) * x[j];
+      }
+      grad[i] = s;
+    }
+    for (int i = 0; i < p; ++i) {
+      x[i] -= grad[i] / trace;
+    }
+  }
+  return x;
+}
+
+int main(int argc, char *argv[]) {
+  int rank = 0, size = 1;
+#ifdef USE_MPI
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+
+  const Problem problem(argc > 1 ? std::stol(argv[1]) : 1000000,
+                        argc > 2 ? std::stoi(argv[2]) : 50,
+                        argc > 3 ? std::stod(argv[3]) : 1e4);
+  const int n = problem.n();
+  const int iter_num = 1000;
+  // rows of this rank
+  const long first = problem.Chunks() * rank / size;
+  const long last = problem.Chunks() * (rank + 1) / size;
+
+  double start = omp_get_wtime();
+  auto R = TSQR(first, last, n, problem);
+#ifdef USE_MPI
+  TSQRReduce(R, n, MPI_COMM_WORLD);
+#endif
+  double tsqr_time = omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+  auto G = Gram(first, last, n, problem);
+#ifdef USE_MPI
+  MPI_Allreduce(MPI_IN_PLACE, G.data(), n * n, MPI_DOUBLE, MPI_SUM,
+                MPI_COMM_WORLD);
+#endif
+  double gram_time = omp_get_wtime() - start;
+  auto gram = G;
+  start = omp_get_wtime();
+  bool positive = Cholesky(G.data(), n);
+  double cholesky_time = gram_time + omp_get_wtime() - start;
+
+  start = omp_get_wtime();
+  auto x_gd = GradientDescent(gram, n, iter_num);
+  double gd_time = gram_time + omp_get_wtime() - start;
+
+  if (rank == 0) {
+    printf("%ld rows, %d features, cond %g, %d ranks x %d threads\n",
+           problem.m, problem.p, problem.cond, size, omp_get_max_threads());
+    printf("%-22s %10s %14s\n", "", "time, s", "max |x - 1|");
+    printf("%-22s %10.4f %14g\n", "TSQR", tsqr_time,
+           Error(SolveFromR(R.data(), n)));
+    if (positive) {
+      printf("%-22s %10.4f %14g\n", "normal eq. Cholesky", cholesky_time,
+             Error(SolveFromR(G.data(), n)));
+    } else {
+      printf("%-22s %10.4f %14s\n", "normal eq. Cholesky", cholesky_time,
+             "not SPD");
+    }
+    printf("%-22s %10.4f %14g\n",
+           ("gradient descent x" + std::to_string(iter_num)).c_str(), gd_time,
+           Error(x_gd));
+  }
+
+#ifdef USE_MPI
+  MPI_Finalize();
+#endif
+  return 0;
+}
@@ -1,9 +1,25 @@
+#define _GNU_SOURCE /* sched_setaffinity in numa_alloc.h */
+#include <math.h>
 #include <omp.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include "morton.h"
+#include "numa_alloc.h"
+#include "perf_region.h"
+#include "philox.h"
+
+/* Random numbers per philox batch */
+#define PHILOX_ROW 256
+
+/* Rows are initialized with the static schedule of the MatMul loops over
+   i, so each thread first touches (and places on its socket) the rows of A
+   and C it works on */
 void zero_init_matrix(double **matrix, size_t N) {
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < N; i++) {
     for (int j = 0; j < N; j++) {
       matrix[i][j] = 0.0;
@@ -11,37 +27,55 @@ void zero_init_matrix(double **matrix, size_t N) {
   }
 }
 
+/* Uniform [0, 1) entries, the same for a seed whatever the thread count */
 void rand_init_matrix(double **matrix, size_t N) {
-  srand(time(NULL));
+  const uint64_t seed = time(NULL);
 
+#pragma omp parallel for schedule(static)
   for (int i = 0; i < N; i++) {
-    for (int j = 0; j < N; j++) {
-      matrix[i][j] = rand() / RAND_MAX;
+    uint32_t r[4][PHILOX_ROW];
+    for (int j0 = 0; j0 < N; j0 += PHILOX_ROW) {
+      const int n = N - j0 < PHILOX_ROW ? N - j0 : PHILOX_ROW;
+      philox4x32_10_batch((uint64_t)i * N + j0, 0, seed, n, r[0], r[1], r[2],
+                          r[3]);
+      for (int j = 0; j < n; j++) {
+        matrix[i][j0 + j] = philox_uniform(r[0][j]);
+      }
     }
   }
 }
 
+/* One contiguous block of rows from numa_alloc, pages not yet touched */
 double **malloc_matrix(size_t N) {
   double **matrix = (double **)malloc(N * sizeof(double *));
+  double *data = (double *)numa_alloc(N * N * sizeof(double));
 
   for (int i = 0; i < N; ++i) {
-    matrix[i] = (double *)malloc(N * sizeof(double));
+    matrix[i] = data + i * N;
   }
 
   return matrix;
 }
 
 void free_matrix(double **matrix, size_t N) {
+  numa_free(matrix[0]);
+  free(matrix);
+}
 
-  for (int i = 0; i < N; ++i) {
-    free(matrix[i]);
-  }
+static perf_region region_ijn = PERF_REGION_INIT("matmul ijn");
+static perf_region region_jin = PERF_REGION_INIT("matmul jin");
+static perf_region region_nij = PERF_REGION_INIT("matmul nij");
+static perf_region region_morton = PERF_REGION_INIT("matmul morton");
+static perf_region region_strassen = PERF_REGION_INIT("matmul strassen");
 
-  free(matrix);
+/* Every thread counts its share of the loop; the work is declared once:
+   2 N^3 flops and, at best, A and B read and C read and written once */
+static void declare_matmul_work(perf_region *region, size_t N) {
+  perf_work(region, 2.0 * N * N * N, 4.0 * sizeof(double) * N * N);
 }
 
 void MatMul_ijn(double **A, double **B, double **C, size_t N) {
-#pragma omp for nowait
+#pragma omp for schedule(static) nowait
   for (int i = 0; i < N; i++) {
     for (int j = 0; j < N; j++) {
       for (int n = 0; n < N; n++) {
@@ -54,7 +88,7 @@ void MatMul_ijn(double **A, double **B, double **C, size_t N) {
 }
 
 void MatMul_jin(double **A, double **B, double **C, size_t N) {
-#pragma omp for nowait
+#pragma omp for schedule(static) nowait
   for (int j = 0; j < N; j++) {
     for (int i = 0; i < N; i++) {
       for (int n = 0; n < N; n++) {
@@ -66,11 +100,13 @@ void MatMul_jin(double **A, double **B, double **C, size_t N) {
   return;
 }
 
+/* Every thread runs all of n; the rows i are shared out, the same static
+   split for every n, so each row of C has one writer and nowait is safe */
 void MatMul_nij(double **A, double **B, double **C, size_t N) {
-#pragma omp for nowait
-  for (int n = 0; n < N; n++) {
-    for (int i = 0; i < N; i++) {
-      for (int j = 0; j < N; j++) {
+  for (size_t n = 0; n < N; n++) {
+#pragma omp for schedule(static) nowait
+    for (size_t i = 0; i < N; i++) {
+      for (size_t j = 0; j < N; j++) {
         C[i][j] += A[i][n] * B[n][j];
       }
     }
@@ -79,8 +115,45 @@ void MatMul_nij(double **A, double **B, double **C, size_t N) {
   return;
 }
 
-int main() {
-  const size_t N = 1000; // size of an array
+/* Normwise error of C as A * B: |C x - A (B x)| / (|A| |B| |x|) in the
+   max norm for x = (1, -1, 1, ...), with products in long double. O(N^2),
+   and the classical bound is about N times the unit roundoff. */
+double matmul_error(double **A, double **B, double **C, size_t N) {
+  long double *bx = malloc(N * sizeof(long double));
+  long double *babs = malloc(N * sizeof(long double));
+  double error = 0, scale = 0;
+
+#pragma omp parallel for schedule(static)
+  for (size_t i = 0; i < N; i++) {
+    long double sum = 0, sum_abs = 0;
+    for (size_t j = 0; j < N; j++) {
+      sum += (long double)B[i][j] * (j % 2 ? -1 : 1);
+      sum_abs += fabs(B[i][j]);
+    }
+    bx[i] = sum;
+    babs[i] = sum_abs;
+  }
+
+#pragma omp parallel for schedule(static) reduction(max : error, scale)
+  for (size_t i = 0; i < N; i++) {
+    long double abx = 0, cx = 0, bound = 0;
+    for (size_t j = 0; j < N; j++) {
+      abx += A[i][j] * bx[j];
+      bound += fabs(A[i][j]) * babs[j];
+      cx += (long double)C[i][j] * (j % 2 ? -1 : 1);
+    }
+    const double diff = fabsl(cx - abx);
+    error = diff > error ? diff : error;
+    scale = bound > scale ? bound : scale;
+  }
+
+  free(bx);
+  free(babs);
+  return error / scale;
+}
+
+int main(int argc, char *argv[]) {
+  const size_t N = argc > 1 ? atol(argv[1]) : 1000; // size of an array
 
   double start, end;
 
@@ -88,6 +161,9 @@ int main() {
 
   printf("Starting:\n");
 
+  /* before the first touch, so pages stay next to their threads */
+  numa_bind_threads();
+
   A = malloc_matrix(N);
   B = malloc_matrix(N);
   C = malloc_matrix(N);
@@ -99,29 +175,99 @@ int main() {
   start = omp_get_wtime();
   //  matrix multiplication algorithm
 #pragma omp parallel shared(A, B, C)
-  { MatMul_ijn(A, B, C, N); }
+  {
+    perf_scope scope = perf_begin(&region_ijn);
+    MatMul_ijn(A, B, C, N);
+    perf_end(&scope);
+  }
+  declare_matmul_work(&region_ijn, N);
 
   end = omp_get_wtime();
 
-  printf("Time elapsed (ijn): %f seconds.\n", end - start);
+  printf("Time elapsed (ijn): %f seconds, error %.2e.\n", end - start,
+         matmul_error(A, B, C, N));
 
+  zero_init_matrix(C, N);
   start = omp_get_wtime();
   //  matrix multiplication algorithm
 #pragma omp parallel shared(A, B, C)
-  { MatMul_jin(A, B, C, N); }
+  {
+    perf_scope scope = perf_begin(&region_jin);
+    MatMul_jin(A, B, C, N);
+    perf_end(&scope);
+  }
+  declare_matmul_work(&region_jin, N);
 
   end = omp_get_wtime();
 
-  printf("Time elapsed (jin): %f seconds.\n", end - start);
+  printf("Time elapsed (jin): %f seconds, error %.2e.\n", end - start,
+         matmul_error(A, B, C, N));
 
+  zero_init_matrix(C, N);
   start = omp_get_wtime();
   //  matrix multiplication algorithm
 #pragma omp parallel shared(A, B, C)
-  { MatMul_nij(A, B, C, N); }
+  {
+    perf_scope scope = perf_begin(&region_nij);
+    MatMul_nij(A, B, C, N);
+    perf_end(&scope);
+  }
+  declare_matmul_work(&region_nij, N);
+
+  end = omp_get_wtime();
+
+  printf("Time elapsed (nij): %f seconds, error %.2e.\n", end - start,
+         matmul_error(A, B, C, N));
 
+  /* recursive and Strassen-Winograd on the Morton layout, conversions
+     timed separately */
+  const size_t n = morton_tiles(N), used = morton_used_tiles(N);
+  double *Am = morton_alloc(n), *Bm = morton_alloc(n), *Cm = morton_alloc(n);
+
+  start = omp_get_wtime();
+  morton_from_rows(Am, A, N, n);
+  morton_from_rows(Bm, B, N, n);
   end = omp_get_wtime();
+  printf("Morton layout, %zu x %zu tiles of %d: conversion %f seconds.\n", n,
+         n, MORTON_TILE, end - start);
+
+  memset(Cm, 0, n * n * MORTON_TILE_SIZE * sizeof(double));
+  start = omp_get_wtime();
+  {
+    perf_scope scope = perf_begin(&region_morton);
+    morton_multiply(Cm, Am, Bm, n, used);
+    perf_end(&scope);
+  }
+  end = omp_get_wtime();
+  declare_matmul_work(&region_morton, N);
+  morton_to_rows(C, Cm, N, n);
+  printf("Time elapsed (recursive): %f seconds, error %.2e.\n", end - start,
+         matmul_error(A, B, C, N));
+
+  /* below n only when Strassen-Winograd was measured faster at this shape */
+  const size_t threshold = morton_tune_strassen(Cm, Am, Bm, n, used);
+  if (threshold < n) {
+    start = omp_get_wtime();
+    {
+      perf_scope scope = perf_begin(&region_strassen);
+      morton_strassen(Cm, Am, Bm, n, used, threshold);
+      perf_end(&scope);
+    }
+    end = omp_get_wtime();
+    declare_matmul_work(&region_strassen, N);
+    morton_to_rows(C, Cm, N, n);
+    printf("Time elapsed (Strassen-Winograd down to %zu): %f seconds, error "
+           "%.2e.\n",
+           threshold * MORTON_TILE, end - start, matmul_error(A, B, C, N));
+  } else {
+    printf("Strassen-Winograd is not faster at N = %zu here.\n", N);
+  }
+
+  free(Am);
+  free(Bm);
+  free(Cm);
 
-  printf("Time elapsed (nij): %f seconds.\n", end - start);
+  perf_report(stdout);
 
   free_matrix(A, N);
   free_matrix(B, N);
@@ -1,6 +1,18 @@
 #include <omp.h>
 #include <iostream>
 #include <stdio.h>
+#include <time.h>
+
+#include "trace.hpp"
+
+// CPU time of the calling thread: on few cores the wall time would include
+// the trace drain thread, which runs outside the traced code
+double thread_seconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec + 1e-9 * ts.tv_nsec;
+}
 
 int main(int argc, char ** argv)
 {
@@ -34,5 +46,56 @@ int main(int argc, char ** argv)
         }
     }
 
+    // no lock at all: every thread fills its own buffer, a background
+    // thread prints the messages and writes them to a Chrome trace
+    Trace &trace = Trace::Get();
+    trace.Start("outmes_trace.json");
+#pragma omp parallel private(tid)
+    {
+        tid = omp_get_thread_num();
+        trace.Message("trace %d hello world", tid);
+    }
+    trace.Stop();
+
+    // cost of a message per thread: critical printf against the trace buffer
+    const int messages = argc > 1 ? atoi(argv[1]) : 10000;
+    FILE *sink = fopen("/dev/null", "w");
+
+    double critical_time = 0;
+#pragma omp parallel private(tid) reduction(+ : critical_time)
+    {
+        tid = omp_get_thread_num();
+        double start = thread_seconds();
+        for (int i = 0; i < messages; ++i)
+        {
+#pragma omp critical
+            fprintf(sink, "critical %d message %d\n", tid, i);
+        }
+        critical_time = thread_seconds() - start;
+    }
+
+    trace.Start("outmes_bench.json", 0, false);
+    double trace_time = 0;
+#pragma omp parallel private(tid) reduction(+ : trace_time)
+    {
+        tid = omp_get_thread_num();
+        double start = thread_seconds();
+        for (int i = 0; i < messages; ++i)
+        {
+            trace.Message("trace %d message %d", tid, i);
+        }
+        trace_time = thread_seconds() - start;
+    }
+    trace.Stop();
+    fclose(sink);
+
+    const int threads = omp_get_max_threads();
+    printf("%d messages x %d threads, CPU per message: critical printf "
+           "%.1f ns, trace %.1f ns (%llu written, %llu dropped)\n",
+           messages, threads, 1e9 * critical_time / messages / threads,
+           1e9 * trace_time / messages / threads,
+           (unsigned long long)trace.Written(),
+           (unsigned long long)trace.Dropped());
+
     return 0;
 }
\ No newline at end of file
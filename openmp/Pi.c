@@ -1,8 +1,18 @@
 #include <omp.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <time.h>
 
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+#include "philox.h"
+
+/* Philox counters per batch, every counter gives two samples */
+#define PI_BLOCK 1024
+
 double pi_single_thread(const size_t N) {
   srand(time(NULL));
   double d, x, y, pi;
@@ -46,7 +56,78 @@ double pi_omp(const size_t N) {
   return pi;
 }
 
-int main() {
+/* Samples [2 * first, 2 * last) of the Philox stream falling in the quadrant */
+uint64_t count_in_quadrant(uint64_t first, uint64_t last, uint64_t seed) {
+  uint64_t in_quadrant = 0;
+  uint64_t blocks = (last - first + PI_BLOCK - 1) / PI_BLOCK;
+
+#pragma omp parallel for schedule(static) reduction(+ : in_quadrant)
+  for (uint64_t b = 0; b < blocks; ++b) {
+    uint32_t r0[PI_BLOCK], r1[PI_BLOCK], r2[PI_BLOCK], r3[PI_BLOCK];
+    uint64_t begin = first + b * PI_BLOCK;
+    size_t n = last - begin < PI_BLOCK ? last - begin : PI_BLOCK;
+    philox4x32_10_batch(begin, 0, seed, n, r0, r1, r2, r3);
+
+    uint64_t count = 0;
+#pragma omp simd reduction(+ : count)
+    for (size_t i = 0; i < n; ++i) {
+      double x0 = philox_uniform(r0[i]), y0 = philox_uniform(r1[i]);
+      double x1 = philox_uniform(r2[i]), y1 = philox_uniform(r3[i]);
+      count += (x0 * x0 + y0 * y0 <= 1) + (x1 * x1 + y1 * y1 <= 1);
+    }
+    in_quadrant += count;
+  }
+  return in_quadrant;
+}
+
+/*
+ * Sample i is a pure function of (seed, i), and counts are integers, so the
+ * estimate is bit-identical for any number of threads and ranks.
+ * N is rounded up to an even number of samples.
+ */
+double pi_philox(const size_t N, uint64_t seed) {
+  uint64_t counters = (N + 1) / 2;
+  uint64_t first = 0, last = counters;
+
+#ifdef USE_MPI
+  int rank, size;
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+  first = counters * rank / size;
+  last = counters * (rank + 1) / size;
+#endif
+
+  uint64_t in_quadrant = count_in_quadrant(first, last, seed);
+
+#ifdef USE_MPI
+  MPI_Allreduce(MPI_IN_PLACE, &in_quadrant, 1, MPI_UINT64_T, MPI_SUM,
+                MPI_COMM_WORLD);
+#endif
+
+  return 4.0 * in_quadrant / (2 * counters);
+}
+
+/* Known answers from the Random123 distribution */
+int philox_self_test() {
+  philox4x32_ctr zero = {{0, 0, 0, 0}};
+  philox4x32_key zero_key = {{0, 0}};
+  philox4x32_ctr ones = {{0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff}};
+  philox4x32_key ones_key = {{0xffffffff, 0xffffffff}};
+  philox4x32_ctr a = philox4x32_10(zero, zero_key);
+  philox4x32_ctr b = philox4x32_10(ones, ones_key);
+  return a.v[0] == 0x6627e8d5 && a.v[1] == 0xe169c58d &&
+         a.v[2] == 0xbc57ac4c && a.v[3] == 0x9b00dbd8 &&
+         b.v[0] == 0x408f276d && b.v[1] == 0x41c83b0e &&
+         b.v[2] == 0xa20bc7c6 && b.v[3] == 0x6d5451fd;
+}
+
+int main(int argc, char *argv[]) {
+  int rank = 0;
+#ifdef USE_MPI
+  MPI_Init(&argc, &argv);
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+
   const size_t N = 1000000;
   double step;
 
@@ -69,5 +150,31 @@ int main() {
 
   printf("pi = %.16f\n", pi);
 
+  const size_t N_philox = argc > 1 ? strtoull(argv[1], NULL, 10) : 1000000000;
+  const uint64_t seed = 2021;
+
+  // the same samples with one thread and with all of them
+  int threads = omp_get_max_threads();
+  omp_set_num_threads(1);
+  double pi_one = pi_philox(N_philox / 100, seed);
+  omp_set_num_threads(threads);
+  double pi_all = pi_philox(N_philox / 100, seed);
+
+  start = omp_get_wtime();
+  pi = pi_philox(N_philox, seed);
+  end = omp_get_wtime();
+
+  if (rank == 0) {
+    printf("Philox known answers: %s\n", philox_self_test() ? "ok" : "FAILED");
+    printf("Same estimate with 1 and %d threads: %s\n", threads,
+           pi_one == pi_all ? "yes" : "NO");
+    printf("Time elapsed (philox, %zu samples): %f seconds, %.3f Gsamples/s.\n",
+           N_philox, end - start, N_philox / (end - start) * 1e-9);
+    printf("pi = %.16f\n", pi);
+  }
+
+#ifdef USE_MPI
+  MPI_Finalize();
+#endif
   return 0;
 }
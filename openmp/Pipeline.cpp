@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <iostream>
+#include <vector>
+
+#include <omp.h>
+
+#include "pipeline.hpp"
+
+using std::cout, std::endl, std::vector;
+
+PPMImage AllocPPM(int x, int y) {
+  PPMImage img;
+  img.x = x;
+  img.y = y;
+  img.all = x * y;
+  img.data = new PPMPixel[img.all];
+  return img;
+}
+
+bool SamePPM(const PPMImage &a, const PPMImage &b) {
+  for (int i = 0; i < a.all; ++i) {
+    if (a.data[i].red != b.data[i].red || a.data[i].green != b.data[i].green ||
+        a.data[i].blue != b.data[i].blue) {
+      return false;
+    }
+  }
+  return true;
+}
+
+using Chain = void (*)(Pipeline &, PPMImage &, uint64_t *);
+
+/// Blur, cartoon median, histogram, shift and store the car
+void CartoonChain(Pipeline &pipeline, PPMImage &dst, uint64_t *hist) {
+  pipeline.Gaussian(1.0).Median(3).Histogram(hist).Shift(dst.x / 3).Write(
+      dst, dst.all / 2);
+}
+
+/// Cheap stages, here the memory traffic of the intermediates dominates
+void GrayChain(Pipeline &pipeline, PPMImage &dst, uint64_t *hist) {
+  pipeline.Gray().Box(1).Histogram(hist).Shift(dst.x / 3).Write(dst);
+}
+
+void Benchmark(const char *name, Chain chain, const PPMImage &src) {
+  const int repeats = 3;
+  PPMImage fused = AllocPPM(src.x, src.y), staged = AllocPPM(src.x, src.y);
+  vector<uint64_t> fused_hist(256), staged_hist(256);
+  Pipeline fused_pipeline(src), staged_pipeline(src);
+  chain(fused_pipeline, fused, fused_hist.data());
+  chain(staged_pipeline, staged, staged_hist.data());
+
+  double start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+    staged_pipeline.RunStaged();
+  }
+  double staged_time = (omp_get_wtime() - start) / repeats;
+
+  start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+    fused_pipeline.Run();
+  }
+  double fused_time = (omp_get_wtime() - start) / repeats;
+
+  bool ok = SamePPM(fused, staged) && fused_hist == staged_hist;
+  double mpix = src.all * 1e-6;
+  printf("%s chain, results match: %s\n", name, ok ? "yes" : "NO");
+  printf("  stage by stage: %8.4f s %8.2f Mpix/s\n", staged_time,
+         mpix / staged_time);
+  printf("  fused tiles:    %8.4f s %8.2f Mpix/s\n", fused_time,
+         mpix / fused_time);
+
+  delete[] fused.data;
+  delete[] staged.data;
+}
+
+int main(int argc, char *argv[]) {
+  const char *filename = argc > 1 ? argv[1] : "car.ppm";
+  PPMImage src;
+  readPPM(filename, src);
+  // tile the picture up to a few megapixels so it does not fit in cache
+  int scale = argc > 2 ? atoi(argv[2]) : 8;
+  PPMImage big = AllocPPM(src.x * scale, src.y * scale);
+  for (int y = 0; y < big.y; ++y) {
+    for (int x = 0; x < big.x; ++x) {
+      big.data[(long)y * big.x + x] = src.data[(y % src.y) * src.x + x % src.x];
+    }
+  }
+
+  printf("%dx%d image, %d threads\n", big.x, big.y, omp_get_max_threads());
+  Benchmark("cartoon", CartoonChain, big);
+  Benchmark("gray", GrayChain, big);
+
+  // the same chain on the original picture
+  PPMImage out = AllocPPM(src.x, src.y);
+  Pipeline pipeline(src);
+  vector<uint64_t> hist(256);
+  CartoonChain(pipeline, out, hist.data());
+  pipeline.Run();
+  writePPM("car_pipeline.ppm", out);
+
+  delete[] src.data;
+  delete[] big.data;
+  delete[] out.data;
+  return 0;
+}
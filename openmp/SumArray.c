@@ -2,6 +2,32 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include "reduce.h"
+
+/* values of very different magnitude, where the order of additions matters */
+void fill_doubles(double *x, size_t n)
+{
+    srand(1);
+    for (size_t i = 0; i < n; ++i)
+    {
+        double v = (double)rand() / RAND_MAX - 0.5;
+        x[i] = (i % 1000 == 0) ? v * 1e12 : v;
+    }
+}
+
+double plain_sum(const double *x, size_t n)
+{
+    double sum = 0;
+
+#pragma omp parallel for reduction(+: sum)
+    for (size_t i = 0; i < n; ++i)
+    {
+        sum += x[i];
+    }
+
+    return sum;
+}
+
 int main(int argc, char ** argv)
 {
     const size_t N = 10000;
@@ -24,5 +50,50 @@ int main(int argc, char ** argv)
 
     printf("sum = %d\n", sum);
 
+    // the same for doubles: plain reduction against reduce.h
+    const size_t M = argc > 1 ? strtoull(argv[1], NULL, 10) : 50000000;
+    double *x = (double *)malloc(M * sizeof(double));
+    fill_doubles(x, M);
+
+    int max_threads = omp_get_max_threads();
+    printf("%8s %24s %24s\n", "threads", "reduction(+)", "reduce_sum");
+    for (int threads = 1; threads <= 8; threads *= 2)
+    {
+        omp_set_num_threads(threads);
+        printf("%8d %24.10f %24.10f\n", threads, plain_sum(x, M),
+               reduce_sum(x, M));
+    }
+    omp_set_num_threads(max_threads);
+
+    // overhead against the plain loop, best of 5
+    const int repeats = 5;
+    double best[4] = {1e30, 1e30, 1e30, 1e30};
+    volatile double sink = 0;
+    for (int r = 0; r < repeats; ++r)
+    {
+        double start = omp_get_wtime();
+        sink += plain_sum(x, M);
+        double t1 = omp_get_wtime();
+        sink += reduce_sum(x, M);
+        double t2 = omp_get_wtime();
+        sink += reduce_dot(x, x, M);
+        double t3 = omp_get_wtime();
+        sink += reduce_sum_pairwise(x, M);
+        double t4 = omp_get_wtime();
+        double times[4] = {t1 - start, t2 - t1, t3 - t2, t4 - t3};
+        for (int k = 0; k < 4; ++k)
+        {
+            best[k] = times[k] < best[k] ? times[k] : best[k];
+        }
+    }
+
+    double gb = M * sizeof(double) * 1e-9;
+    printf("%zu doubles, %d threads\n", M, max_threads);
+    printf("reduction(+):        %f s %6.2f GB/s\n", best[0], gb / best[0]);
+    printf("reduce_sum:          %f s %6.2f GB/s\n", best[1], gb / best[1]);
+    printf("reduce_dot (x, x):   %f s %6.2f GB/s\n", best[2], 2 * gb / best[2]);
+    printf("pairwise (1 thread): %f s %6.2f GB/s\n", best[3], gb / best[3]);
+
+    free(x);
     return 0;
-}
\ No newline at end of file
+}
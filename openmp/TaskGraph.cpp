@@ -0,0 +1,170 @@
+// ParSec.c as a task graph, and a multi-step vector pipeline run as one
+// OpenMP region per operation against the fused graph.
+// Usage: TaskGraph [N] [repeats]
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <omp.h>
+
+#include "task_graph.hpp"
+
+using std::vector;
+
+/// c = a + b and d = a * b from ParSec.c: instead of two sections (two
+/// threads at most) both become kernels of one pass over all threads
+bool Sections() {
+  const long N = 20;
+  vector<double> a(N), b(N), c(N), d(N);
+  TaskGraph graph;
+  auto va = graph.Vector(a.data(), N), vb = graph.Vector(b.data(), N);
+  auto vc = graph.Vector(c.data(), N), vd = graph.Vector(d.data(), N);
+  vector<double> index(N);
+  for (long i = 0; i < N; ++i) {
+    index[i] = i;
+  }
+  auto vi = graph.Vector(index.data(), N);
+  graph.Map(va, [](double i) { return i; }, vi);
+  graph.Map(vb, [N](double i) { return N - i; }, vi);
+  graph.Map(vc, [](double x, double y) { return x + y; }, va, vb);
+  graph.Map(vd, [](double x, double y) { return x * y; }, va, vb);
+  graph.Run();
+
+  bool ok = graph.Passes() == 1;
+  for (long i = 0; i < N; ++i) {
+    ok = ok && c[i] == N && d[i] == i * (N - i);
+  }
+  return ok;
+}
+
+/// A sum feeding an element-wise kernel and an opaque task in between: three
+/// passes and a task, results as computed in order
+bool Dependencies() {
+  const long N = 100000;
+  vector<double> x(N), y(N), z(N);
+  double s = 0, t = 0;
+  TaskGraph graph;
+  auto vx = graph.Vector(x.data(), N), vy = graph.Vector(y.data(), N);
+  auto vz = graph.Vector(z.data(), N);
+  auto vs = graph.Scalar(&s), vt = graph.Scalar(&t);
+  graph.Map(vx, [](double) { return 1.0; }, vx);
+  graph.Reduce(vs, [](double x) { return x; }, vx);
+  graph.Map(vy, [](double x, double s) { return x * s; }, vx, vs);
+  graph.Task([&] { y[0] = 0; }, {vy.id}, {vy.id});
+  graph.Map(vz, [](double y) { return 2 * y; }, vy);
+  graph.Reduce(vt, [](double z) { return z; }, vz);
+
+  bool ok = graph.Passes() == 4;
+  for (auto backend : {TaskGraph::Backend::OpenMP, TaskGraph::Backend::Pool}) {
+    t = 0;
+    graph.Run(backend);
+    ok = ok && s == N && t == 2.0 * N * (N - 1);
+  }
+  return ok;
+}
+
+/// One damped Jacobi-like step on vectors, five operations:
+///   r = b - x * diag      residual of a diagonal system
+///   rr = r . r            its norm
+///   x = x + w * r / diag  update
+///   e = x - x_true        error
+///   ee = e . e
+struct Step {
+  long N;
+  double w = 0.5;
+  vector<double> x, b, diag, x_true, r, e;
+  double rr = 0, ee = 0;
+
+  explicit Step(long N)
+      : N(N), x(N), b(N), diag(N), x_true(N), r(N), e(N) {
+    for (long i = 0; i < N; ++i) {
+      diag[i] = 2 + std::sin(i);
+      x_true[i] = std::cos(i);
+      b[i] = diag[i] * x_true[i];
+    }
+  }
+
+  void Regions() {
+    rr = 0;
+    ee = 0;
+#pragma omp parallel for
+    for (long i = 0; i < N; ++i) {
+      r[i] = b[i] - x[i] * diag[i];
+    }
+#pragma omp parallel for reduction(+ : rr)
+    for (long i = 0; i < N; ++i) {
+      rr += r[i] * r[i];
+    }
+#pragma omp parallel for
+    for (long i = 0; i < N; ++i) {
+      x[i] += w * r[i] / diag[i];
+    }
+#pragma omp parallel for
+    for (long i = 0; i < N; ++i) {
+      e[i] = x[i] - x_true[i];
+    }
+#pragma omp parallel for reduction(+ : ee)
+    for (long i = 0; i < N; ++i) {
+      ee += e[i] * e[i];
+    }
+  }
+
+  void Build(TaskGraph &graph) {
+    auto vx = graph.Vector(x.data(), N), vb = graph.Vector(b.data(), N);
+    auto vd = graph.Vector(diag.data(), N);
+    auto vt = graph.Vector(x_true.data(), N);
+    auto vr = graph.Vector(r.data(), N), ve = graph.Vector(e.data(), N);
+    auto srr = graph.Scalar(&rr), see = graph.Scalar(&ee);
+    const double w = this->w;
+    graph.Map(vr, [](double b, double x, double d) { return b - x * d; }, vb,
+              vx, vd);
+    graph.Reduce(srr, [](double r) { return r * r; }, vr);
+    graph.Map(vx, [w](double x, double r, double d) { return x + w * r / d; },
+              vx, vr, vd);
+    graph.Map(ve, [](double x, double t) { return x - t; }, vx, vt);
+    graph.Reduce(see, [](double e) { return e * e; }, ve);
+  }
+};
+
+int main(int argc, char *argv[]) {
+  const long N = argc > 1 ? std::stol(argv[1]) : 10000000;
+  const int repeats = argc > 2 ? std::stoi(argv[2]) : 20;
+
+  printf("ParSec sections as a graph: %s\n", Sections() ? "ok" : "FAILED");
+  printf("dependencies: %s\n", Dependencies() ? "ok" : "FAILED");
+
+  Step regions(N), omp_graph(N), pool_graph(N);
+  TaskGraph graph_omp, graph_pool;
+  omp_graph.Build(graph_omp);
+  pool_graph.Build(graph_pool);
+  printf("%d kernels in %d pass(es), N = %ld, %d threads\n",
+         graph_omp.Kernels(), graph_omp.Passes(), N, omp_get_max_threads());
+
+  double start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+    regions.Regions();
+  }
+  double regions_time = (omp_get_wtime() - start) / repeats;
+
+  start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+    graph_omp.Run(TaskGraph::Backend::OpenMP);
+  }
+  double omp_time = (omp_get_wtime() - start) / repeats;
+
+  start = omp_get_wtime();
+  for (int k = 0; k < repeats; ++k) {
+    graph_pool.Run(TaskGraph::Backend::Pool);
+  }
+  double pool_time = (omp_get_wtime() - start) / repeats;
+
+  printf("%-24s %12s %14s\n", "", "ms/step", "|e|^2");
+  printf("%-24s %12.3f %14g\n", "5 parallel regions", 1e3 * regions_time,
+         regions.ee);
+  printf("%-24s %12.3f %14g\n", "graph, OpenMP tasks", 1e3 * omp_time,
+         omp_graph.ee);
+  printf("%-24s %12.3f %14g\n", "graph, thread pool", 1e3 * pool_time,
+         pool_graph.ee);
+  return 0;
+}
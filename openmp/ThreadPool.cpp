@@ -0,0 +1,162 @@
+// Fork/join overhead of per-sweep OpenMP regions against the persistent pool,
+// plus checks of ParallelReduce and task dependencies.
+// Usage: ThreadPool [threads] [iterations]
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <omp.h>
+
+#include "thread_pool.hpp"
+
+using std::vector;
+
+/// Jacobi sweeps as in Axisb.cpp: copy, update, distance; three regions per
+/// iteration like the original solver
+double SweepsOmp(const vector<double> &A, const vector<double> &b,
+                 vector<double> &x, vector<double> &x_prev, int N, int threads,
+                 int iterations) {
+  double norm = 0;
+  for (int it = 0; it < iterations; ++it) {
+#pragma omp parallel for num_threads(threads)
+    for (int i = 0; i < N; ++i) {
+      x_prev[i] = x[i];
+    }
+#pragma omp parallel for num_threads(threads)
+    for (int i = 0; i < N; ++i) {
+      double var = 0;
+      for (int j = 0; j < N; ++j) {
+        if (j != i) {
+          var += A[i * N + j] * x_prev[j];
+        }
+      }
+      x[i] = (b[i] - var) / A[i * N + i];
+    }
+    norm = 0;
+#pragma omp parallel for num_threads(threads) reduction(+ : norm)
+    for (int i = 0; i < N; ++i) {
+      norm += (x[i] - x_prev[i]) * (x[i] - x_prev[i]);
+    }
+  }
+  return norm;
+}
+
+double SweepsPool(ThreadPool &pool, const vector<double> &A,
+                  const vector<double> &b, vector<double> &x,
+                  vector<double> &x_prev, int N, int iterations) {
+  double norm = 0;
+  for (int it = 0; it < iterations; ++it) {
+    pool.ParallelFor(0, N, [&](long i) { x_prev[i] = x[i]; });
+    pool.ParallelFor(0, N, [&](long i) {
+      double var = 0;
+      for (int j = 0; j < N; ++j) {
+        if (j != i) {
+          var += A[i * N + j] * x_prev[j];
+        }
+      }
+      x[i] = (b[i] - var) / A[i * N + i];
+    });
+    norm = pool.ParallelReduce(
+        0, N, 0.0,
+        [&](long first, long last) {
+          double s = 0;
+          for (long i = first; i < last; ++i) {
+            s += (x[i] - x_prev[i]) * (x[i] - x_prev[i]);
+          }
+          return s;
+        },
+        [](double l, double r) { return l + r; });
+  }
+  return norm;
+}
+
+void Problem(int N, vector<double> &A, vector<double> &b) {
+  A.assign((long)N * N, 0);
+  b.assign(N, 0);
+  for (int i = 0; i < N; ++i) {
+    for (int j = 0; j < N; ++j) {
+      A[i * N + j] = std::sin(i + 2.0 * j);
+    }
+    A[i * N + i] = 2.0 * N;
+    b[i] = i;
+  }
+}
+
+/// Diamond a -> (b, c) -> d repeated: d must see both b and c
+bool CheckDependencies(ThreadPool &pool, int rounds) {
+  for (int r = 0; r < rounds; ++r) {
+    std::atomic<int> value{0};
+    int seen = -1;
+    auto a = pool.Spawn([&] { value = 1; });
+    auto b = pool.Spawn([&] { value.fetch_add(10); }, {a});
+    auto c = pool.Spawn([&] { value.fetch_add(100); }, {a});
+    auto d = pool.Spawn([&] { seen = value; }, {b, c});
+    pool.Wait(d);
+    if (seen != 111) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool CheckReduce(ThreadPool &pool) {
+  const long n = 1000003;
+  long sum = pool.ParallelReduce(
+      0, n, 0L,
+      [](long first, long last) {
+        long s = 0;
+        for (long i = first; i < last; ++i) {
+          s += i;
+        }
+        return s;
+      },
+      [](long l, long r) { return l + r; }, 1000);
+
+  // nested: a parallel for inside every iteration of another one
+  std::atomic<long> count{0};
+  pool.ParallelFor(0, 64, [&](long) {
+    pool.ParallelFor(0, 1000, [&](long) { count.fetch_add(1); });
+  });
+  return sum == n * (n - 1) / 2 && count == 64000;
+}
+
+int main(int argc, char *argv[]) {
+  const int threads =
+      argc > 1 ? std::stoi(argv[1]) : std::thread::hardware_concurrency();
+  const int iterations = argc > 2 ? std::stoi(argv[2]) : 2000;
+  ThreadPool pool(threads);
+
+  printf("%d threads on %u cores\n", threads,
+         std::thread::hardware_concurrency());
+  printf("ParallelReduce and nested ParallelFor: %s\n",
+         CheckReduce(pool) ? "ok" : "FAILED");
+  printf("task dependencies: %s\n",
+         CheckDependencies(pool, 1000) ? "ok" : "FAILED");
+
+  printf("%8s %16s %16s %10s\n", "N", "omp, us/iter", "pool, us/iter",
+         "speedup");
+  for (int N : {16, 64, 256, 1024}) {
+    vector<double> A, b;
+    Problem(N, A, b);
+    vector<double> x(N), x_prev(N);
+
+    double start = omp_get_wtime();
+    double norm_omp = SweepsOmp(A, b, x, x_prev, N, threads, iterations);
+    double omp_time = omp_get_wtime() - start;
+
+    std::fill(x.begin(), x.end(), 0);
+    start = omp_get_wtime();
+    double norm_pool = SweepsPool(pool, A, b, x, x_prev, N, iterations);
+    double pool_time = omp_get_wtime() - start;
+
+    printf("%8d %16.2f %16.2f %10.2f%s\n", N, 1e6 * omp_time / iterations,
+           1e6 * pool_time / iterations, omp_time / pool_time,
+           std::abs(norm_omp - norm_pool) <= 1e-12 * (1 + norm_omp)
+               ? ""
+               : "  MISMATCH");
+  }
+  return 0;
+}
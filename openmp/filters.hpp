@@ -0,0 +1,337 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include <omp.h>
+
+#include "ppm.hpp"
+
+// Filters work on planar channels: one contiguous w*h array per colour, so the
+// inner loops run over contiguous x and vectorize. Borders are replicated.
+
+/// Rows per tile: a tile and its halo should stay in L2 while being filtered
+static const int FILTER_TILE_ROWS = 32;
+/// Median filter tiles, the column histograms of one tile fit in L2
+static const int MEDIAN_TILE_COLS = 256;
+static const int MEDIAN_TILE_ROWS = 128;
+
+template <typename T> void SplitChannels(const PPMImage &img, T *planes[3]) {
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < img.all; ++i) {
+    planes[0][i] = (T)img.data[i].red;
+    planes[1][i] = (T)img.data[i].green;
+    planes[2][i] = (T)img.data[i].blue;
+  }
+}
+
+inline int ClampColor(float v) {
+  return std::min(RGB_COMPONENT_COLOR, std::max(0, (int)std::lround(v)));
+}
+
+template <typename T> void MergeChannels(T *const planes[3], PPMImage &img) {
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < img.all; ++i) {
+    img.data[i].red = ClampColor(planes[0][i]);
+    img.data[i].green = ClampColor(planes[1][i]);
+    img.data[i].blue = ClampColor(planes[2][i]);
+  }
+}
+
+/// Normalized 1-D Gaussian of radius ceil(3 sigma)
+inline std::vector<float> GaussianKernel(double sigma) {
+  int r = std::max(1, (int)std::ceil(3 * sigma));
+  std::vector<float> kernel(2 * r + 1);
+  double sum = 0;
+  for (int k = -r; k <= r; ++k) {
+    sum += kernel[k + r] = std::exp(-k * k / (2 * sigma * sigma));
+  }
+  for (auto &v : kernel) {
+    v /= sum;
+  }
+  return kernel;
+}
+
+/// Horizontal pass of a symmetric kernel over one row
+inline void ConvolveRow(const float *src, float *dst, int w,
+                        const std::vector<float> &kernel, float *line) {
+  const int r = (int)kernel.size() / 2;
+  for (int x = -r; x < w + r; ++x) {
+    line[x + r] = src[std::min(w - 1, std::max(0, x))];
+  }
+  std::fill(dst, dst + w, 0.f);
+  for (int k = 0; k <= 2 * r; ++k) {
+    const float wk = kernel[k];
+    const float *in = line + k;
+#pragma omp simd
+    for (int x = 0; x < w; ++x) {
+      dst[x] += wk * in[x];
+    }
+  }
+}
+
+/// Rows [y0, y1) of the separable convolution of a w x h plane, `dst` points
+/// at output row y0. `tmp` holds the horizontally filtered halo rows:
+/// (y1 - y0 + 2r) * w floats, `line` one padded row: w + 2r floats.
+inline void ConvolveRows(const float *src, float *dst, int w, int h, int y0,
+                         int y1, const std::vector<float> &kernel, float *tmp,
+                         float *line) {
+  const int r = (int)kernel.size() / 2;
+  for (int y = y0 - r; y < y1 + r; ++y) {
+    int sy = std::min(h - 1, std::max(0, y));
+    ConvolveRow(src + (long)sy * w, tmp + (long)(y - y0 + r) * w, w, kernel,
+                line);
+  }
+  for (int y = y0; y < y1; ++y) {
+    float *out = dst + (long)(y - y0) * w;
+    std::fill(out, out + w, 0.f);
+    for (int k = 0; k <= 2 * r; ++k) {
+      const float wk = kernel[k];
+      const float *in = tmp + (long)(y - y0 + k) * w;
+#pragma omp simd
+      for (int x = 0; x < w; ++x) {
+        out[x] += wk * in[x];
+      }
+    }
+  }
+}
+
+/// Separable Gaussian blur of one plane, tiles of rows in parallel
+inline void GaussianBlur(const float *src, float *dst, int w, int h,
+                         double sigma) {
+  const auto kernel = GaussianKernel(sigma);
+  const int r = (int)kernel.size() / 2;
+
+#pragma omp parallel
+  {
+    std::vector<float> tmp((long)(FILTER_TILE_ROWS + 2 * r) * w);
+    std::vector<float> line(w + 2 * r);
+#pragma omp for schedule(dynamic)
+    for (int y0 = 0; y0 < h; y0 += FILTER_TILE_ROWS) {
+      ConvolveRows(src, dst + (long)y0 * w, w, h, y0,
+                   std::min(h, y0 + FILTER_TILE_ROWS), kernel, tmp.data(),
+                   line.data());
+    }
+  }
+}
+
+/// Rows [y0, y1) of the (2r+1)^2 box blur by running sums, O(1) per pixel
+/// whatever the radius. `dst` and `tmp` as in ConvolveRows, `sums` w doubles.
+inline void BoxBlurRows(const float *src, float *dst, int w, int h, int y0,
+                        int y1, int r, float *tmp, double *sums) {
+  const float norm = 1.f / ((2 * r + 1) * (2 * r + 1));
+  for (int y = y0 - r; y < y1 + r; ++y) {
+    const float *in = src + (long)std::min(h - 1, std::max(0, y)) * w;
+    float *out = tmp + (long)(y - y0 + r) * w;
+    double sum = 0;
+    for (int x = -r; x <= r; ++x) {
+      sum += in[std::min(w - 1, std::max(0, x))];
+    }
+    for (int x = 0; x < w; ++x) {
+      out[x] = (float)sum;
+      sum += in[std::min(w - 1, x + r + 1)] - in[std::max(0, x - r)];
+    }
+  }
+
+  std::fill(sums, sums + w, 0.0);
+  for (int k = 0; k <= 2 * r; ++k) {
+    const float *in = tmp + (long)k * w;
+#pragma omp simd
+    for (int x = 0; x < w; ++x) {
+      sums[x] += in[x];
+    }
+  }
+  for (int y = y0; y < y1; ++y) {
+    float *out = dst + (long)(y - y0) * w;
+#pragma omp simd
+    for (int x = 0; x < w; ++x) {
+      out[x] = (float)sums[x] * norm;
+    }
+    if (y + 1 == y1) {
+      break;
+    }
+    const float *next = tmp + (long)(y - y0 + 2 * r + 1) * w;
+    const float *prev = tmp + (long)(y - y0) * w;
+#pragma omp simd
+    for (int x = 0; x < w; ++x) {
+      sums[x] += next[x] - prev[x];
+    }
+  }
+}
+
+/// Box blur of one plane with a (2r+1) x (2r+1) window
+inline void BoxBlur(const float *src, float *dst, int w, int h, int r) {
+#pragma omp parallel
+  {
+    std::vector<float> tmp((long)(FILTER_TILE_ROWS + 2 * r) * w);
+    std::vector<double> sums(w);
+#pragma omp for schedule(dynamic)
+    for (int y0 = 0; y0 < h; y0 += FILTER_TILE_ROWS) {
+      BoxBlurRows(src, dst + (long)y0 * w, w, h, y0,
+                  std::min(h, y0 + FILTER_TILE_ROWS), r, tmp.data(),
+                  sums.data());
+    }
+  }
+}
+
+/// 256 fine and 16 coarse bins; counts fit in 16 bits for r <= 127
+struct MedianHistogram {
+  uint16_t coarse[16];
+  uint16_t fine[256];
+};
+
+inline void HistogramAdd(MedianHistogram &dst, const MedianHistogram &src) {
+#pragma omp simd
+  for (int i = 0; i < 16; ++i) {
+    dst.coarse[i] += src.coarse[i];
+  }
+#pragma omp simd
+  for (int i = 0; i < 256; ++i) {
+    dst.fine[i] += src.fine[i];
+  }
+}
+
+inline void HistogramSub(MedianHistogram &dst, const MedianHistogram &src) {
+#pragma omp simd
+  for (int i = 0; i < 16; ++i) {
+    dst.coarse[i] -= src.coarse[i];
+  }
+#pragma omp simd
+  for (int i = 0; i < 256; ++i) {
+    dst.fine[i] -= src.fine[i];
+  }
+}
+
+/// Value of the element with the given rank (0-based), coarse bins first
+inline uint8_t HistogramSelect(const MedianHistogram &hist, int rank) {
+  int c = 0;
+  while (rank >= hist.coarse[c]) {
+    rank -= hist.coarse[c++];
+  }
+  const uint16_t *fine = hist.fine + 16 * c;
+  int f = 0;
+  while (rank >= fine[f]) {
+    rank -= fine[f++];
+  }
+  return (uint8_t)(16 * c + f);
+}
+
+/// One tile of the constant-time median filter (Perreault and Hebert, 2007).
+/// `pad` is the plane padded by r on every side, width w + 2r.
+/// Column histograms are updated lazily, right before the kernel histogram
+/// slides over them, so each column is touched once per row while in cache.
+inline void MedianTile(const uint8_t *pad, uint8_t *dst, int w, int r, int x0,
+                       int x1, int y0, int y1,
+                       std::vector<MedianHistogram> &columns) {
+  const long pw = w + 2 * r;
+  const int nc = x1 - x0 + 2 * r;
+  const int rank = (2 * r + 1) * (2 * r + 1) / 2;
+  columns.assign(nc, MedianHistogram{});
+
+  for (int c = 0; c < nc; ++c) {
+    for (int y = y0; y < y0 + 2 * r; ++y) {
+      uint8_t v = pad[y * pw + x0 + c];
+      ++columns[c].coarse[v >> 4];
+      ++columns[c].fine[v];
+    }
+  }
+
+  auto update_column = [&](int c, int y) {
+    uint8_t v = pad[(y + 2 * r) * pw + x0 + c];
+    ++columns[c].coarse[v >> 4];
+    ++columns[c].fine[v];
+    if (y > y0) {
+      v = pad[(y - 1) * pw + x0 + c];
+      --columns[c].coarse[v >> 4];
+      --columns[c].fine[v];
+    }
+  };
+
+  MedianHistogram kernel;
+  for (int y = y0; y < y1; ++y) {
+    kernel = MedianHistogram{};
+    for (int c = 0; c <= 2 * r; ++c) {
+      update_column(c, y);
+      HistogramAdd(kernel, columns[c]);
+    }
+    uint8_t *out = dst + (long)y * w;
+    out[x0] = HistogramSelect(kernel, rank);
+    for (int x = x0 + 1; x < x1; ++x) {
+      const int c = x - x0 + 2 * r;
+      update_column(c, y);
+      HistogramAdd(kernel, columns[c]);
+      HistogramSub(kernel, columns[c - 2 * r - 1]);
+      out[x] = HistogramSelect(kernel, rank);
+    }
+  }
+}
+
+/// Median filter of one 8-bit plane with a (2r+1) x (2r+1) window,
+/// the cost per pixel does not depend on r
+inline void MedianFilter(const uint8_t *src, uint8_t *dst, int w, int h,
+                         int r) {
+  const long pw = w + 2 * r;
+  std::vector<uint8_t> pad(pw * (h + 2 * r));
+
+#pragma omp parallel for schedule(static)
+  for (int y = -r; y < h + r; ++y) {
+    const uint8_t *in = src + (long)std::min(h - 1, std::max(0, y)) * w;
+    uint8_t *out = pad.data() + (y + r) * pw;
+    std::fill(out, out + r, in[0]);
+    std::copy(in, in + w, out + r);
+    std::fill(out + r + w, out + pw, in[w - 1]);
+  }
+
+  const int tiles_x = (w + MEDIAN_TILE_COLS - 1) / MEDIAN_TILE_COLS;
+  const int tiles_y = (h + MEDIAN_TILE_ROWS - 1) / MEDIAN_TILE_ROWS;
+
+#pragma omp parallel
+  {
+    std::vector<MedianHistogram> columns;
+#pragma omp for schedule(dynamic) collapse(2)
+    for (int ty = 0; ty < tiles_y; ++ty) {
+      for (int tx = 0; tx < tiles_x; ++tx) {
+        int x0 = tx * MEDIAN_TILE_COLS, y0 = ty * MEDIAN_TILE_ROWS;
+        MedianTile(pad.data(), dst, w, r, x0,
+                   std::min(w, x0 + MEDIAN_TILE_COLS), y0,
+                   std::min(h, y0 + MEDIAN_TILE_ROWS), columns);
+      }
+    }
+  }
+}
+
+/// Apply a plane filter to every channel of an image.
+/// `dst` must have the size of `src` and its own pixel buffer.
+template <typename T, typename Filter>
+void FilterPPM(const PPMImage &src, PPMImage &dst, Filter filter) {
+  std::vector<T> in(3L * src.all), out(3L * src.all);
+  T *in_planes[3] = {in.data(), in.data() + src.all, in.data() + 2L * src.all};
+  T *out_planes[3] = {out.data(), out.data() + src.all,
+                      out.data() + 2L * src.all};
+  SplitChannels(src, in_planes);
+  for (int c = 0; c < 3; ++c) {
+    filter(in_planes[c], out_planes[c]);
+  }
+  MergeChannels(out_planes, dst);
+}
+
+inline void gaussianBlurPPM(const PPMImage &src, PPMImage &dst, double sigma) {
+  FilterPPM<float>(src, dst, [&](const float *in, float *out) {
+    GaussianBlur(in, out, src.x, src.y, sigma);
+  });
+}
+
+inline void boxBlurPPM(const PPMImage &src, PPMImage &dst, int r) {
+  FilterPPM<float>(src, dst, [&](const float *in, float *out) {
+    BoxBlur(in, out, src.x, src.y, r);
+  });
+}
+
+/// Median filter with a (2r+1) x (2r+1) window, r <= 127
+inline void medianFilterPPM(const PPMImage &src, PPMImage &dst, int r) {
+  FilterPPM<uint8_t>(src, dst, [&](const uint8_t *in, uint8_t *out) {
+    MedianFilter(in, out, src.x, src.y, r);
+  });
+}
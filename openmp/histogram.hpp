@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <omp.h>
+
+#include "ppm.hpp"
+
+// Every thread counts into its own copies of the histogram ("lanes"):
+// neighbouring pixels go to different lanes, so runs of equal values do not
+// serialise on a store-to-load dependency through the same counter. Lanes and
+// threads are merged at the end without atomics.
+
+static const int HISTOGRAM_LANES = 4;
+/// Pixels converted at once by the fused paths, stays in L1
+static const int HISTOGRAM_BLOCK = 1024;
+/// Private counters are 32-bit, flushed before they could overflow
+static const long HISTOGRAM_FLUSH = 1L << 30;
+
+/// Integer BT.601 luma, weights sum to 256
+inline int Gray(int red, int green, int blue) {
+  return (77 * red + 150 * green + 29 * blue + 128) >> 8;
+}
+
+/// Count `n` items into `hist` of `bins` 64-bit counters.
+/// `block(begin, end, lanes, stride)` counts items [begin, end) spread over
+/// HISTOGRAM_LANES lanes, lane l starting at lanes + l * stride. Items are split
+/// between threads statically, lanes and threads are summed afterwards.
+template <typename Block>
+void PrivateHistogram(long n, int bins, uint64_t *hist, Block block) {
+  std::fill(hist, hist + bins, 0);
+  const int threads = omp_get_max_threads();
+  std::vector<uint64_t> partial((long)threads * bins);
+
+#pragma omp parallel num_threads(threads)
+  {
+    const int tid = omp_get_thread_num();
+    const int team = omp_get_num_threads();
+    std::vector<uint32_t> lanes((long)HISTOGRAM_LANES * bins);
+    uint64_t *mine = partial.data() + (long)tid * bins;
+
+    long begin = n * tid / team, end = n * (tid + 1) / team;
+    while (begin < end) {
+      long stop = std::min(end, begin + HISTOGRAM_FLUSH);
+      std::fill(lanes.begin(), lanes.end(), 0);
+      block(begin, stop, lanes.data(), bins);
+      for (int l = 0; l < HISTOGRAM_LANES; ++l) {
+        for (int b = 0; b < bins; ++b) {
+          mine[b] += lanes[(long)l * bins + b];
+        }
+      }
+      begin = stop;
+    }
+
+#pragma omp barrier
+#pragma omp for schedule(static)
+    for (int b = 0; b < bins; ++b) {
+      uint64_t sum = 0;
+      for (int t = 0; t < team; ++t) {
+        sum += partial[(long)t * bins + b];
+      }
+      hist[b] = sum;
+    }
+  }
+}
+
+/// Count a block of precomputed bin indices into the lanes
+template <typename T>
+inline void CountLanes(const T *bins, long n, uint32_t *lanes, int stride) {
+  uint32_t *l0 = lanes, *l1 = lanes + stride, *l2 = lanes + 2L * stride,
+           *l3 = lanes + 3L * stride;
+  long i = 0;
+  for (; i + 4 <= n; i += 4) {
+    ++l0[bins[i]];
+    ++l1[bins[i + 1]];
+    ++l2[bins[i + 2]];
+    ++l3[bins[i + 3]];
+  }
+  for (; i < n; ++i) {
+    ++lanes[(i % HISTOGRAM_LANES) * (long)stride + bins[i]];
+  }
+}
+
+/// Histogram of an interleaved image with `channels` channels of `bits` bits
+/// (8 or 16-bit samples). `hist` gets channels * 2^bits counters, channel c
+/// starting at c * 2^bits. Values above 2^bits - 1 are wrapped.
+template <typename T>
+void ChannelHistogram(const T *data, long pixels, int channels, int bits,
+                      uint64_t *hist) {
+  const int bins = 1 << bits;
+  const uint32_t mask = bins - 1;
+  PrivateHistogram(
+      pixels * channels, channels * bins, hist,
+      [&](long begin, long end, uint32_t *lanes, int stride) {
+        if (channels == 1 && mask + 1 >= (1u << (8 * sizeof(T)))) {
+          CountLanes(data + begin, end - begin, lanes, stride);
+          return;
+        }
+        uint32_t index[HISTOGRAM_BLOCK];
+        for (long b = begin; b < end; b += HISTOGRAM_BLOCK) {
+          const int len = (int)std::min<long>(HISTOGRAM_BLOCK, end - b);
+          int c = b % channels;
+#pragma omp simd
+          for (int i = 0; i < len; ++i) {
+            index[i] = (data[b + i] & mask) +
+                       (uint32_t)((c + i) % channels) * (uint32_t)bins;
+          }
+          CountLanes(index, len, lanes, stride);
+        }
+      });
+}
+
+/// 256-bin histogram of the grayscale image of interleaved 8-bit RGB,
+/// converted block by block in registers and never stored as a whole
+inline void GrayHistogram(const uint8_t *rgb, long pixels, uint64_t *hist) {
+  PrivateHistogram(pixels, 256, hist,
+                   [&](long begin, long end, uint32_t *lanes, int stride) {
+                     uint8_t gray[HISTOGRAM_BLOCK];
+                     for (long b = begin; b < end; b += HISTOGRAM_BLOCK) {
+                       const int len =
+                           (int)std::min<long>(HISTOGRAM_BLOCK, end - b);
+                       const uint8_t *p = rgb + 3 * b;
+#pragma omp simd
+                       for (int i = 0; i < len; ++i) {
+                         gray[i] = (uint8_t)Gray(p[3 * i], p[3 * i + 1],
+                                                 p[3 * i + 2]);
+                       }
+                       CountLanes(gray, len, lanes, stride);
+                     }
+                   });
+}
+
+/// Same for the PPMImage layout used by readPPM
+inline void GrayHistogramPPM(const PPMImage &img, uint64_t *hist) {
+  PrivateHistogram(img.all, 256, hist,
+                   [&](long begin, long end, uint32_t *lanes, int stride) {
+                     uint8_t gray[HISTOGRAM_BLOCK];
+                     for (long b = begin; b < end; b += HISTOGRAM_BLOCK) {
+                       const int len =
+                           (int)std::min<long>(HISTOGRAM_BLOCK, end - b);
+                       const PPMPixel *p = img.data + b;
+#pragma omp simd
+                       for (int i = 0; i < len; ++i) {
+                         gray[i] = (uint8_t)std::min(
+                             255, Gray(p[i].red, p[i].green, p[i].blue));
+                       }
+                       CountLanes(gray, len, lanes, stride);
+                     }
+                   });
+}
@@ -0,0 +1,433 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include <omp.h>
+
+// Dense A x = b by LU with partial pivoting, and the mixed-precision solver
+// built on it.
+//
+// The factorization is right-looking and blocked: a panel of LU_PANEL
+// columns is factored column by column, the rows to its right are solved
+// with its unit lower triangle, and the trailing matrix gets the rank-
+// LU_PANEL update A22 -= L21 U12, which is nearly all of the 2/3 n^3 flops.
+// The update runs on LU_TILE_ROWS x LU_TILE_COLS tiles in parallel, each
+// through a register-blocked kernel, so it is compute bound and twice as
+// fast in float as in double (twice the SIMD lanes, half the bytes).
+//
+// MixedSolve factors A in float and recovers double accuracy by iterative
+// refinement: the residual r = b - A x is computed in double, the
+// correction solves A d = r with the float factors. Each step gains about
+// log10(1 / (cond(A) eps_float)) digits. If the corrections stop shrinking
+// (cond(A) near 1 / eps_float), the correction equation is solved instead
+// by GMRES in double, preconditioned by the float factors (GMRES-IR). In
+// theory that reaches condition numbers near 1 / eps_double; with GMRES(30)
+// it converges here up to about 1e11 and stagnates beyond, where GMRES
+// gives up after a restart cycle that gains less than 10x and the system
+// is solved by LU in double.
+
+/// Columns per panel, and depth of the trailing update
+static const int LU_PANEL = 128;
+/// Trailing update tile, per task
+static const int LU_TILE_ROWS = 64;
+static const int LU_TILE_COLS = 256;
+
+/// C -= L U for a rows x depth L and a depth x cols U, all row-major with
+/// leading dimension ld: 4 rows by two cache lines of C accumulate in
+/// registers over the whole depth
+template <typename Real>
+void LUUpdateTile(Real *C, const Real *L, const Real *U, int rows, int cols,
+                  int depth, long ld) {
+  constexpr int MR = 4, NR = 128 / sizeof(Real);
+  int i = 0;
+  for (; i + MR <= rows; i += MR) {
+    int j = 0;
+    for (; j + NR <= cols; j += NR) {
+      Real acc[MR][NR] = {};
+      for (int k = 0; k < depth; ++k) {
+        const Real *u = U + k * ld + j;
+        for (int r = 0; r < MR; ++r) {
+          const Real l = L[(i + r) * ld + k];
+#pragma omp simd
+          for (int c = 0; c < NR; ++c) {
+            acc[r][c] += l * u[c];
+          }
+        }
+      }
+      for (int r = 0; r < MR; ++r) {
+#pragma omp simd
+        for (int c = 0; c < NR; ++c) {
+          C[(i + r) * ld + j + c] -= acc[r][c];
+        }
+      }
+    }
+    for (int r = 0; r < MR; ++r) {
+      for (int k = 0; k < depth; ++k) {
+        const Real l = L[(i + r) * ld + k];
+        for (int c = j; c < cols; ++c) {
+          C[(i + r) * ld + c] -= l * U[k * ld + c];
+        }
+      }
+    }
+  }
+  for (; i < rows; ++i) {
+    for (int k = 0; k < depth; ++k) {
+      const Real l = L[i * ld + k];
+#pragma omp simd
+      for (int c = 0; c < cols; ++c) {
+        C[i * ld + c] -= l * U[k * ld + c];
+      }
+    }
+  }
+}
+
+/// LU factors P A = L U of an n x n row-major matrix, in place
+template <typename Real>
+class LU {
+ public:
+  explicit LU(int n) : n(n), a((long)n * n), piv(n) {}
+
+  int Size() const { return n; }
+  Real *Data() { return a.data(); }
+
+  /// Factors the matrix stored in Data(); false if a pivot is zero or the
+  /// factors overflow (A out of the range of Real)
+  bool Factor() {
+    for (int k0 = 0; k0 < n; k0 += LU_PANEL) {
+      const int nb = std::min(LU_PANEL, n - k0);
+      if (!FactorPanel(k0, nb)) {
+        return false;
+      }
+      const int right = k0 + nb, rest = n - right;
+      if (rest == 0) {
+        break;
+      }
+      Real *A = a.data();
+      // U12 = L11^-1 A12, column tiles in parallel
+#pragma omp parallel for schedule(static)
+      for (int j0 = right; j0 < n; j0 += LU_TILE_COLS) {
+        const int j1 = std::min(n, j0 + LU_TILE_COLS);
+        for (int k = k0; k < right; ++k) {
+          for (int i = k + 1; i < right; ++i) {
+            const Real l = A[(long)i * n + k];
+#pragma omp simd
+            for (int j = j0; j < j1; ++j) {
+              A[(long)i * n + j] -= l * A[(long)k * n + j];
+            }
+          }
+        }
+      }
+      // A22 -= L21 U12
+      const int row_tiles = (rest + LU_TILE_ROWS - 1) / LU_TILE_ROWS;
+      const int col_tiles = (rest + LU_TILE_COLS - 1) / LU_TILE_COLS;
+#pragma omp parallel for collapse(2) schedule(static)
+      for (int ti = 0; ti < row_tiles; ++ti) {
+        for (int tj = 0; tj < col_tiles; ++tj) {
+          const int i = right + ti * LU_TILE_ROWS,
+                    j = right + tj * LU_TILE_COLS;
+          LUUpdateTile(A + (long)i * n + j, A + (long)i * n + k0,
+                       A + (long)k0 * n + j, std::min(LU_TILE_ROWS, n - i),
+                       std::min(LU_TILE_COLS, n - j), nb, n);
+        }
+      }
+    }
+    return true;
+  }
+
+  /// x = A^-1 x with the factors, the substitutions in the precision of x:
+  /// GMRES-IR applies the float factors in double, else the preconditioned
+  /// operator is only as accurate as float
+  template <typename T>
+  void Solve(T *x) const {
+    const Real *A = a.data();
+    for (int i = 0; i < n; ++i) {
+      std::swap(x[i], x[piv[i]]);
+    }
+    for (int i = 0; i < n; ++i) {
+      T s = x[i];
+#pragma omp simd reduction(- : s)
+      for (int k = 0; k < i; ++k) {
+        s -= (T)A[(long)i * n + k] * x[k];
+      }
+      x[i] = s;
+    }
+    for (int i = n - 1; i >= 0; --i) {
+      T s = x[i];
+#pragma omp simd reduction(- : s)
+      for (int k = i + 1; k < n; ++k) {
+        s -= (T)A[(long)i * n + k] * x[k];
+      }
+      x[i] = s / (T)A[(long)i * n + i];
+    }
+  }
+
+ private:
+  int n;
+  std::vector<Real> a;
+  std::vector<int> piv;  // row i was swapped with row piv[i] at step i
+
+  /// Unblocked LU of columns k0 .. k0 + nb - 1, rows k0 .. n - 1; the row
+  /// swaps apply to whole rows
+  bool FactorPanel(int k0, int nb) {
+    Real *A = a.data();
+    for (int k = k0; k < k0 + nb; ++k) {
+      int p = k;
+      Real best = std::abs(A[(long)k * n + k]);
+      for (int i = k + 1; i < n; ++i) {
+        const Real v = std::abs(A[(long)i * n + k]);
+        if (v > best) {
+          best = v;
+          p = i;
+        }
+      }
+      if (best == 0 || !std::isfinite(best)) {
+        return false;
+      }
+      piv[k] = p;
+      if (p != k) {
+        std::swap_ranges(A + (long)k * n, A + (long)(k + 1) * n,
+                         A + (long)p * n);
+      }
+      const Real inv = 1 / A[(long)k * n + k];
+      const Real *u = A + (long)k * n;
+      const int end = k0 + nb;
+#pragma omp parallel for schedule(static) if (n - k > 256)
+      for (int i = k + 1; i < n; ++i) {
+        Real *row = A + (long)i * n;
+        const Real l = row[k] *= inv;
+#pragma omp simd
+        for (int j = k + 1; j < end; ++j) {
+          row[j] -= l * u[j];
+        }
+      }
+    }
+    return true;
+  }
+};
+
+/// max_i sum_j |A_ij|
+inline double NormInf(int n, const double *A) {
+  double norm = 0;
+#pragma omp parallel for schedule(static) reduction(max : norm)
+  for (int i = 0; i < n; ++i) {
+    double s = 0;
+#pragma omp simd reduction(+ : s)
+    for (int j = 0; j < n; ++j) {
+      s += std::abs(A[(long)i * n + j]);
+    }
+    norm = std::max(norm, s);
+  }
+  return norm;
+}
+
+inline double NormInf(const std::vector<double> &x) {
+  double norm = 0;
+  for (double v : x) {
+    norm = std::max(norm, std::abs(v));
+  }
+  return norm;
+}
+
+/// y = A x
+inline void MatVec(int n, const double *A, const double *x, double *y) {
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i) {
+    double s = 0;
+#pragma omp simd reduction(+ : s)
+    for (int j = 0; j < n; ++j) {
+      s += A[(long)i * n + j] * x[j];
+    }
+    y[i] = s;
+  }
+}
+
+/// y = b - A x, in double
+inline void Residual(int n, const double *A, const double *b, const double *x,
+                     double *y) {
+#pragma omp parallel for schedule(static)
+  for (int i = 0; i < n; ++i) {
+    double s = 0;
+#pragma omp simd reduction(+ : s)
+    for (int j = 0; j < n; ++j) {
+      s += A[(long)i * n + j] * x[j];
+    }
+    y[i] = b[i] - s;
+  }
+}
+
+struct RefineStats {
+  int refinements = 0;  // steps of plain iterative refinement
+  int gmres = 0;        // GMRES iterations, all restarts, if it was needed
+  bool fallback = false;  // the float factorization failed, solved in double
+  double backward_error = 0;  // |b - A x| / (|A| |x| + |b|), infinity norms
+  double factor_time = 0, refine_time = 0;
+};
+
+/// GMRES(restart) for A d = r, left-preconditioned by the float factors,
+/// until the preconditioned residual drops by `reduction`, or a restart
+/// cycle reduces it less than 10x (stagnation); returns the iterations
+inline int PreconditionedGMRES(int n, const double *A, const LU<float> &M,
+                               const double *r, double *d, double reduction,
+                               int restart, int max_iterations) {
+  using std::vector;
+  vector<vector<double>> V(restart + 1, vector<double>(n));
+  vector<double> H((restart + 1) * restart), cs(restart), sn(restart),
+      g(restart + 1), w(n);
+  std::fill(d, d + n, 0.0);
+  int iterations = 0;
+  double target = -1, last_beta = -1;
+  while (iterations < max_iterations) {
+    // v0 = M^-1 (r - A d)
+    Residual(n, A, r, d, V[0].data());
+    M.Solve(V[0].data());
+    double beta = 0;
+    for (double v : V[0]) beta += v * v;
+    beta = std::sqrt(beta);
+    if (target < 0) target = beta * reduction;
+    if (beta <= target || beta == 0) break;
+    if (last_beta > 0 && beta > 0.1 * last_beta) break;
+    last_beta = beta;
+    for (double &v : V[0]) v /= beta;
+    std::fill(g.begin(), g.end(), 0.0);
+    g[0] = beta;
+
+    int m = 0;
+    for (; m < restart && iterations < max_iterations; ++m, ++iterations) {
+      // w = M^-1 A v_m, orthogonalized by modified Gram-Schmidt
+      MatVec(n, A, V[m].data(), w.data());
+      M.Solve(w.data());
+      for (int k = 0; k <= m; ++k) {
+        double h = 0;
+        for (int i = 0; i < n; ++i) h += w[i] * V[k][i];
+        for (int i = 0; i < n; ++i) w[i] -= h * V[k][i];
+        H[k * restart + m] = h;
+      }
+      double h = 0;
+      for (double v : w) h += v * v;
+      h = std::sqrt(h);
+      H[(m + 1) * restart + m] = h;
+      if (h != 0) {
+        for (int i = 0; i < n; ++i) V[m + 1][i] = w[i] / h;
+      }
+      // Givens rotations keep H upper triangular, |g[m + 1]| is the residual
+      for (int k = 0; k < m; ++k) {
+        const double x = H[k * restart + m], y = H[(k + 1) * restart + m];
+        H[k * restart + m] = cs[k] * x + sn[k] * y;
+        H[(k + 1) * restart + m] = -sn[k] * x + cs[k] * y;
+      }
+      const double x = H[m * restart + m], y = H[(m + 1) * restart + m];
+      const double rho = std::hypot(x, y);
+      cs[m] = x / rho;
+      sn[m] = y / rho;
+      H[m * restart + m] = rho;
+      H[(m + 1) * restart + m] = 0;
+      g[m + 1] = -sn[m] * g[m];
+      g[m] *= cs[m];
+      if (std::abs(g[m + 1]) <= target || h == 0) {
+        ++m;
+        ++iterations;
+        break;
+      }
+    }
+    // d += V y with H y = g
+    vector<double> y(m);
+    for (int k = m - 1; k >= 0; --k) {
+      double s = g[k];
+      for (int j = k + 1; j < m; ++j) s -= H[k * restart + j] * y[j];
+      y[k] = s / H[k * restart + k];
+    }
+    for (int k = 0; k < m; ++k) {
+      for (int i = 0; i < n; ++i) d[i] += y[k] * V[k][i];
+    }
+    if (std::abs(g[m]) <= target) break;
+  }
+  return iterations;
+}
+
+/// x of A x = b (A n x n row-major, double) to double accuracy, factoring
+/// in float: refinement while each correction is at most half the previous
+/// one, then GMRES-IR while it halves the backward error; if that fails too,
+/// or the float factorization does, LU in double
+inline RefineStats MixedSolve(int n, const double *A, const double *b,
+                              double *x, int max_steps = 10) {
+  using std::vector;
+  RefineStats stats;
+  const double eps = std::numeric_limits<double>::epsilon();
+  const double norm_A = NormInf(n, A), norm_b = NormInf(vector<double>(b, b + n));
+  const double tol = std::sqrt((double)n) * eps;
+  vector<double> r(n), d(n);
+  auto backward_error = [&] {
+    Residual(n, A, b, x, r.data());
+    return NormInf(r) / (norm_A * NormInf(vector<double>(x, x + n)) + norm_b);
+  };
+  auto solve_double = [&] {
+    const double start = omp_get_wtime();
+    stats.fallback = true;
+    LU<double> D(n);
+    std::copy(A, A + (long)n * n, D.Data());
+    std::copy(b, b + n, x);
+    if (D.Factor()) {
+      D.Solve(x);
+    }
+    stats.factor_time += omp_get_wtime() - start;
+    stats.backward_error = backward_error();
+    return stats;
+  };
+
+  double start = omp_get_wtime();
+  LU<float> M(n);
+  float *Af = M.Data();
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < (long)n * n; ++i) {
+    Af[i] = (float)A[i];
+  }
+  const bool factored = M.Factor();
+  stats.factor_time = omp_get_wtime() - start;
+  if (!factored) {
+    // out of float range or singular in float
+    return solve_double();
+  }
+
+  start = omp_get_wtime();
+  std::copy(b, b + n, x);
+  M.Solve(x);
+  double last_correction = std::numeric_limits<double>::infinity();
+  double last_error = last_correction;
+  bool gmres = false;
+  for (int step = 0;; ++step) {
+    stats.backward_error = backward_error();
+    if (stats.backward_error <= tol) {
+      break;
+    }
+    if (step == max_steps ||
+        (gmres && stats.backward_error > 0.5 * last_error)) {
+      // too ill-conditioned for the float factors even as a preconditioner
+      stats.refine_time = omp_get_wtime() - start;
+      return solve_double();
+    }
+    last_error = stats.backward_error;
+    if (!gmres) {
+      d = r;
+      M.Solve(d.data());
+      const double size = NormInf(d);
+      if (size > 0.5 * last_correction) {
+        gmres = true;  // stalled: this correction is not trusted either
+      } else {
+        last_correction = size;
+        ++stats.refinements;
+      }
+    }
+    if (gmres) {
+      stats.gmres += PreconditionedGMRES(n, A, M, r.data(), d.data(), 1e-10,
+                                         30, 100);
+    }
+    for (int i = 0; i < n; ++i) {
+      x[i] += d[i];
+    }
+  }
+  stats.refine_time = omp_get_wtime() - start;
+  return stats;
+}
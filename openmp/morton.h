@@ -0,0 +1,347 @@
+#ifndef MORTON_H
+#define MORTON_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <omp.h>
+
+/*
+ * Cache-oblivious matrix multiplication on a Morton (Z-order) tiled layout,
+ * with Strassen-Winograd levels on top, usable from C and C++.
+ *
+ * A matrix is padded to n x n tiles of MORTON_TILE x MORTON_TILE doubles, n
+ * a power of two. Each tile is stored row-major and contiguous, and tiles
+ * follow the Z-order of their (row, column): the four quadrants of any
+ * aligned block are themselves contiguous Morton matrices. The recursive
+ * multiply splits C += A * B into eight quadrant products down to single
+ * tiles, so at every level of the memory hierarchy some level of the
+ * recursion fits, without a tuned block size; the first levels become
+ * OpenMP tasks (four independent products at a time, then the other four).
+ *
+ * Strassen-Winograd replaces the eight quadrant products by seven plus
+ * fifteen quadrant additions, which are plain loops over contiguous arrays
+ * in this layout. Its error bound grows with the number of levels, so it is
+ * only used above a threshold (see morton_tune_strassen) and then switches
+ * to the recursive multiply.
+ *
+ * Only the first `used` tiles of each side hold data. Both recursions skip
+ * the quadrant products that would multiply zero padding only, which would
+ * be up to 7/8 of the flops for N just above a power of two tiles. The
+ * padding still costs memory (up to four times the matrix), and the
+ * Strassen-Winograd additions still run over it.
+ */
+
+/* Tile side: three tiles fit in L1/L2 */
+#define MORTON_TILE 64
+#define MORTON_TILE_SIZE (MORTON_TILE * MORTON_TILE)
+/* Recursion levels whose quadrant products are spawned as tasks */
+#define MORTON_TASK_LEVELS 3
+
+/* Tiles per side for an N x N matrix: power of two */
+static inline size_t morton_tiles(size_t N) {
+  size_t n = 1;
+  while (n * MORTON_TILE < N) {
+    n <<= 1;
+  }
+  return n;
+}
+
+/* Tiles per side holding data for an N x N matrix */
+static inline size_t morton_used_tiles(size_t N) {
+  return (N + MORTON_TILE - 1) / MORTON_TILE;
+}
+
+/* Tiles holding data in the first (lower 0) or second half of a block whose
+   first `used` tiles do, h tiles per half */
+static inline size_t morton_half(size_t used, size_t h, int second) {
+  if (second) {
+    return used > h ? used - h : 0;
+  }
+  return used < h ? used : h;
+}
+
+/* Position of tile (ti, tj) in Z-order: row bits above column bits */
+static inline size_t morton_index(size_t ti, size_t tj) {
+  size_t index = 0;
+  for (int bit = 0; bit < 32; ++bit) {
+    index |= ((tj >> bit) & 1) << (2 * bit);
+    index |= ((ti >> bit) & 1) << (2 * bit + 1);
+  }
+  return index;
+}
+
+static inline double *morton_alloc(size_t n) {
+  return (double *)aligned_alloc(64, n * n * MORTON_TILE_SIZE * sizeof(double));
+}
+
+/* Row-pointer N x N matrix into a zero-padded Morton one of n x n tiles */
+static inline void morton_from_rows(double *dst, double **src, size_t N,
+                                    size_t n) {
+#pragma omp parallel for collapse(2) schedule(static)
+  for (size_t ti = 0; ti < n; ++ti) {
+    for (size_t tj = 0; tj < n; ++tj) {
+      double *tile = dst + morton_index(ti, tj) * MORTON_TILE_SIZE;
+      for (size_t i = 0; i < MORTON_TILE; ++i) {
+        for (size_t j = 0; j < MORTON_TILE; ++j) {
+          const size_t gi = ti * MORTON_TILE + i, gj = tj * MORTON_TILE + j;
+          tile[i * MORTON_TILE + j] = gi < N && gj < N ? src[gi][gj] : 0.0;
+        }
+      }
+    }
+  }
+}
+
+static inline void morton_to_rows(double **dst, const double *src, size_t N,
+                                  size_t n) {
+#pragma omp parallel for collapse(2) schedule(static)
+  for (size_t ti = 0; ti < n; ++ti) {
+    for (size_t tj = 0; tj < n; ++tj) {
+      const double *tile = src + morton_index(ti, tj) * MORTON_TILE_SIZE;
+      for (size_t i = 0; i < MORTON_TILE && ti * MORTON_TILE + i < N; ++i) {
+        for (size_t j = 0; j < MORTON_TILE && tj * MORTON_TILE + j < N; ++j) {
+          dst[ti * MORTON_TILE + i][tj * MORTON_TILE + j] =
+              tile[i * MORTON_TILE + j];
+        }
+      }
+    }
+  }
+}
+
+/* C += A * B for single tiles */
+static inline void morton_tile_kernel(double *restrict C,
+                                      const double *restrict A,
+                                      const double *restrict B) {
+  for (int i = 0; i < MORTON_TILE; ++i) {
+    double *c = C + i * MORTON_TILE;
+    for (int k = 0; k < MORTON_TILE; ++k) {
+      const double a = A[i * MORTON_TILE + k];
+      const double *b = B + k * MORTON_TILE;
+#pragma omp simd
+      for (int j = 0; j < MORTON_TILE; ++j) {
+        c[j] += a * b[j];
+      }
+    }
+  }
+}
+
+/* C += A * B, n x n tiles each, of which the first r rows of A and C, k
+   columns of A and rows of B and c columns of B and C hold data; depth
+   counts the levels above */
+static inline void morton_multiply_rec(double *C, const double *A,
+                                       const double *B, size_t n, size_t r,
+                                       size_t k, size_t c, int depth) {
+  if (r == 0 || k == 0 || c == 0) {
+    return;
+  }
+  if (n == 1) {
+    morton_tile_kernel(C, A, B);
+    return;
+  }
+  const size_t q = n * n / 4 * MORTON_TILE_SIZE;
+  const double *A00 = A, *A01 = A + q, *A10 = A + 2 * q, *A11 = A + 3 * q;
+  const double *B00 = B, *B01 = B + q, *B10 = B + 2 * q, *B11 = B + 3 * q;
+  double *C00 = C, *C01 = C + q, *C10 = C + 2 * q, *C11 = C + 3 * q;
+  const size_t h = n / 2;
+  const size_t r0 = morton_half(r, h, 0), r1 = morton_half(r, h, 1);
+  const size_t k0 = morton_half(k, h, 0), k1 = morton_half(k, h, 1);
+  const size_t c0 = morton_half(c, h, 0), c1 = morton_half(c, h, 1);
+  /* the two products adding into one quadrant of C are never concurrent */
+  if (depth < MORTON_TASK_LEVELS) {
+#pragma omp task
+    morton_multiply_rec(C00, A00, B00, h, r0, k0, c0, depth + 1);
+#pragma omp task
+    morton_multiply_rec(C01, A00, B01, h, r0, k0, c1, depth + 1);
+#pragma omp task
+    morton_multiply_rec(C10, A10, B00, h, r1, k0, c0, depth + 1);
+    morton_multiply_rec(C11, A10, B01, h, r1, k0, c1, depth + 1);
+#pragma omp taskwait
+#pragma omp task
+    morton_multiply_rec(C00, A01, B10, h, r0, k1, c0, depth + 1);
+#pragma omp task
+    morton_multiply_rec(C01, A01, B11, h, r0, k1, c1, depth + 1);
+#pragma omp task
+    morton_multiply_rec(C10, A11, B10, h, r1, k1, c0, depth + 1);
+    morton_multiply_rec(C11, A11, B11, h, r1, k1, c1, depth + 1);
+#pragma omp taskwait
+  } else {
+    morton_multiply_rec(C00, A00, B00, h, r0, k0, c0, depth + 1);
+    morton_multiply_rec(C00, A01, B10, h, r0, k1, c0, depth + 1);
+    morton_multiply_rec(C01, A00, B01, h, r0, k0, c1, depth + 1);
+    morton_multiply_rec(C01, A01, B11, h, r0, k1, c1, depth + 1);
+    morton_multiply_rec(C10, A10, B00, h, r1, k0, c0, depth + 1);
+    morton_multiply_rec(C10, A11, B10, h, r1, k1, c0, depth + 1);
+    morton_multiply_rec(C11, A10, B01, h, r1, k0, c1, depth + 1);
+    morton_multiply_rec(C11, A11, B11, h, r1, k1, c1, depth + 1);
+  }
+}
+
+/* C += A * B for Morton matrices of n x n tiles, the first used of each
+   side holding data */
+static inline void morton_multiply(double *C, const double *A, const double *B,
+                                   size_t n, size_t used) {
+#pragma omp parallel
+#pragma omp single
+  morton_multiply_rec(C, A, B, n, used, used, used, 0);
+}
+
+/* z = x + sign * y over m contiguous doubles; z may be x */
+static inline void morton_add(double *z, const double *x, const double *y,
+                              double sign, size_t m) {
+#pragma omp simd
+  for (size_t i = 0; i < m; ++i) {
+    z[i] = x[i] + sign * y[i];
+  }
+}
+
+/* C = A * B; Strassen-Winograd while n > threshold tiles. A holds data in
+   its first r rows and ka columns, B in its first kb rows and c columns:
+   the sums below mix both halves of A's columns and of B's rows, so the two
+   inner extents are kept apart until the recursive multiply. */
+static inline void morton_strassen_rec(double *C, const double *A,
+                                       const double *B, size_t n, size_t r,
+                                       size_t ka, size_t kb, size_t c,
+                                       size_t threshold, int depth) {
+  const size_t m = n * n * MORTON_TILE_SIZE;
+  if (n <= threshold || n == 1 || r == 0 || ka == 0 || kb == 0 || c == 0) {
+    memset(C, 0, m * sizeof(double));
+    morton_multiply_rec(C, A, B, n, r, ka < kb ? ka : kb, c, depth);
+    return;
+  }
+  const size_t q = m / 4, h = n / 2;
+  /* first halves hold at least as much data as second ones, so every sum
+     below holds data in the extent of its first-half operand */
+  const size_t r0 = morton_half(r, h, 0), r1 = morton_half(r, h, 1);
+  const size_t ka0 = morton_half(ka, h, 0), ka1 = morton_half(ka, h, 1);
+  const size_t kb0 = morton_half(kb, h, 0), kb1 = morton_half(kb, h, 1);
+  const size_t c0 = morton_half(c, h, 0), c1 = morton_half(c, h, 1);
+  const double *A11 = A, *A12 = A + q, *A21 = A + 2 * q, *A22 = A + 3 * q;
+  const double *B11 = B, *B12 = B + q, *B21 = B + 2 * q, *B22 = B + 3 * q;
+  double *C11 = C, *C12 = C + q, *C21 = C + 2 * q, *C22 = C + 3 * q;
+
+  /* S1..S4, T1..T4 and M2..M7; M1 is computed in C11 */
+  double *tmp = (double *)aligned_alloc(64, 14 * q * sizeof(double));
+  double *S1 = tmp, *S2 = tmp + q, *S3 = tmp + 2 * q, *S4 = tmp + 3 * q;
+  double *T1 = tmp + 4 * q, *T2 = tmp + 5 * q, *T3 = tmp + 6 * q,
+         *T4 = tmp + 7 * q;
+  double *M2 = tmp + 8 * q, *M3 = tmp + 9 * q, *M4 = tmp + 10 * q,
+         *M5 = tmp + 11 * q, *M6 = tmp + 12 * q, *M7 = tmp + 13 * q;
+
+  morton_add(S1, A21, A22, 1, q);
+  morton_add(S2, S1, A11, -1, q);
+  morton_add(S3, A11, A21, -1, q);
+  morton_add(S4, A12, S2, -1, q);
+  morton_add(T1, B12, B11, -1, q);
+  morton_add(T2, B22, T1, -1, q);
+  morton_add(T3, B22, B12, -1, q);
+  morton_add(T4, T2, B21, -1, q);
+
+  const int next = depth + 1;
+#pragma omp task if (depth < MORTON_TASK_LEVELS)
+  morton_strassen_rec(C11, A11, B11, h, r0, ka0, kb0, c0, threshold,
+                      next); /* M1 */
+#pragma omp task if (depth < MORTON_TASK_LEVELS)
+  morton_strassen_rec(M2, A12, B21, h, r0, ka1, kb1, c0, threshold, next);
+#pragma omp task if (depth < MORTON_TASK_LEVELS)
+  morton_strassen_rec(M3, S4, B22, h, r0, ka0, kb1, c1, threshold, next);
+#pragma omp task if (depth < MORTON_TASK_LEVELS)
+  morton_strassen_rec(M4, A22, T4, h, r1, ka1, kb0, c0, threshold, next);
+#pragma omp task if (depth < MORTON_TASK_LEVELS)
+  morton_strassen_rec(M5, S1, T1, h, r1, ka0, kb0, c0, threshold, next);
+#pragma omp task if (depth < MORTON_TASK_LEVELS)
+  morton_strassen_rec(M6, S2, T2, h, r0, ka0, kb0, c0, threshold, next);
+  morton_strassen_rec(M7, S3, T3, h, r0, ka0, kb0, c1, threshold, next);
+#pragma omp taskwait
+
+  /* U2 = M1 + M6 in C22, U3 = U2 + M7 */
+  morton_add(C22, C11, M6, 1, q);
+  morton_add(C12, C22, M5, 1, q); /* U4 */
+  morton_add(C12, C12, M3, 1, q);
+  morton_add(C22, C22, M7, 1, q); /* U3 */
+  morton_add(C21, C22, M4, -1, q);
+  morton_add(C22, C22, M5, 1, q);
+  morton_add(C11, C11, M2, 1, q);
+  free(tmp);
+}
+
+/* C = A * B for Morton matrices of n x n tiles, the first used of each side
+   holding data, Strassen-Winograd levels while the tile count per side is
+   above threshold */
+static inline void morton_strassen(double *C, const double *A, const double *B,
+                                   size_t n, size_t used, size_t threshold) {
+#pragma omp parallel
+#pragma omp single
+  morton_strassen_rec(C, A, B, n, used, used, used, used, threshold, 0);
+}
+
+/* Best of two runs of C = A * B, n x n tiles with the first used of each
+   side holding data: the recursive multiply for threshold >= n, otherwise
+   Strassen-Winograd down to threshold */
+static inline double morton_time_multiply(double *C, const double *A,
+                                          const double *B, size_t n,
+                                          size_t used, size_t threshold) {
+  double best = 1e300;
+  for (int rep = 0; rep < 2; ++rep) {
+    memset(C, 0, n * n * MORTON_TILE_SIZE * sizeof(double));
+    const double start = omp_get_wtime();
+    if (threshold < n) {
+      morton_strassen(C, A, B, n, used, threshold);
+    } else {
+      morton_multiply(C, A, B, n, used);
+    }
+    const double t = omp_get_wtime() - start;
+    best = t < best ? t : best;
+  }
+  return best;
+}
+
+/*
+ * Strassen-Winograd threshold for C = A * B of n x n tiles, the first used
+ * of each side holding data, on this machine; returns n when Strassen is
+ * not faster at that shape (it then stays unused). C is overwritten.
+ *
+ * The smallest full block at which one level pays off gives the lowest
+ * candidate threshold. Full blocks are not the real shape though: with
+ * used well below n the recursive multiply skips most padding quadrants,
+ * while the Strassen additions still run over them. So every candidate
+ * from there up to n / 2 (fewer levels) is timed on A and B themselves,
+ * and only one that beats the recursive multiply there is returned.
+ */
+static inline size_t morton_tune_strassen(double *C, const double *A,
+                                          const double *B, size_t n,
+                                          size_t used) {
+  size_t lowest = n;
+  for (size_t s = 2; s <= n; s <<= 1) {
+    const size_t m = s * s * MORTON_TILE_SIZE;
+    double *As = morton_alloc(s), *Bs = morton_alloc(s), *Cs = morton_alloc(s);
+    for (size_t i = 0; i < m; ++i) {
+      As[i] = (double)(i % 7) - 3;
+      Bs[i] = (double)(i % 5) - 2;
+    }
+    const double plain = morton_time_multiply(Cs, As, Bs, s, s, s);
+    const double strassen = morton_time_multiply(Cs, As, Bs, s, s, s / 2);
+    free(As);
+    free(Bs);
+    free(Cs);
+    if (strassen < plain) {
+      /* one level pays off at s tiles, recurse down to s / 2 */
+      lowest = s / 2;
+      break;
+    }
+  }
+  size_t threshold = n;
+  if (lowest < n) {
+    double best = morton_time_multiply(C, A, B, n, used, n);
+    for (size_t t = lowest; t < n; t <<= 1) {
+      const double time = morton_time_multiply(C, A, B, n, used, t);
+      if (time < best) {
+        best = time;
+        threshold = t;
+      }
+    }
+  }
+  return threshold;
+}
+
+#endif
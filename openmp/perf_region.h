@@ -0,0 +1,379 @@
+#ifndef PERF_REGION_H
+#define PERF_REGION_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+/*
+ * Scoped hardware-counter regions and a roofline report, usable from C and
+ * C++.
+ *
+ *   static perf_region mm = PERF_REGION_INIT("matmul");
+ *   perf_scope s = perf_begin(&mm);      // in every thread doing the work
+ *   ... kernel ...
+ *   perf_end(&s);
+ *   perf_work(&mm, 2.0 * N * N * N, 3.0 * 8 * N * N);  // flops, bytes once
+ *   perf_report(stdout);                 // at the end of main
+ *
+ * Each thread reads its own counter group (cycles, instructions, cache
+ * references and misses) with perf_event_open at begin and end, one read()
+ * each. Where the counters are not available (containers, VMs,
+ * perf_event_paranoid) only time is reported. FLOP and byte counts are
+ * declared by the caller from the algorithm: the report puts every region on
+ * the roofline min(peak GFLOP/s, intensity * peak GB/s) measured on this
+ * machine (or given as PERF_PEAKS=gflops,gbs), and the fraction of that
+ * bound reached says which kernels are worth optimizing.
+ *
+ * Header only: regions and thread slots belong to one translation unit.
+ */
+
+#define PERF_MAX_THREADS 256
+/* cycles, instructions, cache references, cache misses */
+#define PERF_EVENTS 4
+
+#ifdef __cplusplus
+#define PERF_THREAD_LOCAL thread_local
+#else
+#define PERF_THREAD_LOCAL _Thread_local
+#endif
+
+typedef struct {
+  uint64_t calls;
+  uint64_t ns;
+  uint64_t counters[PERF_EVENTS];
+  /* keep threads on separate cache lines */
+  char pad[64 - (2 + PERF_EVENTS) * sizeof(uint64_t)];
+} perf_thread_stats;
+
+typedef struct perf_region {
+  const char *name;
+  struct perf_region *next;
+  int registered;
+  double flops, bytes;
+  perf_thread_stats threads[PERF_MAX_THREADS];
+} perf_region;
+
+#define PERF_REGION_INIT(name) {name, NULL, 0, 0, 0, {{0, 0, {0}, {0}}}}
+
+typedef struct {
+  perf_region *region;
+  int thread;
+  uint64_t ns;
+  uint64_t counters[PERF_EVENTS];
+} perf_scope;
+
+/* Counter group of the calling thread, opened on first use */
+typedef struct {
+  int index;
+  int leader;
+  /* position of event e in a group read, -1 if it could not be opened */
+  int slot[PERF_EVENTS];
+  int members;
+} perf_thread_state;
+
+static perf_region *perf_regions = NULL;
+static int perf_next_thread = 0;
+
+static inline uint64_t perf_now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+#ifdef __linux__
+static inline int perf_open(uint64_t config, int group) {
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.read_format = PERF_FORMAT_GROUP;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group, 0);
+}
+#endif
+
+/* index of a thread that came after all PERF_MAX_THREADS slots were given
+   out: its regions are not recorded */
+#define PERF_NO_SLOT (-2)
+
+static inline perf_thread_state *perf_thread(void) {
+  static PERF_THREAD_LOCAL perf_thread_state state = {-1, -1, {0}, 0};
+  if (state.index != -1) {
+    return &state;
+  }
+  for (int e = 0; e < PERF_EVENTS; ++e) {
+    state.slot[e] = -1;
+  }
+  /* slots are never reused: a slot shared by two live threads would race */
+  state.index = __atomic_fetch_add(&perf_next_thread, 1, __ATOMIC_RELAXED);
+  if (state.index >= PERF_MAX_THREADS) {
+    if (state.index == PERF_MAX_THREADS) {
+      fprintf(stderr,
+              "perf_region: more than %d threads, the later ones are not "
+              "recorded\n",
+              PERF_MAX_THREADS);
+    }
+    state.index = PERF_NO_SLOT;
+    return &state;
+  }
+#ifdef __linux__
+  const uint64_t configs[PERF_EVENTS] = {
+      PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_REFERENCES, PERF_COUNT_HW_CACHE_MISSES};
+  for (int e = 0; e < PERF_EVENTS; ++e) {
+    int fd = perf_open(configs[e], state.leader);
+    if (fd < 0) {
+      continue;
+    }
+    if (state.leader < 0) {
+      state.leader = fd;
+    }
+    state.slot[e] = state.members++;
+  }
+#endif
+  return &state;
+}
+
+static inline void perf_read(const perf_thread_state *state,
+                             uint64_t counters[PERF_EVENTS]) {
+  memset(counters, 0, PERF_EVENTS * sizeof(uint64_t));
+  if (state->leader < 0) {
+    return;
+  }
+  /* nr, then one value per member */
+  uint64_t values[1 + PERF_EVENTS];
+  ssize_t size = read(state->leader, values, sizeof(values));
+  if (size < (ssize_t)sizeof(uint64_t)) {
+    return;
+  }
+  for (int e = 0; e < PERF_EVENTS; ++e) {
+    if (state->slot[e] >= 0 && (uint64_t)state->slot[e] < values[0]) {
+      counters[e] = values[1 + state->slot[e]];
+    }
+  }
+}
+
+static inline void perf_register(perf_region *region) {
+  int expected = 0;
+  if (__atomic_compare_exchange_n(&region->registered, &expected, 1, 0,
+                                  __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+    region->next = __atomic_load_n(&perf_regions, __ATOMIC_ACQUIRE);
+    while (!__atomic_compare_exchange_n(&perf_regions, &region->next, region,
+                                        1, __ATOMIC_ACQ_REL,
+                                        __ATOMIC_ACQUIRE)) {
+    }
+  }
+}
+
+static inline perf_scope perf_begin(perf_region *region) {
+  perf_register(region);
+  perf_thread_state *state = perf_thread();
+  perf_scope scope;
+  scope.region = region;
+  scope.thread = state->index;
+  perf_read(state, scope.counters);
+  scope.ns = perf_now_ns();
+  return scope;
+}
+
+static inline void perf_end(perf_scope *scope) {
+  if (scope->thread < 0) {
+    return;
+  }
+  const uint64_t ns = perf_now_ns();
+  uint64_t counters[PERF_EVENTS];
+  perf_read(perf_thread(), counters);
+  perf_thread_stats *stats = &scope->region->threads[scope->thread];
+  stats->calls += 1;
+  stats->ns += ns - scope->ns;
+  for (int e = 0; e < PERF_EVENTS; ++e) {
+    stats->counters[e] += counters[e] - scope->counters[e];
+  }
+}
+
+/* Work done by the region, from the algorithm; call once per execution */
+static inline void perf_work(perf_region *region, double flops, double bytes) {
+  perf_register(region);
+#pragma omp atomic
+  region->flops += flops;
+#pragma omp atomic
+  region->bytes += bytes;
+}
+
+/* Peak of fused multiply-adds: 8 vectors of independent chains per thread */
+static inline double perf_peak_gflops(void) {
+  const long iterations = 20000000;
+  double seconds = 0, flops = 0;
+  double sink = 0;
+#pragma omp parallel reduction(max : seconds) reduction(+ : flops, sink)
+  {
+    double x[64];
+    for (int k = 0; k < 64; ++k) {
+      x[k] = k;
+    }
+    const double a = 0.999999, b = 1e-7;
+    const uint64_t start = perf_now_ns();
+    for (long i = 0; i < iterations / 64; ++i) {
+#pragma omp simd
+      for (int k = 0; k < 64; ++k) {
+        x[k] = x[k] * a + b;
+      }
+    }
+    seconds = (perf_now_ns() - start) * 1e-9;
+    flops = 2.0 * 64 * (iterations / 64);
+    for (int k = 0; k < 64; ++k) {
+      sink += x[k];
+    }
+  }
+  return sink == 0.123 ? 0 : flops / seconds * 1e-9;
+}
+
+/* Triad a = b + s * c on arrays far larger than the caches, best of 3 */
+static inline double perf_peak_gbs(void) {
+  const long n = 1L << 24;
+  double *a = (double *)malloc(n * sizeof(double));
+  double *b = (double *)malloc(n * sizeof(double));
+  double *c = (double *)malloc(n * sizeof(double));
+  double best = 0;
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < n; ++i) {
+    a[i] = 0;
+    b[i] = 1;
+    c[i] = 2;
+  }
+  for (int rep = 0; rep < 3; ++rep) {
+    const uint64_t start = perf_now_ns();
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < n; ++i) {
+      a[i] = b[i] + 0.5 * c[i];
+    }
+    const double gbs = 3.0 * 8 * n / ((perf_now_ns() - start) * 1e-9) * 1e-9;
+    best = gbs > best ? gbs : best;
+  }
+  free(a);
+  free(b);
+  free(c);
+  return best;
+}
+
+/* IPC and LLC miss rate columns */
+static inline void perf_print_counters(FILE *out,
+                                       const uint64_t counters[PERF_EVENTS]) {
+  if (counters[0] > 0) {
+    fprintf(out, "%5.2f ", (double)counters[1] / counters[0]);
+  } else {
+    fprintf(out, "%5s ", "-");
+  }
+  if (counters[2] > 0) {
+    fprintf(out, "%8.1f%% ", 100.0 * counters[3] / counters[2]);
+  } else {
+    fprintf(out, "%9s ", "-");
+  }
+}
+
+/*
+ * One summary row per region: calls and time of the slowest thread,
+ * counters summed over the threads, FLOP and bytes as declared. Regions run
+ * by several threads are followed by one row per thread (time, IPC, LLC
+ * misses and its time against the slowest thread, for load imbalance);
+ * PERF_THREADS=0 leaves those out.
+ */
+static inline void perf_report(FILE *out) {
+  if (perf_regions == NULL) {
+    return;
+  }
+  double peak_gflops = 0, peak_gbs = 0;
+  const char *peaks = getenv("PERF_PEAKS");
+  if (peaks == NULL || sscanf(peaks, "%lf,%lf", &peak_gflops, &peak_gbs) != 2) {
+    peak_gflops = perf_peak_gflops();
+    peak_gbs = perf_peak_gbs();
+  }
+  const double ridge = peak_gflops / peak_gbs;
+  const char *per_thread_env = getenv("PERF_THREADS");
+  const int per_thread =
+      per_thread_env == NULL || strcmp(per_thread_env, "0") != 0;
+  fprintf(out,
+          "roofline: peak %.1f GFLOP/s, %.1f GB/s, ridge %.2f FLOP/byte%s\n",
+          peak_gflops, peak_gbs, ridge,
+          perf_thread()->leader < 0 ? " (no hardware counters)" : "");
+  fprintf(out, "%-20s %7s %3s %10s %9s %8s %7s %5s %9s %8s %s\n", "region",
+          "calls", "thr", "time, s", "GFLOP/s", "GB/s", "FLOP/B", "IPC",
+          "LLC miss", "of roof", "bound");
+  /* regions in the order they were first entered */
+  perf_region *ordered = NULL;
+  while (perf_regions != NULL) {
+    perf_region *r = perf_regions;
+    perf_regions = r->next;
+    r->next = ordered;
+    ordered = r;
+  }
+  perf_regions = ordered;
+  for (perf_region *r = perf_regions; r != NULL; r = r->next) {
+    uint64_t calls = 0, counters[PERF_EVENTS] = {0};
+    double seconds = 0;
+    int threads = 0;
+    for (int t = 0; t < PERF_MAX_THREADS; ++t) {
+      const perf_thread_stats *s = &r->threads[t];
+      if (s->calls == 0) {
+        continue;
+      }
+      ++threads;
+      calls = s->calls > calls ? s->calls : calls;
+      /* threads run concurrently: the slowest one is the region's time */
+      seconds = s->ns * 1e-9 > seconds ? s->ns * 1e-9 : seconds;
+      for (int e = 0; e < PERF_EVENTS; ++e) {
+        counters[e] += s->counters[e];
+      }
+    }
+    const double gflops = r->flops / seconds * 1e-9;
+    const double gbs = r->bytes / seconds * 1e-9;
+    const double intensity = r->bytes > 0 ? r->flops / r->bytes : 0;
+    const double roof = intensity * peak_gbs < peak_gflops
+                            ? intensity * peak_gbs
+                            : peak_gflops;
+    fprintf(out, "%-20s %7llu %3d %10.4f %9.2f %8.2f %7.2f ", r->name,
+            (unsigned long long)calls, threads, seconds, gflops, gbs,
+            intensity);
+    perf_print_counters(out, counters);
+    if (r->flops > 0) {
+      fprintf(out, "%7.1f%% %s\n", 100 * gflops / roof,
+              intensity < ridge ? "memory" : "compute");
+    } else {
+      fprintf(out, "%7.1f%% %s\n", 100 * gbs / peak_gbs, "memory");
+    }
+    if (!per_thread || threads < 2) {
+      continue;
+    }
+    for (int t = 0; t < PERF_MAX_THREADS; ++t) {
+      const perf_thread_stats *s = &r->threads[t];
+      if (s->calls == 0) {
+        continue;
+      }
+      char label[32];
+      snprintf(label, sizeof(label), "  thread %d", t);
+      fprintf(out, "%-20s %7llu %3s %10.4f %9s %8s %7s ", label,
+              (unsigned long long)s->calls, "", s->ns * 1e-9, "-", "-", "-");
+      perf_print_counters(out, s->counters);
+      fprintf(out, "%7.1f%% %s\n", 100 * s->ns * 1e-9 / seconds,
+              "of slowest");
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,371 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include <omp.h>
+
+#include "filters.hpp"
+#include "histogram.hpp"
+#include "ppm.hpp"
+
+// Image pipeline executed tile by tile.
+//
+// A tile is a band of output rows. Walking the chain backwards, every stage
+// widens the band by its halo (clipped to the image), so each stage gets all
+// rows it reads and border rows are replicated exactly as in the standalone
+// filters: the result does not depend on the tile size. Intermediate bands of
+// one tile stay in cache; halo rows are recomputed by neighbouring tiles.
+// Tiles are handed out to the OpenMP team dynamically.
+
+/// Planar rows [y0, y1) of an image, channel c starting at data + c * stride
+struct Band {
+  int y0, y1, w, channels;
+  long stride;
+  float *data;
+
+  float *Row(int c, int y) const {
+    return data + c * stride + (long)(y - y0) * w;
+  }
+  /// Rows [a, b) of the same storage
+  Band View(int a, int b) const {
+    return {a, b, w, channels, stride, Row(0, a)};
+  }
+};
+
+/// Per thread buffers reused between tiles
+struct Scratch {
+  std::vector<float> tmp, line;
+  std::vector<double> sums;
+  std::vector<uint8_t> pad, bytes;
+  std::vector<MedianHistogram> columns;
+};
+
+class Stage {
+public:
+  virtual ~Stage() = default;
+  /// Input rows needed on each side of an output row
+  virtual int Halo() const { return 0; }
+  virtual int Channels(int in) const { return in; }
+  /// Taps look at rows (count, write) and pass the band on unchanged
+  virtual bool IsTap() const { return false; }
+  /// `in` covers out's rows widened by Halo() and clipped to the image of
+  /// height h, `out` is allocated by the caller
+  virtual void Run(const Band & /*in*/, Band & /*out*/, int /*h*/,
+                   Scratch & /*scratch*/) {}
+  /// Rows [y0, y1) of the band belong to the current tile
+  virtual void Tap(const Band & /*band*/, int /*y0*/, int /*y1*/) {}
+  virtual void Start(int /*threads*/) {}
+  virtual void Finish() {}
+};
+
+class GrayStage : public Stage {
+public:
+  int Channels(int) const override { return 1; }
+  void Run(const Band &in, Band &out, int, Scratch &) override {
+    for (int y = out.y0; y < out.y1; ++y) {
+      const float *r = in.Row(0, y), *g = in.Row(1, y), *b = in.Row(2, y);
+      float *gray = out.Row(0, y);
+#pragma omp simd
+      for (int x = 0; x < out.w; ++x) {
+        gray[x] = 0.299f * r[x] + 0.587f * g[x] + 0.114f * b[x];
+      }
+    }
+  }
+};
+
+class GaussianStage : public Stage {
+public:
+  explicit GaussianStage(double sigma) : kernel_(GaussianKernel(sigma)) {}
+  int Halo() const override { return (int)kernel_.size() / 2; }
+  void Run(const Band &in, Band &out, int, Scratch &s) override {
+    const int r = Halo(), rows = in.y1 - in.y0;
+    s.tmp.resize((long)(out.y1 - out.y0 + 2 * r) * in.w);
+    s.line.resize(in.w + 2 * r);
+    for (int c = 0; c < in.channels; ++c) {
+      ConvolveRows(in.Row(c, in.y0), out.Row(c, out.y0), in.w, rows,
+                   out.y0 - in.y0, out.y1 - in.y0, kernel_, s.tmp.data(),
+                   s.line.data());
+    }
+  }
+
+private:
+  std::vector<float> kernel_;
+};
+
+class BoxStage : public Stage {
+public:
+  explicit BoxStage(int r) : r_(r) {}
+  int Halo() const override { return r_; }
+  void Run(const Band &in, Band &out, int, Scratch &s) override {
+    s.tmp.resize((long)(out.y1 - out.y0 + 2 * r_) * in.w);
+    s.sums.resize(in.w);
+    for (int c = 0; c < in.channels; ++c) {
+      BoxBlurRows(in.Row(c, in.y0), out.Row(c, out.y0), in.w, in.y1 - in.y0,
+                  out.y0 - in.y0, out.y1 - in.y0, r_, s.tmp.data(),
+                  s.sums.data());
+    }
+  }
+
+private:
+  int r_;
+};
+
+class MedianStage : public Stage {
+public:
+  explicit MedianStage(int r) : r_(r) {}
+  int Halo() const override { return r_; }
+  void Run(const Band &in, Band &out, int, Scratch &s) override {
+    const int w = in.w, rows = out.y1 - out.y0;
+    const long pw = w + 2 * r_;
+    s.pad.resize(pw * (rows + 2 * r_));
+    s.bytes.resize((long)rows * w);
+    for (int c = 0; c < in.channels; ++c) {
+      for (int y = out.y0 - r_; y < out.y1 + r_; ++y) {
+        const float *row = in.Row(c, std::min(in.y1 - 1, std::max(in.y0, y)));
+        uint8_t *padded = s.pad.data() + (y - out.y0 + r_) * pw;
+        for (int x = -r_; x < w + r_; ++x) {
+          padded[x + r_] = ClampColor(row[std::min(w - 1, std::max(0, x))]);
+        }
+      }
+      for (int x0 = 0; x0 < w; x0 += MEDIAN_TILE_COLS) {
+        MedianTile(s.pad.data(), s.bytes.data(), w, r_, x0,
+                   std::min(w, x0 + MEDIAN_TILE_COLS), 0, rows, s.columns);
+      }
+      for (int y = out.y0; y < out.y1; ++y) {
+        const uint8_t *bytes = s.bytes.data() + (long)(y - out.y0) * w;
+        std::copy(bytes, bytes + w, out.Row(c, y));
+      }
+    }
+  }
+
+private:
+  int r_;
+};
+
+/// Horizontal cyclic shift of every row, see rotatePPMHorizontal
+class ShiftStage : public Stage {
+public:
+  explicit ShiftStage(long shift) : shift_(shift) {}
+  void Run(const Band &in, Band &out, int, Scratch &) override {
+    const long s = NormalizeShift(shift_, in.w);
+    for (int c = 0; c < in.channels; ++c) {
+      for (int y = out.y0; y < out.y1; ++y) {
+        const float *row = in.Row(c, y);
+        float *new_row = out.Row(c, y);
+        std::copy(row, row + in.w - s, new_row + s);
+        std::copy(row + in.w - s, row + in.w, new_row);
+      }
+    }
+  }
+
+private:
+  long shift_;
+};
+
+/// 256-bin histogram of a gray band, or of the luma of an RGB band
+class HistogramTap : public Stage {
+public:
+  explicit HistogramTap(uint64_t *hist) : hist_(hist) {}
+  bool IsTap() const override { return true; }
+  void Start(int threads) override {
+    lanes_.assign(threads, std::vector<uint32_t>(HISTOGRAM_LANES * 256));
+  }
+  void Tap(const Band &band, int y0, int y1) override {
+    uint32_t *lanes = lanes_[omp_get_thread_num()].data();
+    uint8_t gray[HISTOGRAM_BLOCK];
+    for (int y = y0; y < y1; ++y) {
+      for (int x0 = 0; x0 < band.w; x0 += HISTOGRAM_BLOCK) {
+        const int len = std::min(HISTOGRAM_BLOCK, band.w - x0);
+        const float *r = band.Row(0, y) + x0;
+        if (band.channels == 1) {
+          for (int x = 0; x < len; ++x) {
+            gray[x] = ClampColor(r[x]);
+          }
+        } else {
+          const float *g = band.Row(1, y) + x0, *b = band.Row(2, y) + x0;
+          for (int x = 0; x < len; ++x) {
+            gray[x] = Gray(ClampColor(r[x]), ClampColor(g[x]), ClampColor(b[x]));
+          }
+        }
+        CountLanes(gray, len, lanes, 256);
+      }
+    }
+  }
+  void Finish() override {
+    std::fill(hist_, hist_ + 256, 0);
+    for (const auto &lanes : lanes_) {
+      for (int i = 0; i < HISTOGRAM_LANES * 256; ++i) {
+        hist_[i % 256] += lanes[i];
+      }
+    }
+  }
+
+private:
+  uint64_t *hist_;
+  std::vector<std::vector<uint32_t>> lanes_;
+};
+
+/// Store rows into `img` (same size as the source), optionally rotated along
+/// the whole buffer like rotatePPM. Gray bands are written to all channels.
+class WriteTap : public Stage {
+public:
+  WriteTap(PPMImage &img, long shift) : img_(img), shift_(shift) {}
+  bool IsTap() const override { return true; }
+  void Tap(const Band &band, int y0, int y1) override {
+    const int g = band.channels > 1 ? 1 : 0, b = band.channels > 1 ? 2 : 0;
+    for (int y = y0; y < y1; ++y) {
+      const float *red = band.Row(0, y), *green = band.Row(g, y),
+                  *blue = band.Row(b, y);
+      long to = NormalizeShift((long)y * band.w + shift_, img_.all);
+      for (int x = 0; x < band.w; ++x) {
+        PPMPixel &p = img_.data[to];
+        p.red = ClampColor(red[x]);
+        p.green = ClampColor(green[x]);
+        p.blue = ClampColor(blue[x]);
+        if (++to == img_.all) {
+          to = 0;
+        }
+      }
+    }
+  }
+
+private:
+  PPMImage &img_;
+  long shift_;
+};
+
+class Pipeline {
+public:
+  explicit Pipeline(const PPMImage &src) : src_(src) {}
+
+  Pipeline &Then(std::unique_ptr<Stage> stage) {
+    stages_.push_back(std::move(stage));
+    return *this;
+  }
+  Pipeline &Gray() { return Then(std::make_unique<GrayStage>()); }
+  Pipeline &Gaussian(double sigma) {
+    return Then(std::make_unique<GaussianStage>(sigma));
+  }
+  Pipeline &Box(int r) { return Then(std::make_unique<BoxStage>(r)); }
+  Pipeline &Median(int r) { return Then(std::make_unique<MedianStage>(r)); }
+  Pipeline &Shift(long shift) {
+    return Then(std::make_unique<ShiftStage>(shift));
+  }
+  Pipeline &Histogram(uint64_t *hist) {
+    return Then(std::make_unique<HistogramTap>(hist));
+  }
+  Pipeline &Write(PPMImage &dst, long shift = 0) {
+    return Then(std::make_unique<WriteTap>(dst, shift));
+  }
+
+  /// Fused execution, every tile of `tile_rows` rows runs the whole chain
+  void Run(int tile_rows = FILTER_TILE_ROWS) {
+    const int n = stages_.size(), h = src_.y;
+    const int threads = omp_get_max_threads();
+    for (auto &stage : stages_) {
+      stage->Start(threads);
+    }
+
+#pragma omp parallel num_threads(threads)
+    {
+      std::vector<float> in_buffer, out_buffer;
+      std::vector<std::pair<int, int>> rows(n + 1);
+      Scratch scratch;
+
+#pragma omp for schedule(dynamic)
+      for (int t0 = 0; t0 < h; t0 += tile_rows) {
+        const int t1 = std::min(h, t0 + tile_rows);
+        rows[n] = {t0, t1};
+        for (int k = n - 1; k >= 0; --k) {
+          int halo = stages_[k]->Halo();
+          rows[k] = {std::max(0, rows[k + 1].first - halo),
+                     std::min(h, rows[k + 1].second + halo)};
+        }
+
+        Band band = Load(rows[0].first, rows[0].second, in_buffer);
+        for (int k = 0; k < n; ++k) {
+          if (stages_[k]->IsTap()) {
+            stages_[k]->Tap(band, t0, t1);
+            continue;
+          }
+          Band out = Alloc(rows[k + 1].first, rows[k + 1].second,
+                           stages_[k]->Channels(band.channels), out_buffer);
+          stages_[k]->Run(band, out, h, scratch);
+          std::swap(in_buffer, out_buffer);
+          band = out;
+        }
+      }
+    }
+
+    for (auto &stage : stages_) {
+      stage->Finish();
+    }
+  }
+
+  /// The same chain stage by stage over whole images, for comparison
+  void RunStaged(int tile_rows = FILTER_TILE_ROWS) {
+    const int h = src_.y;
+    const int threads = omp_get_max_threads();
+    std::vector<float> in_buffer, out_buffer;
+    Band band = Load(0, h, in_buffer);
+
+    for (auto &stage : stages_) {
+      stage->Start(threads);
+      const bool tap = stage->IsTap();
+      Band out = tap ? band
+                     : Alloc(0, h, stage->Channels(band.channels), out_buffer);
+#pragma omp parallel num_threads(threads)
+      {
+        Scratch scratch;
+#pragma omp for schedule(dynamic)
+        for (int t0 = 0; t0 < h; t0 += tile_rows) {
+          const int t1 = std::min(h, t0 + tile_rows);
+          if (tap) {
+            stage->Tap(band, t0, t1);
+            continue;
+          }
+          int halo = stage->Halo();
+          Band in = band.View(std::max(0, t0 - halo), std::min(h, t1 + halo));
+          Band part = out.View(t0, t1);
+          stage->Run(in, part, h, scratch);
+        }
+      }
+      stage->Finish();
+      if (!tap) {
+        std::swap(in_buffer, out_buffer);
+        band = out;
+      }
+    }
+  }
+
+private:
+  Band Alloc(int y0, int y1, int channels, std::vector<float> &buffer) const {
+    const long stride = (long)(y1 - y0) * src_.x;
+    buffer.resize(channels * stride);
+    return {y0, y1, src_.x, channels, stride, buffer.data()};
+  }
+
+  /// Source rows as planar floats, the conversion stage of every chain
+  Band Load(int y0, int y1, std::vector<float> &buffer) const {
+    Band band = Alloc(y0, y1, 3, buffer);
+    const bool serial = omp_in_parallel();
+#pragma omp parallel for schedule(static) if (!serial)
+    for (int y = y0; y < y1; ++y) {
+      const PPMPixel *p = src_.data + (long)y * src_.x;
+      float *r = band.Row(0, y), *g = band.Row(1, y), *b = band.Row(2, y);
+      for (int x = 0; x < src_.x; ++x) {
+        r[x] = p[x].red;
+        g[x] = p[x].green;
+        b[x] = p[x].blue;
+      }
+    }
+    return band;
+  }
+
+  const PPMImage &src_;
+  std::vector<std::unique_ptr<Stage>> stages_;
+};
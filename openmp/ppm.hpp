@@ -0,0 +1,200 @@
+#pragma once
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <stdlib.h>
+#include <string>
+
+#include <omp.h>
+
+#define RGB_COMPONENT_COLOR 255
+
+struct PPMPixel {
+  int red;
+  int green;
+  int blue;
+};
+
+typedef struct {
+  int x, y, all;
+  PPMPixel *data;
+} PPMImage;
+
+inline void readPPM(const char *filename, PPMImage &img) {
+  std::ifstream file(filename);
+  if (file) {
+    std::string s;
+    int rgb_comp_color;
+    file >> s;
+    if (s != "P3") {
+      std::cout << "error in format" << std::endl;
+      exit(9);
+    }
+    file >> img.x >> img.y;
+    file >> rgb_comp_color;
+    img.all = img.x * img.y;
+    std::cout << s << std::endl;
+    std::cout << "x=" << img.x << " y=" << img.y << " all=" << img.all
+              << std::endl;
+    img.data = new PPMPixel[img.all];
+    for (int i = 0; i < img.all; i++) {
+      file >> img.data[i].red >> img.data[i].green >> img.data[i].blue;
+    }
+
+  } else {
+    std::cout << "the file:" << filename << "was not found" << std::endl;
+  }
+  file.close();
+}
+
+inline void writePPM(const char *filename, const PPMImage &img) {
+  std::ofstream file(filename, std::ofstream::out);
+  file << "P3" << std::endl;
+  file << img.x << " " << img.y << " " << std::endl;
+  file << RGB_COMPONENT_COLOR << std::endl;
+
+  for (int i = 0; i < img.all; i++) {
+    file << img.data[i].red << " " << img.data[i].green << " "
+         << img.data[i].blue << (((i + 1) % img.x == 0) ? "\n" : " ");
+  }
+  file.close();
+}
+
+/// Reduce any (possibly negative or huge) shift to [0, n)
+inline long NormalizeShift(long shift, long n) {
+  if (n == 0) {
+    return 0;
+  }
+  shift %= n;
+  return shift < 0 ? shift + n : shift;
+}
+
+/// dst[i] = src[(i - shift) mod n] with at most two memcpy per thread.
+/// The destination range is split evenly between threads, every chunk maps
+/// onto one or two contiguous pieces of the source.
+inline void RotateCopy(const PPMPixel *src, PPMPixel *dst, long n,
+                       long shift) {
+  shift = NormalizeShift(shift, n);
+  int threads = std::max(1, omp_get_max_threads());
+  // not worth waking the team for a few pages
+  if (n * (long)sizeof(PPMPixel) < (1 << 16)) {
+    threads = 1;
+  }
+
+#pragma omp parallel for num_threads(threads) schedule(static)
+  for (int t = 0; t < threads; ++t) {
+    long begin = n * t / threads;
+    long end = n * (t + 1) / threads;
+    while (begin < end) {
+      long from = begin - shift;
+      if (from < 0) {
+        from += n;
+      }
+      long len = std::min(end - begin, n - from);
+      std::memcpy(dst + begin, src + from, len * sizeof(PPMPixel));
+      begin += len;
+    }
+  }
+}
+
+/// Cyclic shift of the whole pixel buffer by `shift` positions in one pass:
+/// the same result as `shift` calls of the one-step loop in Car.cpp.
+/// Negative values shift towards the beginning.
+inline void rotatePPM(PPMImage &img, long shift) {
+  if (NormalizeShift(shift, img.all) == 0) {
+    return;
+  }
+  PPMPixel *new_data = new PPMPixel[img.all];
+  RotateCopy(img.data, new_data, img.all, shift);
+  delete[] img.data;
+  img.data = new_data;
+}
+
+/// Vertical cyclic shift: rows move down by `shift`
+inline void rotatePPMVertical(PPMImage &img, long shift) {
+  rotatePPM(img, NormalizeShift(shift, img.y) * img.x);
+}
+
+/// Rotate every row of a x-by-y pixel block right by `shift` < x
+inline void RotateRows(const PPMPixel *src, PPMPixel *dst, long x, long y,
+                       long shift) {
+#pragma omp parallel for schedule(static)
+  for (long i = 0; i < y; ++i) {
+    const PPMPixel *row = src + i * x;
+    PPMPixel *new_row = dst + i * x;
+    std::memcpy(new_row + shift, row, (x - shift) * sizeof(PPMPixel));
+    std::memcpy(new_row, row + x - shift, shift * sizeof(PPMPixel));
+  }
+}
+
+/// Horizontal cyclic shift: every row is rotated right by `shift` on its own
+inline void rotatePPMHorizontal(PPMImage &img, long shift) {
+  shift = NormalizeShift(shift, img.x);
+  if (shift == 0) {
+    return;
+  }
+  PPMPixel *new_data = new PPMPixel[img.all];
+  RotateRows(img.data, new_data, img.x, img.y, shift);
+  delete[] img.data;
+  img.data = new_data;
+}
+
+/// In-place rotation by the reversal algorithm, for images that cannot afford
+/// a second buffer: reverse both parts, then the whole buffer.
+inline void rotatePPMInplace(PPMImage &img, long shift) {
+  shift = NormalizeShift(shift, img.all);
+  if (shift == 0) {
+    return;
+  }
+  auto reverse = [](PPMPixel *first, long n) {
+#pragma omp parallel for schedule(static)
+    for (long i = 0; i < n / 2; ++i) {
+      std::swap(first[i], first[n - 1 - i]);
+    }
+  };
+  reverse(img.data, img.all - shift);
+  reverse(img.data + img.all - shift, shift);
+  reverse(img.data, img.all);
+}
+
+enum class ShiftDirection { Linear, Vertical, Horizontal };
+
+/// Emit frames for shifts step, 2 * step, ..., frames * step without
+/// reshifting the image for every frame.
+///
+/// Linear and vertical shifts of a cyclic buffer are windows of the buffer
+/// concatenated with itself, so those frames are served as views into one
+/// doubled copy and cost nothing. Horizontal frames are not contiguous and are
+/// produced by one row-wise copy from the original.
+/// The frame passed to `callback` is only valid during the call.
+inline void animatePPM(
+    const PPMImage &img, int frames, long step, ShiftDirection direction,
+    const std::function<void(int, const PPMImage &)> &callback) {
+  PPMImage frame = img;
+
+  if (direction == ShiftDirection::Horizontal) {
+    frame.data = new PPMPixel[img.all];
+    for (int k = 1; k <= frames; ++k) {
+      RotateRows(img.data, frame.data, img.x, img.y,
+                 NormalizeShift(step * k, img.x));
+      callback(k, frame);
+    }
+    delete[] frame.data;
+    return;
+  }
+
+  if (direction == ShiftDirection::Vertical) {
+    step *= img.x;
+  }
+  PPMPixel *doubled = new PPMPixel[2L * img.all];
+  RotateCopy(img.data, doubled, img.all, 0);
+  RotateCopy(img.data, doubled + img.all, img.all, 0);
+  for (int k = 1; k <= frames; ++k) {
+    frame.data = doubled + img.all - NormalizeShift(step * k, img.all);
+    callback(k, frame);
+  }
+  delete[] doubled;
+}
@@ -0,0 +1,341 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <omp.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+/*
+ * Accurate and reproducible reductions of doubles, usable from C and C++.
+ *
+ * The input is cut into fixed blocks of REDUCE_BLOCK elements, independent of
+ * the number of threads. Every block is summed with REDUCE_LANES compensated
+ * (Neumaier) accumulators in a fixed order, so its result only depends on the
+ * data. Block results are then added into an exact fixed-point accumulator
+ * (reduce_acc), where addition is integer and therefore associative: the
+ * final value is the same bit pattern whichever threads or ranks summed which
+ * blocks. reduction(+ : ...) in contrast changes with the thread count.
+ *
+ * NaN and infinities cannot be held in fixed point: they are summed apart,
+ * with plain +, and returned instead of the fixed-point sum as soon as there
+ * is one, so they propagate as in a plain sum.
+ *
+ * Ranks must own whole blocks (offsets multiple of REDUCE_BLOCK) for the MPI
+ * versions to match the single process result.
+ */
+
+#define REDUCE_BLOCK 4096
+#define REDUCE_LANES 8
+
+/* Fixed point with 32-bit digits kept in 64-bit limbs, bit 0 is 2^-1152:
+   room for subnormals at the bottom and 64 bits of carries at the top */
+#define REDUCE_LIMBS 70
+#define REDUCE_LIMB_BITS 32
+#define REDUCE_OFFSET 1152
+
+typedef struct {
+  int64_t limb[REDUCE_LIMBS];
+  /* additions since the last carry propagation */
+  int64_t pending;
+  /* sum of the NaN and infinite inputs, 0 if none */
+  double special;
+} reduce_acc;
+
+static inline void reduce_acc_init(reduce_acc *acc) {
+  for (int i = 0; i < REDUCE_LIMBS; ++i) {
+    acc->limb[i] = 0;
+  }
+  acc->pending = 0;
+  acc->special = 0;
+}
+
+/* Bring every limb but the top one into [0, 2^32) */
+static inline void reduce_acc_normalize(reduce_acc *acc) {
+  for (int i = 0; i + 1 < REDUCE_LIMBS; ++i) {
+    int64_t carry = acc->limb[i] >> REDUCE_LIMB_BITS;
+    acc->limb[i] -= carry * ((int64_t)1 << REDUCE_LIMB_BITS);
+    acc->limb[i + 1] += carry;
+  }
+  acc->pending = 0;
+}
+
+/* Exact: value = m * 2^e with a 53-bit integer m spread over three limbs */
+static inline void reduce_acc_add(reduce_acc *acc, double value) {
+  if (value == 0) {
+    return;
+  }
+  if (!isfinite(value)) {
+    acc->special += value;
+    return;
+  }
+  int e;
+  double f = frexp(fabs(value), &e);
+  int64_t m = (int64_t)ldexp(f, 53);
+  int bit = e - 53 + REDUCE_OFFSET;
+  int index = bit / REDUCE_LIMB_BITS, shift = bit % REDUCE_LIMB_BITS;
+  unsigned __int128 wide = (unsigned __int128)m << shift;
+  int64_t sign = value < 0 ? -1 : 1;
+  for (int k = 0; k < 3 && index + k < REDUCE_LIMBS; ++k) {
+    acc->limb[index + k] += sign * (int64_t)(uint32_t)(wide >> (32 * k));
+  }
+  /* every addition moves a limb by less than 2^32, 2^30 of them are safe */
+  if (++acc->pending == (int64_t)1 << 30) {
+    reduce_acc_normalize(acc);
+  }
+}
+
+static inline void reduce_acc_merge(reduce_acc *acc, const reduce_acc *other) {
+  if (acc->pending + other->pending >= (int64_t)1 << 30) {
+    reduce_acc_normalize(acc);
+  }
+  for (int i = 0; i < REDUCE_LIMBS; ++i) {
+    acc->limb[i] += other->limb[i];
+  }
+  acc->pending += other->pending;
+  acc->special += other->special;
+}
+
+/* The accumulated sum as the double nearest to the top 96 bits, or the
+   NaN or infinity added */
+static inline double reduce_acc_value(const reduce_acc *in) {
+  if (in->special != 0) {
+    return in->special;
+  }
+  reduce_acc acc = *in;
+  reduce_acc_normalize(&acc);
+  double sign = 1;
+  if (acc.limb[REDUCE_LIMBS - 1] < 0) {
+    for (int i = 0; i < REDUCE_LIMBS; ++i) {
+      acc.limb[i] = -acc.limb[i];
+    }
+    reduce_acc_normalize(&acc);
+    sign = -1;
+  }
+  int top = REDUCE_LIMBS - 1;
+  while (top > 0 && acc.limb[top] == 0) {
+    --top;
+  }
+  double value = 0;
+  for (int i = top; i >= 0 && i > top - 3; --i) {
+    value += ldexp((double)acc.limb[i],
+                   REDUCE_LIMB_BITS * i - REDUCE_OFFSET);
+  }
+  return sign * value;
+}
+
+/* Rounding error of t = a + b (Neumaier), selects instead of branches */
+static inline double reduce_sum_error(double a, double b, double t) {
+  int a_big = fabs(a) >= fabs(b);
+  double big = a_big ? a : b, small = a_big ? b : a;
+  return (big - t) + small;
+}
+
+/* s + x with the rounding error added to c */
+static inline void reduce_two_sum(double *s, double *c, double x) {
+  double t = *s + x;
+  *c += reduce_sum_error(*s, x, t);
+  *s = t;
+}
+
+/* Fold the lanes in a fixed order */
+static inline void reduce_lanes(const double *s, const double *c, double *sum,
+                                double *comp) {
+  double total = 0, error = 0;
+  for (int l = 0; l < REDUCE_LANES; ++l) {
+    reduce_two_sum(&total, &error, s[l]);
+    error += c[l];
+  }
+  *sum = total;
+  /* after an infinity the compensation is Inf - Inf, not an error term */
+  *comp = isfinite(total) ? error : 0;
+}
+
+/* Compensated sum of one block, the true sum is about *sum + *comp */
+static inline void reduce_block_sum(const double *x, size_t n, double *sum,
+                                    double *comp) {
+  double s[REDUCE_LANES] = {0}, c[REDUCE_LANES] = {0};
+  size_t i = 0;
+  for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+#pragma omp simd
+    for (int l = 0; l < REDUCE_LANES; ++l) {
+      double t = s[l] + x[i + l];
+      c[l] += reduce_sum_error(s[l], x[i + l], t);
+      s[l] = t;
+    }
+  }
+  for (; i < n; ++i) {
+    reduce_two_sum(&s[0], &c[0], x[i]);
+  }
+  reduce_lanes(s, c, sum, comp);
+}
+
+/* Compensated dot product of one block, product errors recovered by fma */
+static inline void reduce_block_dot(const double *x, const double *y, size_t n,
+                                    double *sum, double *comp) {
+  double s[REDUCE_LANES] = {0}, c[REDUCE_LANES] = {0};
+  size_t i = 0;
+  for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+#pragma omp simd
+    for (int l = 0; l < REDUCE_LANES; ++l) {
+      double p = x[i + l] * y[i + l];
+      double e = fma(x[i + l], y[i + l], -p);
+      double t = s[l] + p;
+      c[l] += reduce_sum_error(s[l], p, t) + e;
+      s[l] = t;
+    }
+  }
+  for (; i < n; ++i) {
+    double p = x[i] * y[i];
+    c[0] += fma(x[i], y[i], -p);
+    reduce_two_sum(&s[0], &c[0], p);
+  }
+  reduce_lanes(s, c, sum, comp);
+}
+
+/* Sum of (x - y)^2 of one block, e.g. the distance between two iterates */
+static inline void reduce_block_dist2(const double *x, const double *y,
+                                      size_t n, double *sum, double *comp) {
+  double s[REDUCE_LANES] = {0}, c[REDUCE_LANES] = {0};
+  size_t i = 0;
+  for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+#pragma omp simd
+    for (int l = 0; l < REDUCE_LANES; ++l) {
+      double d = x[i + l] - y[i + l];
+      double p = d * d;
+      double e = fma(d, d, -p);
+      double t = s[l] + p;
+      c[l] += reduce_sum_error(s[l], p, t) + e;
+      s[l] = t;
+    }
+  }
+  for (; i < n; ++i) {
+    double d = x[i] - y[i];
+    double p = d * d;
+    c[0] += fma(d, d, -p);
+    reduce_two_sum(&s[0], &c[0], p);
+  }
+  reduce_lanes(s, c, sum, comp);
+}
+
+enum reduce_kind { REDUCE_SUM, REDUCE_DOT, REDUCE_DIST2 };
+
+/* Add the blocks of x (and y) to acc in parallel */
+static inline void reduce_accumulate(reduce_acc *acc, enum reduce_kind kind,
+                                     const double *x, const double *y,
+                                     size_t n) {
+  const size_t blocks = (n + REDUCE_BLOCK - 1) / REDUCE_BLOCK;
+
+#pragma omp parallel if (blocks > 1)
+  {
+    reduce_acc mine;
+    reduce_acc_init(&mine);
+#pragma omp for schedule(static)
+    for (size_t b = 0; b < blocks; ++b) {
+      size_t first = b * REDUCE_BLOCK;
+      size_t len = n - first < REDUCE_BLOCK ? n - first : REDUCE_BLOCK;
+      double sum, comp;
+      if (kind == REDUCE_SUM) {
+        reduce_block_sum(x + first, len, &sum, &comp);
+      } else if (kind == REDUCE_DOT) {
+        reduce_block_dot(x + first, y + first, len, &sum, &comp);
+      } else {
+        reduce_block_dist2(x + first, y + first, len, &sum, &comp);
+      }
+      reduce_acc_add(&mine, sum);
+      reduce_acc_add(&mine, comp);
+    }
+#pragma omp critical(reduce_merge)
+    reduce_acc_merge(acc, &mine);
+  }
+}
+
+static inline double reduce_run(enum reduce_kind kind, const double *x,
+                                const double *y, size_t n) {
+  reduce_acc acc;
+  reduce_acc_init(&acc);
+  reduce_accumulate(&acc, kind, x, y, n);
+  return reduce_acc_value(&acc);
+}
+
+/* Reproducible sum, dot product, squared distance and 2-norm */
+static inline double reduce_sum(const double *x, size_t n) {
+  return reduce_run(REDUCE_SUM, x, NULL, n);
+}
+
+static inline double reduce_dot(const double *x, const double *y, size_t n) {
+  return reduce_run(REDUCE_DOT, x, y, n);
+}
+
+static inline double reduce_dist2(const double *x, const double *y, size_t n) {
+  return reduce_run(REDUCE_DIST2, x, y, n);
+}
+
+static inline double reduce_norm2(const double *x, size_t n) {
+  return sqrt(reduce_dot(x, x, n));
+}
+
+/*
+ * Fast deterministic alternatives for one thread: pairwise sum with
+ * vectorized leaves (error O(log n) ulp) and a plain Neumaier sum
+ */
+static inline double reduce_sum_pairwise(const double *x, size_t n) {
+  if (n <= 1024) {
+    double s[REDUCE_LANES] = {0};
+    size_t i = 0;
+    for (; i + REDUCE_LANES <= n; i += REDUCE_LANES) {
+#pragma omp simd
+      for (int l = 0; l < REDUCE_LANES; ++l) {
+        s[l] += x[i + l];
+      }
+    }
+    for (; i < n; ++i) {
+      s[0] += x[i];
+    }
+    return ((s[0] + s[1]) + (s[2] + s[3])) + ((s[4] + s[5]) + (s[6] + s[7]));
+  }
+  size_t half = n / 2 / REDUCE_LANES * REDUCE_LANES;
+  return reduce_sum_pairwise(x, half) + reduce_sum_pairwise(x + half, n - half);
+}
+
+static inline double reduce_sum_kahan(const double *x, size_t n) {
+  double s = 0, c = 0;
+  for (size_t i = 0; i < n; ++i) {
+    reduce_two_sum(&s, &c, x[i]);
+  }
+  return s + c;
+}
+
+#ifdef USE_MPI
+/* Exact accumulators of all ranks summed limb by limb, result on every rank */
+static inline void reduce_acc_allreduce(reduce_acc *acc, MPI_Comm comm) {
+  reduce_acc_normalize(acc);
+  MPI_Allreduce(MPI_IN_PLACE, acc->limb, REDUCE_LIMBS, MPI_INT64_T, MPI_SUM,
+                comm);
+  MPI_Allreduce(MPI_IN_PLACE, &acc->special, 1, MPI_DOUBLE, MPI_SUM, comm);
+}
+
+static inline double reduce_sum_mpi(const double *x, size_t n, MPI_Comm comm) {
+  reduce_acc acc;
+  reduce_acc_init(&acc);
+  reduce_accumulate(&acc, REDUCE_SUM, x, NULL, n);
+  reduce_acc_allreduce(&acc, comm);
+  return reduce_acc_value(&acc);
+}
+
+static inline double reduce_dot_mpi(const double *x, const double *y, size_t n,
+                                    MPI_Comm comm) {
+  reduce_acc acc;
+  reduce_acc_init(&acc);
+  reduce_accumulate(&acc, REDUCE_DOT, x, y, n);
+  reduce_acc_allreduce(&acc, comm);
+  return reduce_acc_value(&acc);
+}
+#endif
+
+#endif
@@ -0,0 +1,334 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <vector>
+
+#include <omp.h>
+
+#include "thread_pool.hpp"
+
+// Dependency graph of vector kernels.
+//
+// Kernels declare the arrays they read and write; dependencies follow from
+// program order (read after write, write after read, write after write), as
+// with `omp task depend`. Element-wise kernels (Map) and sums (Reduce) over
+// vectors of the same length are fused into passes: a pass walks its
+// vectors block by block and runs all of its kernels on a block before
+// moving on, so intermediate vectors are touched while still in cache and
+// a chain of k operations reads memory once instead of k times. Passes and
+// opaque kernels (Task) form a DAG executed as OpenMP tasks or on a
+// ThreadPool; inside a pass the blocks are spread over all threads, unlike
+// `omp sections` whose parallelism is the number of sections.
+//
+// A graph can be Run any number of times, e.g. once per solver iteration.
+// Sums add the per-block partial sums in block order, so they do not depend
+// on the number of threads.
+
+/// Elements per block of a pass: a few vectors of it fit in L2
+static const long TASK_GRAPH_BLOCK = 4096;
+
+class TaskGraph {
+public:
+  /// n doubles at data
+  struct Vec {
+    int id;
+    double *data;
+    long n;
+  };
+  /// One double, broadcast when used in element-wise kernels
+  struct Val {
+    int id;
+    double *data;
+  };
+
+  enum class Backend { OpenMP, Pool };
+
+  Vec Vector(double *data, long n) { return {arrays_++, data, n}; }
+  Val Scalar(double *value) { return {arrays_++, value}; }
+
+  /// out[i] = f(in[i]...) where a Val argument passes its value
+  template <typename F, typename... In> void Map(Vec out, F f, In... in) {
+    Node node;
+    node.kind = Kind::Elementwise;
+    node.n = out.n;
+    double *data = out.data;
+    node.block = [=](long begin, long end) {
+      auto args = std::make_tuple(Bind(in)...);
+      std::apply(
+          [&](auto... a) {
+#pragma omp simd
+            for (long i = begin; i < end; ++i) {
+              data[i] = f(a[i]...);
+            }
+          },
+          args);
+    };
+    Add(std::move(node), {in.id...}, {out.id});
+  }
+
+  /// *out = sum over i of f(in[i]...)
+  template <typename F, typename... In> void Reduce(Val out, F f, In... in) {
+    Node node;
+    node.kind = Kind::Reduction;
+    node.n = Length(in...);
+    node.result = out.data;
+    node.partial = [=](long begin, long end) {
+      auto args = std::make_tuple(Bind(in)...);
+      double sum = 0;
+      std::apply(
+          [&](auto... a) {
+#pragma omp simd reduction(+ : sum)
+            for (long i = begin; i < end; ++i) {
+              sum += f(a[i]...);
+            }
+          },
+          args);
+      return sum;
+    };
+    Add(std::move(node), {in.id...}, {out.id});
+  }
+
+  /// Opaque kernel (a solver sweep, I/O, ...) on the arrays with the given
+  /// ids, never fused
+  void Task(std::function<void()> fn, std::initializer_list<int> reads,
+            std::initializer_list<int> writes) {
+    Node node;
+    node.kind = Kind::Opaque;
+    node.run = std::move(fn);
+    Add(std::move(node), reads, writes);
+  }
+
+  /// Number of passes and opaque tasks the kernels were grouped into
+  int Passes() const { return groups_.size(); }
+  int Kernels() const { return nodes_.size(); }
+
+  void Run(Backend backend = Backend::OpenMP,
+           ThreadPool &pool = ThreadPool::Global()) {
+    if (backend == Backend::OpenMP) {
+      RunOpenMP();
+    } else {
+      RunPool(pool);
+    }
+  }
+
+private:
+  enum class Kind { Elementwise, Reduction, Opaque };
+
+  struct Node {
+    Kind kind;
+    long n = 0;
+    std::function<void(long, long)> block;
+    std::function<double(long, long)> partial;
+    double *result = nullptr;
+    std::function<void()> run;
+    std::vector<int> deps;
+  };
+
+  /// Fused pass, or a single opaque task
+  struct Group {
+    std::vector<int> nodes;
+    long n = 0;
+    bool fusible = false;
+    // nodes outside the group it waits for; never grows once nodes join, so
+    // fusing cannot create a cycle
+    std::set<int> external;
+    std::vector<int> deps, next;
+  };
+
+  struct VecRef {
+    const double *p;
+    double operator[](long i) const { return p[i]; }
+  };
+  struct ValRef {
+    double v;
+    double operator[](long) const { return v; }
+  };
+  static VecRef Bind(const Vec &v) { return {v.data}; }
+  static ValRef Bind(const Val &v) { return {*v.data}; }
+
+  static long Length() { return 1; }
+  template <typename... Rest> static long Length(const Vec &v, Rest... rest) {
+    return v.n;
+  }
+  template <typename... Rest> static long Length(const Val &, Rest... rest) {
+    return Length(rest...);
+  }
+
+  /// Hazards against earlier kernels, then the pass the node can join
+  void Add(Node node, std::initializer_list<int> reads,
+           std::initializer_list<int> writes) {
+    const int index = nodes_.size();
+    writer_.resize(arrays_, -1);
+    readers_.resize(arrays_);
+    std::set<int> deps;
+    for (int id : reads) {
+      if (writer_[id] >= 0) {
+        deps.insert(writer_[id]);
+      }
+    }
+    for (int id : writes) {
+      if (writer_[id] >= 0) {
+        deps.insert(writer_[id]);
+      }
+      deps.insert(readers_[id].begin(), readers_[id].end());
+    }
+    for (int id : reads) {
+      readers_[id].push_back(index);
+    }
+    for (int id : writes) {
+      writer_[id] = index;
+      readers_[id].clear();
+    }
+    deps.erase(index);
+    node.deps.assign(deps.begin(), deps.end());
+
+    const bool fusible = node.kind != Kind::Opaque;
+    const long n = node.n;
+    nodes_.push_back(std::move(node));
+    group_of_.push_back(-1);
+
+    if (fusible && !groups_.empty() && groups_.back().fusible &&
+        groups_.back().n == n && CanJoin(groups_.back(), deps)) {
+      groups_.back().nodes.push_back(index);
+      group_of_[index] = groups_.size() - 1;
+      return;
+    }
+    Group group;
+    group.nodes = {index};
+    group.n = n;
+    group.fusible = fusible;
+    group.external = deps;
+    groups_.push_back(std::move(group));
+    group_of_[index] = groups_.size() - 1;
+    Link(groups_.size() - 1);
+  }
+
+  /// Every dependency is already satisfied before the pass starts or is an
+  /// element-wise kernel of the pass (sums finish only at its end)
+  bool CanJoin(const Group &group, const std::set<int> &deps) const {
+    const int g = &group - groups_.data();
+    for (int d : deps) {
+      bool inside = group_of_[d] == g && nodes_[d].kind == Kind::Elementwise;
+      if (!inside && !group.external.count(d)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Link(int g) {
+    std::set<int> deps;
+    for (int d : groups_[g].external) {
+      deps.insert(group_of_[d]);
+    }
+    groups_[g].deps.assign(deps.begin(), deps.end());
+    for (int d : deps) {
+      groups_[d].next.push_back(g);
+    }
+  }
+
+  /// Blocks of a pass through parallel_for(count, body(k)); the sums are
+  /// combined in block order afterwards
+  template <typename ParallelFor>
+  void RunGroup(const Group &group, ParallelFor parallel_for) {
+    if (!group.fusible) {
+      nodes_[group.nodes[0]].run();
+      return;
+    }
+    const long blocks = (group.n + TASK_GRAPH_BLOCK - 1) / TASK_GRAPH_BLOCK;
+    std::vector<int> sums;
+    for (int v : group.nodes) {
+      if (nodes_[v].kind == Kind::Reduction) {
+        sums.push_back(v);
+      }
+    }
+    std::vector<double> partial(sums.size() * blocks);
+    parallel_for(blocks, [&](long k) {
+      const long begin = k * TASK_GRAPH_BLOCK;
+      const long end = std::min(group.n, begin + TASK_GRAPH_BLOCK);
+      int s = 0;
+      for (int v : group.nodes) {
+        if (nodes_[v].kind == Kind::Elementwise) {
+          nodes_[v].block(begin, end);
+        } else {
+          partial[s++ * blocks + k] = nodes_[v].partial(begin, end);
+        }
+      }
+    });
+    for (size_t s = 0; s < sums.size(); ++s) {
+      double total = 0;
+      for (long k = 0; k < blocks; ++k) {
+        total += partial[s * blocks + k];
+      }
+      *nodes_[sums[s]].result = total;
+    }
+  }
+
+  /// Passes become tasks once their predecessors finish, blocks of a pass
+  /// are a taskloop
+  void RunOpenMP() {
+    const int count = groups_.size();
+    std::unique_ptr<std::atomic<int>[]> waiting(new std::atomic<int>[count]);
+    for (int g = 0; g < count; ++g) {
+      waiting[g] = groups_[g].deps.size();
+    }
+    auto parallel_for = [](long blocks, const std::function<void(long)> &body) {
+#pragma omp taskloop grainsize(1)
+      for (long k = 0; k < blocks; ++k) {
+        body(k);
+      }
+    };
+    std::function<void(int)> run = [&](int g) {
+      RunGroup(groups_[g], parallel_for);
+      for (int next : groups_[g].next) {
+        if (waiting[next].fetch_sub(1) == 1) {
+#pragma omp task firstprivate(next) shared(run)
+          run(next);
+        }
+      }
+    };
+
+#pragma omp parallel
+#pragma omp single
+    for (int g = 0; g < count; ++g) {
+      if (groups_[g].deps.empty()) {
+#pragma omp task firstprivate(g) shared(run)
+        run(g);
+      }
+    }
+  }
+
+  void RunPool(ThreadPool &pool) {
+    auto parallel_for = [&pool](long blocks,
+                                const std::function<void(long)> &body) {
+      pool.ParallelFor(0, blocks, body, 1);
+    };
+    std::vector<ThreadPool::TaskHandle> handles(groups_.size());
+    for (size_t g = 0; g < groups_.size(); ++g) {
+      std::vector<ThreadPool::TaskHandle> deps;
+      for (int d : groups_[g].deps) {
+        deps.push_back(handles[d]);
+      }
+      handles[g] = pool.Spawn(
+          [this, g, parallel_for] { RunGroup(groups_[g], parallel_for); },
+          deps);
+    }
+    for (auto &handle : handles) {
+      pool.Wait(handle);
+    }
+  }
+
+  int arrays_ = 0;
+  std::vector<Node> nodes_;
+  std::vector<int> group_of_;
+  std::vector<Group> groups_;
+  // last writer and readers since, per array id
+  std::vector<int> writer_;
+  std::vector<std::vector<int>> readers_;
+};
@@ -0,0 +1,381 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <initializer_list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+// Persistent work-stealing thread pool.
+//
+// `omp parallel for num_threads(THREADS)` inside an iteration loop forks and
+// joins a team per sweep, and a parallel for nested in another one either
+// oversubscribes or runs serially. Here the workers are created once (and
+// pinned to cores on Linux), every worker owns a deque of tasks: it pops its
+// own newest task, idle workers steal the oldest task of someone else. A
+// thread waiting for tasks runs queued tasks meanwhile, so nested
+// ParallelFor/ParallelReduce calls from inside tasks are fine.
+//
+// The calling thread takes part in the work, a pool of size n starts n - 1
+// workers; with n = 1 everything runs inline without any synchronization.
+
+class ThreadPool {
+public:
+  using Task = std::function<void()>;
+
+  /// Node of a task graph, see Spawn
+  struct TaskNode {
+    Task fn;
+    std::atomic<int> deps{1};
+    std::atomic<bool> done{false};
+    std::mutex mutex;
+    std::vector<std::shared_ptr<TaskNode>> next;
+  };
+  using TaskHandle = std::shared_ptr<TaskNode>;
+
+  /// Set of tasks to wait for together
+  class TaskGroup {
+  public:
+    explicit TaskGroup(ThreadPool &pool) : pool_(pool) {}
+    ~TaskGroup() { Wait(); }
+
+    template <typename F> void Run(F &&f) {
+      pending_.fetch_add(1, std::memory_order_relaxed);
+      pool_.Push([this, f = std::forward<F>(f)]() mutable {
+        f();
+        pending_.fetch_sub(1, std::memory_order_release);
+      });
+    }
+
+    void Wait() {
+      pool_.HelpUntil([this] {
+        return pending_.load(std::memory_order_acquire) == 0;
+      });
+    }
+
+  private:
+    ThreadPool &pool_;
+    std::atomic<long> pending_{0};
+  };
+
+  explicit ThreadPool(int threads = std::thread::hardware_concurrency(),
+                      bool pin = true)
+      : size_(std::max(1, threads)), pin_(pin), queues_(size_) {
+    for (int i = 0; i + 1 < size_; ++i) {
+      workers_.emplace_back([this, i] { WorkerLoop(i); });
+    }
+  }
+
+  ~ThreadPool() {
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      stop_ = true;
+    }
+    wake_.notify_all();
+    for (auto &worker : workers_) {
+      worker.join();
+    }
+  }
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// Threads doing the work, the caller included
+  int Size() const { return size_; }
+
+  /// Pool shared by the programs, one thread per core
+  static ThreadPool &Global() {
+    static ThreadPool pool;
+    return pool;
+  }
+
+  /// body(i) for every i in [begin, end). Ranges are cut lazily: a range is
+  /// halved (and the upper half queued) only while the other threads have
+  /// no work, otherwise `grain` iterations at a time run in place. The
+  /// default grain is about 1/8 of a thread's share.
+  template <typename Body>
+  void ParallelFor(long begin, long end, Body body, long grain = 0) {
+    if (end <= begin) {
+      return;
+    }
+    grain = Grain(end - begin, grain);
+    if (size_ == 1 || end - begin <= grain) {
+      for (long i = begin; i < end; ++i) {
+        body(i);
+      }
+      return;
+    }
+    TaskGroup group(*this);
+    ForRange(group, begin, end, grain, body);
+    group.Wait();
+  }
+
+  /// body(t) once on every thread of the pool, t in [0, Size()): the
+  /// caller is 0 and worker i is i + 1, the same on every call. For work
+  /// that has to stay with one thread from call to call (first-touch page
+  /// placement), which ParallelFor does not promise. Call it from outside
+  /// the pool's tasks. In a pinning pool the caller is pinned to core 0
+  /// (the workers take the next ones) and stays there afterwards.
+  template <typename Body> void ForEachThread(Body body) {
+    if (pin_) {
+      PinTo(0);
+    }
+    std::atomic<int> pending{size_ - 1};
+    for (int i = 0; i + 1 < size_; ++i) {
+      {
+        std::lock_guard<std::mutex> lock(queues_[i].mutex);
+        queues_[i].pinned.push_back([&body, &pending, i] {
+          body(i + 1);
+          pending.fetch_sub(1, std::memory_order_release);
+        });
+      }
+      queued_.fetch_add(1);
+    }
+    if (size_ > 1 && sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      wake_.notify_all();
+    }
+    body(0);
+    HelpUntil([&pending] {
+      return pending.load(std::memory_order_acquire) == 0;
+    });
+  }
+
+  /// combine over map(b, e) of the pieces of [begin, end) no longer than
+  /// grain. The split tree only depends on the range and the grain, so with
+  /// an explicit grain the result is the same for every pool size.
+  template <typename T, typename Map, typename Combine>
+  T ParallelReduce(long begin, long end, T identity, Map map, Combine combine,
+                   long grain = 0) {
+    if (end <= begin) {
+      return identity;
+    }
+    return ReduceRange(begin, end, Grain(end - begin, grain), map, combine);
+  }
+
+  /// Queue fn to run after all of deps have finished. Returns a handle to
+  /// depend on or to Wait for.
+  TaskHandle Spawn(Task fn, std::initializer_list<TaskHandle> deps = {}) {
+    return Spawn(std::move(fn), std::vector<TaskHandle>(deps));
+  }
+
+  TaskHandle Spawn(Task fn, const std::vector<TaskHandle> &deps) {
+    auto node = std::make_shared<TaskNode>();
+    node->fn = std::move(fn);
+    for (const auto &dep : deps) {
+      std::lock_guard<std::mutex> lock(dep->mutex);
+      if (!dep->done.load(std::memory_order_acquire)) {
+        node->deps.fetch_add(1, std::memory_order_relaxed);
+        dep->next.push_back(node);
+      }
+    }
+    Release(node);
+    return node;
+  }
+
+  void Wait(const TaskHandle &node) {
+    HelpUntil([&node] { return node->done.load(std::memory_order_acquire); });
+  }
+
+  /// Run queued tasks until done() holds
+  template <typename Done> void HelpUntil(Done done) {
+    while (!done()) {
+      if (!RunOne()) {
+        std::this_thread::yield();
+      }
+    }
+  }
+
+private:
+  struct alignas(64) Queue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+    /// ForEachThread tasks, run by the owner only
+    std::deque<Task> pinned;
+  };
+
+  long Grain(long n, long grain) const {
+    return grain > 0 ? grain : std::max(1L, n / (8L * size_));
+  }
+
+  static int &Index() {
+    static thread_local int index = -1;
+    return index;
+  }
+
+  static const ThreadPool *&Owner() {
+    static thread_local const ThreadPool *owner = nullptr;
+    return owner;
+  }
+
+  /// Queue of the calling thread: its own for workers, the last (shared)
+  /// one for any other thread
+  int Self() const { return Owner() == this ? Index() : size_ - 1; }
+
+  void Push(Task task) {
+    Queue &queue = queues_[Self()];
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(std::move(task));
+    }
+    queued_.fetch_add(1);
+    if (sleeping_.load() > 0) {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+      wake_.notify_one();
+    }
+  }
+
+  bool Pop(int q, bool newest, Task &task) {
+    Queue &queue = queues_[q];
+    std::lock_guard<std::mutex> lock(queue.mutex);
+    if (newest && !queue.pinned.empty()) {
+      task = std::move(queue.pinned.front());
+      queue.pinned.pop_front();
+    } else if (queue.tasks.empty()) {
+      return false;
+    } else if (newest) {
+      task = std::move(queue.tasks.back());
+      queue.tasks.pop_back();
+    } else {
+      task = std::move(queue.tasks.front());
+      queue.tasks.pop_front();
+    }
+    queued_.fetch_sub(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  /// Own pinned, then own newest task first, then steal the oldest one
+  /// round-robin
+  bool RunOne() {
+    if (queued_.load(std::memory_order_relaxed) == 0) {
+      return false;
+    }
+    const int self = Self();
+    Task task;
+    bool found = Pop(self, true, task);
+    for (int k = 1; !found && k < size_; ++k) {
+      found = Pop((self + k) % size_, false, task);
+    }
+    if (found) {
+      task();
+    }
+    return found;
+  }
+
+  /// Pin the calling thread to core (modulo the core count)
+  static void PinTo(int core) {
+#ifdef __linux__
+    const int cores = std::thread::hardware_concurrency();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(core % std::max(1, cores), &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+#else
+    (void)core;
+#endif
+  }
+
+  void WorkerLoop(int index) {
+    Index() = index;
+    Owner() = this;
+    if (pin_) {
+      PinTo(index + 1);
+    }
+    // spin a while before sleeping: solvers queue the next sweep quickly
+    const int spins = 1 << 12;
+    int idle = 0;
+    while (!stop_.load(std::memory_order_relaxed)) {
+      if (RunOne()) {
+        idle = 0;
+      } else if (++idle < spins) {
+        std::this_thread::yield();
+      } else {
+        std::unique_lock<std::mutex> lock(sleep_mutex_);
+        sleeping_.fetch_add(1);
+        wake_.wait(lock, [this] { return stop_ || queued_.load() > 0; });
+        sleeping_.fetch_sub(1);
+        idle = 0;
+      }
+    }
+  }
+
+  template <typename Body>
+  void ForRange(TaskGroup &group, long begin, long end, long grain,
+                const Body &body) {
+    while (begin < end) {
+      if (end - begin > grain &&
+          queued_.load(std::memory_order_relaxed) < size_ - 1) {
+        const long mid = begin + (end - begin) / 2;
+        group.Run([this, &group, mid, end, grain, &body] {
+          ForRange(group, mid, end, grain, body);
+        });
+        end = mid;
+        continue;
+      }
+      const long stop = std::min(end, begin + grain);
+      for (long i = begin; i < stop; ++i) {
+        body(i);
+      }
+      begin = stop;
+    }
+  }
+
+  template <typename Map, typename Combine>
+  auto ReduceRange(long begin, long end, long grain, const Map &map,
+                   const Combine &combine) -> decltype(map(begin, end)) {
+    if (end - begin <= grain) {
+      return map(begin, end);
+    }
+    const long mid = begin + (end - begin) / 2;
+    if (size_ == 1) {
+      auto left = ReduceRange(begin, mid, grain, map, combine);
+      return combine(left, ReduceRange(mid, end, grain, map, combine));
+    }
+    decltype(map(begin, end)) right;
+    TaskGroup group(*this);
+    group.Run([&] { right = ReduceRange(mid, end, grain, map, combine); });
+    auto left = ReduceRange(begin, mid, grain, map, combine);
+    group.Wait();
+    return combine(left, right);
+  }
+
+  /// Drop one dependency, queue the node when none is left
+  void Release(const TaskHandle &node) {
+    if (node->deps.fetch_sub(1, std::memory_order_acq_rel) != 1) {
+      return;
+    }
+    Push([this, node] {
+      node->fn();
+      std::vector<TaskHandle> next;
+      {
+        std::lock_guard<std::mutex> lock(node->mutex);
+        node->done.store(true, std::memory_order_release);
+        next.swap(node->next);
+      }
+      for (const auto &n : next) {
+        Release(n);
+      }
+    });
+  }
+
+  const int size_;
+  const bool pin_;
+  std::vector<Queue> queues_;
+  std::vector<std::thread> workers_;
+  std::atomic<long> queued_{0};
+  std::atomic<int> sleeping_{0};
+  std::atomic<bool> stop_{false};
+  std::mutex sleep_mutex_;
+  std::condition_variable wake_;
+};
@@ -0,0 +1,398 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Low-overhead tracing instead of printf under `omp critical`.
+//
+// Every thread writes fixed-size binary events (timestamp, static name, raw
+// argument bytes) into its own ring buffer: one producer and one consumer,
+// so recording is a few stores and a release, no lock, no syscall and no
+// formatting. A background thread drains all rings every millisecond,
+// formats messages and streams everything as Chrome trace JSON (open in
+// chrome://tracing or ui.perfetto.dev); messages are also echoed to stdout
+// from there. A full ring drops events and counts them rather than block the
+// traced code.
+//
+//   Trace::Get().Start("trace.json");   // or Trace::FromEnv() with TRACE=path
+//   { TRACE_SCOPE("sweep"); ... }       // duration event
+//   Trace::Get().Counter("residual", r);
+//   Trace::Get().Message("thread %d done", tid);
+//   Trace::Get().Stop();
+//
+// When no session is running every call is a single relaxed load.
+
+/// Events per thread between two drains, 1 MB
+static const uint32_t TRACE_RING = 1 << 14;
+/// Bytes of message arguments kept per event
+static const int TRACE_ARGS = 39;
+/// Longest formatted message
+static const int TRACE_TEXT = 256;
+
+struct TraceEvent {
+  uint64_t ts;      // Ticks(), converted to steady clock time when written
+  const char *name; // string literal (the format of a message), not copied
+  /// Formats args with name as the printf format, set for messages only
+  int (*format)(const TraceEvent &event, char *out, size_t size);
+  char phase; // 'B' begin, 'E' end, 'C' counter, 'i' instant or message
+  char args[TRACE_ARGS];
+};
+static_assert(sizeof(TraceEvent) == 64, "one event per cache line");
+
+/// Single-producer single-consumer ring of events of one thread
+class TraceRing {
+public:
+  explicit TraceRing(uint32_t tid)
+      : tid_(tid), events_(new TraceEvent[TRACE_RING]) {}
+
+  uint32_t Tid() const { return tid_; }
+
+  bool Push(const TraceEvent &event) {
+    const uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == TRACE_RING) {
+      // only the owner writes it, no read-modify-write needed
+      dropped_.store(dropped_.load(std::memory_order_relaxed) + 1,
+                     std::memory_order_relaxed);
+      return false;
+    }
+    events_[head & (TRACE_RING - 1)] = event;
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// Pass the events recorded so far to f, consumer side only
+  template <typename F> size_t Drain(F f) {
+    const uint64_t tail = tail_.load(std::memory_order_relaxed);
+    const uint64_t head = head_.load(std::memory_order_acquire);
+    for (uint64_t i = tail; i < head; ++i) {
+      f(events_[i & (TRACE_RING - 1)]);
+    }
+    tail_.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+  uint64_t Dropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+  /// Forget the events not drained yet (left over from an earlier
+  /// session), consumer side only
+  void Discard() {
+    tail_.store(head_.load(std::memory_order_acquire),
+                std::memory_order_release);
+  }
+
+private:
+  const uint32_t tid_;
+  std::unique_ptr<TraceEvent[]> events_;
+  alignas(64) std::atomic<uint64_t> head_{0};
+  alignas(64) std::atomic<uint64_t> tail_{0};
+  std::atomic<uint64_t> dropped_{0};
+};
+
+class Trace {
+public:
+  static Trace &Get() {
+    static Trace trace;
+    return trace;
+  }
+
+  /// Start a session if the TRACE environment variable names a file
+  static bool FromEnv(int pid = 0) {
+    const char *path = std::getenv("TRACE");
+    return path != nullptr && Get().Start(path, pid);
+  }
+
+  /// Steady clock, ns: comparable between ranks of a node
+  static uint64_t Now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+  /// Event timestamps: the time stamp counter where there is one (a few ns
+  /// against tens for a clock call), scaled to Now() with the ratio measured
+  /// at Start
+  static uint64_t Ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return Now();
+#endif
+  }
+
+  /// Trace into path ("%d" is replaced with pid, e.g. the MPI rank)
+  bool Start(const std::string &path, int pid = 0, bool echo = true) {
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    if (file_ != nullptr) {
+      return false;
+    }
+    std::string name = path;
+    auto pos = name.find("%d");
+    if (pos != std::string::npos) {
+      name.replace(pos, 2, std::to_string(pid));
+    }
+    file_ = std::fopen(name.c_str(), "w");
+    if (file_ == nullptr) {
+      return false;
+    }
+    std::fprintf(file_, "{\"traceEvents\":[\n");
+    pid_ = pid;
+    echo_ = echo;
+    first_ = true;
+    written_.store(0, std::memory_order_relaxed);
+    dropped_at_start_ = Dropped();
+    {
+      // events pushed after the final drain of the last session
+      std::lock_guard<std::mutex> rings_lock(rings_mutex_);
+      for (auto &ring : rings_) {
+        ring->Discard();
+      }
+    }
+    Calibrate();
+    running_ = true;
+    drain_ = std::thread([this] { DrainLoop(); });
+    enabled_.store(true, std::memory_order_release);
+    return true;
+  }
+
+  /// Stop recording, drain what is left and close the JSON file
+  void Stop() {
+    std::lock_guard<std::mutex> lock(session_mutex_);
+    if (file_ == nullptr) {
+      return;
+    }
+    enabled_.store(false, std::memory_order_release);
+    {
+      std::lock_guard<std::mutex> wake_lock(wake_mutex_);
+      running_ = false;
+    }
+    wake_.notify_one();
+    drain_.join();
+    DrainAll();
+    std::fprintf(file_, "\n],\"otherData\":{\"dropped\":%llu}}\n",
+                 (unsigned long long)(Dropped() - dropped_at_start_));
+    std::fclose(file_);
+    file_ = nullptr;
+  }
+
+  bool Enabled() const { return enabled_.load(std::memory_order_relaxed); }
+
+  void Begin(const char *name) { Record('B', name); }
+  void End(const char *name) { Record('E', name); }
+  void Instant(const char *name) { Record('i', name); }
+  void Counter(const char *name, double value) {
+    if (Enabled()) {
+      TraceEvent event = Event('C', name);
+      std::memcpy(event.args, &value, sizeof(value));
+      Local().Push(event);
+    }
+  }
+
+  /// printf-like message: the arguments are copied as raw bytes and only
+  /// formatted by the drain thread, so pointers (%s) must outlive the
+  /// session, string literals are fine
+  template <typename... Args>
+  void Message(const char *format, const Args &...args) {
+    static_assert(sizeof(std::tuple<Args...>) <= TRACE_ARGS,
+                  "too many message arguments");
+    static_assert((std::is_trivially_copyable<Args>::value && ...),
+                  "message arguments are copied as bytes");
+    if (Enabled()) {
+      TraceEvent event = Event('i', format);
+      event.format = &Format<Args...>;
+      std::tuple<Args...> values(args...);
+      std::memcpy(event.args, &values, sizeof(values));
+      Local().Push(event);
+    }
+  }
+
+  /// Events written and lost to full rings in the current session so far
+  uint64_t Written() const {
+    return written_.load(std::memory_order_relaxed);
+  }
+  uint64_t Dropped() {
+    std::lock_guard<std::mutex> lock(rings_mutex_);
+    uint64_t dropped = 0;
+    for (const auto &ring : rings_) {
+      dropped += ring->Dropped();
+    }
+    return dropped;
+  }
+
+  ~Trace() { Stop(); }
+
+private:
+  Trace() = default;
+
+  TraceEvent Event(char phase, const char *name) {
+    TraceEvent event;
+    event.ts = Ticks();
+    event.name = name;
+    event.format = nullptr;
+    event.phase = phase;
+    return event;
+  }
+
+  void Record(char phase, const char *name) {
+    if (Enabled()) {
+      Local().Push(Event(phase, name));
+    }
+  }
+
+  template <typename... Args>
+  static int Format(const TraceEvent &event, char *out, size_t size) {
+    std::tuple<Args...> values;
+    std::memcpy(static_cast<void *>(&values), event.args, sizeof(values));
+    return std::apply(
+        [&](const Args &...args) {
+          return std::snprintf(out, size, event.name, args...);
+        },
+        values);
+  }
+
+  /// Ring of the calling thread, registered on its first event
+  TraceRing &Local() {
+    static thread_local TraceRing *ring = nullptr;
+    if (ring == nullptr) {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      rings_.emplace_back(new TraceRing(rings_.size()));
+      ring = rings_.back().get();
+    }
+    return *ring;
+  }
+
+  void DrainLoop() {
+    std::unique_lock<std::mutex> lock(wake_mutex_);
+    while (running_) {
+      wake_.wait_for(lock, std::chrono::milliseconds(1));
+      lock.unlock();
+      DrainAll();
+      lock.lock();
+    }
+  }
+
+  /// Ratio of the clocks, measured once per session over 10 ms so that
+  /// all timestamps of a session share one scale
+  void Calibrate() {
+    ticks0_ = Ticks();
+    ns0_ = Now();
+    ns_per_tick_ = 1;
+#if defined(__x86_64__) || defined(__i386__)
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    const uint64_t ticks = Ticks(), ns = Now();
+    if (ticks > ticks0_ && ns > ns0_) {
+      ns_per_tick_ = (double)(ns - ns0_) / (ticks - ticks0_);
+    }
+#endif
+  }
+
+  void DrainAll() {
+    std::vector<TraceRing *> rings;
+    {
+      std::lock_guard<std::mutex> lock(rings_mutex_);
+      for (auto &ring : rings_) {
+        rings.push_back(ring.get());
+      }
+    }
+    for (TraceRing *ring : rings) {
+      ring->Drain([this, ring](const TraceEvent &event) {
+        Write(event, ring->Tid());
+      });
+    }
+    if (echo_) {
+      std::fflush(stdout);
+    }
+  }
+
+  static void Escaped(FILE *file, const char *text) {
+    for (; *text != '\0'; ++text) {
+      if (*text == '"' || *text == '\\') {
+        std::fputc('\\', file);
+      }
+      if ((unsigned char)*text >= ' ') {
+        std::fputc(*text, file);
+      }
+    }
+  }
+
+  double Microseconds(uint64_t ticks) const {
+    return 1e-3 * (ns0_ + ((double)ticks - (double)ticks0_) * ns_per_tick_);
+  }
+
+  void Write(const TraceEvent &event, uint32_t tid) {
+    if (event.ts < ticks0_) {
+      return; // recorded before this session started
+    }
+    const bool message = event.format != nullptr;
+    std::fprintf(file_, "%s{\"name\":\"", first_ ? "" : ",\n");
+    first_ = false;
+    Escaped(file_, message ? "message" : event.name);
+    std::fprintf(file_, "\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%u",
+                 event.phase, Microseconds(event.ts), pid_, tid);
+    if (event.phase == 'C') {
+      double value;
+      std::memcpy(&value, event.args, sizeof(value));
+      std::fprintf(file_, ",\"args\":{\"value\":%.17g}", value);
+    } else if (event.phase == 'i') {
+      std::fprintf(file_, ",\"s\":\"t\"");
+    }
+    if (message) {
+      char text[TRACE_TEXT];
+      event.format(event, text, sizeof(text));
+      std::fprintf(file_, ",\"args\":{\"text\":\"");
+      Escaped(file_, text);
+      std::fprintf(file_, "\"}");
+      if (echo_) {
+        std::printf("[%d:%u] %s\n", pid_, tid, text);
+      }
+    }
+    std::fputc('}', file_);
+    written_.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  std::atomic<bool> enabled_{false};
+  std::mutex session_mutex_, rings_mutex_, wake_mutex_;
+  std::condition_variable wake_;
+  std::vector<std::unique_ptr<TraceRing>> rings_;
+  std::thread drain_;
+  bool running_ = false;
+  FILE *file_ = nullptr;
+  int pid_ = 0;
+  bool echo_ = true, first_ = true;
+  std::atomic<uint64_t> written_{0};
+  uint64_t dropped_at_start_ = 0;
+  uint64_t ticks0_ = 0, ns0_ = 0;
+  double ns_per_tick_ = 1;
+};
+
+/// Duration event covering the enclosing scope
+class TraceScope {
+public:
+  explicit TraceScope(const char *name) : name_(name) {
+    Trace::Get().Begin(name_);
+  }
+  ~TraceScope() { Trace::Get().End(name_); }
+
+private:
+  const char *name_;
+};
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCAT(trace_scope_, __LINE__)(name)
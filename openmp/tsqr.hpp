@@ -0,0 +1,240 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include <omp.h>
+
+#ifdef USE_MPI
+#include <mpi.h>
+#endif
+
+// Tall-skinny QR for least squares min ||A x - b||.
+//
+// Only the triangular factor of the augmented matrix [A | b] is kept:
+// if [A | b] = Q R with R of size (p + 1) x (p + 1), then x solves
+// R[0:p, 0:p] x = R[0:p, p] and |R[p, p]| is the residual norm, so Q is never
+// formed. Every thread folds its rows into its own R chunk by chunk, then the
+// R factors are combined pairwise up a binary tree (and across MPI ranks with
+// USE_MPI). R is stored row-major, n x n, lower part unused.
+
+/// Rows of [A | b] folded at once, small enough to stay in L2
+static const int TSQR_CHUNK = 256;
+
+/// Householder reflections that annihilate `chunk` (c rows, column-major with
+/// leading dimension ld) against the upper triangular R: the QR of [R; chunk]
+/// without touching the zeros below R's diagonal, 2 n^2 c flops.
+inline void QRUpdate(double *R, double *chunk, int c, int ld, int n) {
+  for (int k = 0; k < n; ++k) {
+    double *v = chunk + (long)k * ld;
+    double norm = 0;
+#pragma omp simd reduction(+ : norm)
+    for (int i = 0; i < c; ++i) {
+      norm += v[i] * v[i];
+    }
+    if (norm == 0) {
+      continue;
+    }
+    const double x0 = R[k * n + k];
+    const double alpha = x0 > 0 ? -std::sqrt(x0 * x0 + norm)
+                                : std::sqrt(x0 * x0 + norm);
+    const double v0 = x0 - alpha;
+    const double beta = 1 / (alpha * (alpha - x0)); // 2 / (v . v)
+
+    for (int j = k + 1; j < n; ++j) {
+      double *col = chunk + (long)j * ld;
+      double s = v0 * R[k * n + j];
+#pragma omp simd reduction(+ : s)
+      for (int i = 0; i < c; ++i) {
+        s += v[i] * col[i];
+      }
+      s *= beta;
+      R[k * n + j] -= s * v0;
+#pragma omp simd
+      for (int i = 0; i < c; ++i) {
+        col[i] -= s * v[i];
+      }
+    }
+    R[k * n + k] = alpha;
+  }
+}
+
+/// R1 = triangular factor of [R1; R2]
+inline void QRCombine(double *R1, const double *R2, int n,
+                      std::vector<double> &buffer) {
+  buffer.assign((long)n * n, 0);
+  for (int i = 0; i < n; ++i) {
+    for (int j = i; j < n; ++j) {
+      buffer[(long)j * n + i] = R2[i * n + j];
+    }
+  }
+  QRUpdate(R1, buffer.data(), n, n, n);
+}
+
+/// Fold c rows of a row-major block into R
+inline void QRUpdateRows(double *R, const double *rows, int c, int n,
+                         std::vector<double> &buffer) {
+  buffer.resize((long)c * n);
+  for (int i = 0; i < c; ++i) {
+    for (int j = 0; j < n; ++j) {
+      buffer[(long)j * c + i] = rows[(long)i * n + j];
+    }
+  }
+  QRUpdate(R, buffer.data(), c, c, n);
+}
+
+/// Combine per-thread (or per-rank) factors pairwise: log2(count) levels
+inline void TreeReduce(std::vector<std::vector<double>> &factors, int n) {
+  const int count = factors.size();
+  for (int step = 1; step < count; step *= 2) {
+#pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < count - step; i += 2 * step) {
+      std::vector<double> buffer;
+      QRCombine(factors[i].data(), factors[i + step].data(), n, buffer);
+    }
+  }
+}
+
+/// R factor of the rows produced by `rows(k, block)` for chunks k in
+/// [first, last): fills `block` with up to TSQR_CHUNK row-major rows of n
+/// values and returns how many. Chunks are spread over the threads.
+template <typename Rows>
+std::vector<double> TSQR(long first, long last, int n, Rows rows) {
+  const int threads = omp_get_max_threads();
+  std::vector<std::vector<double>> factors(threads,
+                                           std::vector<double>((long)n * n));
+
+#pragma omp parallel num_threads(threads)
+  {
+    std::vector<double> block((long)TSQR_CHUNK * n), buffer;
+    double *R = factors[omp_get_thread_num()].data();
+#pragma omp for schedule(static)
+    for (long k = first; k < last; ++k) {
+      int c = rows(k, block.data());
+      QRUpdateRows(R, block.data(), c, n, buffer);
+    }
+  }
+
+  TreeReduce(factors, n);
+  return factors[0];
+}
+
+/// TSQR of a row-major m x n matrix in memory
+inline std::vector<double> TSQR(const double *A, long m, int n) {
+  return TSQR(0, (m + TSQR_CHUNK - 1) / TSQR_CHUNK, n,
+              [&](long k, double *block) {
+                long begin = k * TSQR_CHUNK;
+                int c = std::min<long>(TSQR_CHUNK, m - begin);
+                std::copy(A + begin * n, A + (begin + c) * n, block);
+                return c;
+              });
+}
+
+#ifdef USE_MPI
+/// Combine the factors of all ranks up a binary tree, result on rank 0
+inline void TSQRReduce(std::vector<double> &R, int n, MPI_Comm comm) {
+  int rank, size;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &size);
+  std::vector<double> other((long)n * n), buffer;
+  for (int step = 1; step < size; step *= 2) {
+    if (rank % (2 * step) == step) {
+      MPI_Send(R.data(), n * n, MPI_DOUBLE, rank - step, 0, comm);
+      return;
+    }
+    if (rank % (2 * step) == 0 && rank + step < size) {
+      MPI_Recv(other.data(), n * n, MPI_DOUBLE, rank + step, 0, comm,
+               MPI_STATUS_IGNORE);
+      QRCombine(R.data(), other.data(), n, buffer);
+    }
+  }
+}
+#endif
+
+/// Add c row-major rows to the upper triangle of the Gram matrix G = M^T M
+inline void GramUpdate(double *G, const double *rows, int c, int n) {
+  for (int i = 0; i < c; ++i) {
+    const double *row = rows + (long)i * n;
+    for (int j = 0; j < n; ++j) {
+      const double s = row[j];
+      double *g = G + (long)j * n;
+#pragma omp simd
+      for (int l = j; l < n; ++l) {
+        g[l] += s * row[l];
+      }
+    }
+  }
+}
+
+/// Normal equations fast path: Gram matrix of [A | b] summed over threads,
+/// n^2 c flops per chunk, half of TSQR, but the condition number is squared
+template <typename Rows>
+std::vector<double> Gram(long first, long last, int n, Rows rows) {
+  std::vector<double> G((long)n * n);
+  const int threads = omp_get_max_threads();
+  std::vector<std::vector<double>> partial(threads,
+                                           std::vector<double>((long)n * n));
+
+#pragma omp parallel num_threads(threads)
+  {
+    std::vector<double> block((long)TSQR_CHUNK * n);
+    double *mine = partial[omp_get_thread_num()].data();
+#pragma omp for schedule(static)
+    for (long k = first; k < last; ++k) {
+      int c = rows(k, block.data());
+      GramUpdate(mine, block.data(), c, n);
+    }
+  }
+
+  for (const auto &p : partial) {
+    for (long i = 0; i < (long)n * n; ++i) {
+      G[i] += p[i];
+    }
+  }
+  return G;
+}
+
+/// In-place Cholesky G = R^T R of the upper triangle, false if G is not
+/// numerically positive definite. For the Gram matrix of [A | b] R is the
+/// same factor TSQR computes (up to signs of rows).
+inline bool Cholesky(double *G, int n) {
+  for (int k = 0; k < n; ++k) {
+    double d = G[k * n + k];
+    for (int i = 0; i < k; ++i) {
+      d -= G[i * n + k] * G[i * n + k];
+    }
+    if (!(d > 0)) {
+      // last pivot of [A | b] is the squared residual, zero for exact data
+      if (k == n - 1 && d > -1e-12 * std::abs(G[k * n + k])) {
+        G[k * n + k] = 0;
+        return true;
+      }
+      return false;
+    }
+    d = std::sqrt(d);
+    G[k * n + k] = d;
+    for (int j = k + 1; j < n; ++j) {
+      double s = G[k * n + j];
+      for (int i = 0; i < k; ++i) {
+        s -= G[i * n + k] * G[i * n + j];
+      }
+      G[k * n + j] = s / d;
+    }
+  }
+  return true;
+}
+
+/// Solve R[0:p, 0:p] x = R[0:p, p] for the n = p + 1 factor of [A | b]
+inline std::vector<double> SolveFromR(const double *R, int n) {
+  const int p = n - 1;
+  std::vector<double> x(p);
+  for (int i = p - 1; i >= 0; --i) {
+    double s = R[i * n + p];
+    for (int j = i + 1; j < p; ++j) {
+      s -= R[i * n + j] * x[j];
+    }
+    x[i] = s / R[i * n + i];
+  }
+  return x;
+}